@@ -0,0 +1,252 @@
+// Compares the mapped, in-place OBJ tokenizer in objparse::parse with the
+// previous ifstream loader on every asset in src/asset (or the given files).
+//
+// Usage: obj_load_bench [file.obj ...]
+// Only the CPU side is timed; neither loader touches GL here. For each file
+// it prints the triangles each loader produced, whether their vertex data
+// agree, the best time per load, throughput and heap allocations per load.
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "Object.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <new>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Best of at least MIN_REPEAT loads, more for small files while time allows
+const int MIN_REPEAT = 3;
+const int MAX_REPEAT = 200;
+const double MAX_SECONDS = 1.0;
+
+static size_t allocationCount = 0;
+
+void* operator new(size_t size)
+{
+	allocationCount++;
+	if (void* ptr = malloc(size ? size : 1))
+		return ptr;
+	throw bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept
+{
+	free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+	free(ptr);
+}
+
+struct LoadedMesh
+{
+	vector<float> positions;
+	vector<float> normals;
+	vector<float> texcoords;
+	FACETYPE faceType = FACETYPE::TRIANGLE;
+};
+
+static const char* skipSpaces(const char* p, const char* end)
+{
+	while (p < end && (*p == ' ' || *p == '\t'))
+		p++;
+	return p;
+}
+
+static void readFloats(ifstream& fs, float* values, int count)
+{
+	string line;
+	getline(fs, line);
+	const char* p = line.c_str();
+	const char* end = p + line.size();
+	for (int i = 0; i < count; i++)
+	{
+		values[i] = 0.0f;
+		p = fastnum::parseFloat(skipSpaces(p, end), end, values[i]);
+	}
+}
+
+// The Object constructor before the mapped tokenizer, minus the GL upload:
+// one string per line, faces of at most four corners. Out of range indices
+// are clamped so broken files cannot crash the benchmark.
+static bool legacyLoad(const string& filename, LoadedMesh& mesh)
+{
+	vector<int> vertexIndices, uvIndices, normalIndices;
+	vector<glm::vec3> tempVertices;
+	vector<glm::vec3> tempNormals;
+	vector<glm::vec2> tempTexcoords;
+
+	ifstream fs(filename);
+	if (!fs.is_open())
+		return false;
+
+	while (!fs.eof())
+	{
+		string lineHead;
+		fs >> lineHead;
+
+		if (lineHead == "v")
+		{
+			float xyz[3];
+			readFloats(fs, xyz, 3);
+			tempVertices.push_back(glm::vec3(xyz[0], xyz[1], xyz[2]));
+		}
+		else if (lineHead == "vn")
+		{
+			float xyz[3];
+			readFloats(fs, xyz, 3);
+			tempNormals.push_back(glm::vec3(xyz[0], xyz[1], xyz[2]));
+		}
+		else if (lineHead == "vt")
+		{
+			float uv[2];
+			readFloats(fs, uv, 2);
+			tempTexcoords.push_back(glm::vec2(uv[0], uv[1]));
+		}
+		else if (lineHead == "f")
+		{
+			string line;
+			getline(fs, line);
+			const char* p = line.c_str();
+			const char* end = p + line.size();
+			objparse::Index indices[4] = {};
+
+			int numIndices = 0;
+			while (numIndices < 4)
+			{
+				p = skipSpaces(p, end);
+				int triplet[3];
+				const char* next = fastnum::parseIndexTriplet(p, end, triplet, -1);
+				if (next == p)
+					break;
+				indices[numIndices] = objparse::Index{ triplet[0], triplet[1], triplet[2] };
+				numIndices++;
+				p = next;
+			}
+			if (numIndices == 4)
+				mesh.faceType = FACETYPE::QUAD;
+
+			int triangles = mesh.faceType == FACETYPE::QUAD ? 2 : 1;
+			for (int t = 0; t < triangles; t++)
+			{
+				int i = t * 2;
+				for (int corner : { i, i + 1, (i + 2) % 4 })
+				{
+					vertexIndices.push_back(indices[corner].vertex);
+					uvIndices.push_back(indices[corner].uv);
+					normalIndices.push_back(indices[corner].normal);
+				}
+			}
+		}
+	}
+
+	auto clampIndex = [](int index, size_t count) { return min(max(index - 1, 0), int(count) - 1); };
+	for (size_t i = 0; i < vertexIndices.size(); i++)
+	{
+		glm::vec3 vertex = tempVertices.empty() ? glm::vec3(0.0f) : tempVertices[clampIndex(vertexIndices[i], tempVertices.size())];
+		mesh.positions.push_back(vertex.x);
+		mesh.positions.push_back(vertex.y);
+		mesh.positions.push_back(vertex.z);
+
+		glm::vec2 uv(0.0f);
+		if (uvIndices[i] != -1 && !tempTexcoords.empty())
+			uv = tempTexcoords[clampIndex(uvIndices[i], tempTexcoords.size())];
+		mesh.texcoords.push_back(uv.x);
+		mesh.texcoords.push_back(uv.y);
+
+		glm::vec3 normal = tempNormals.empty() ? glm::vec3(0.0f) : tempNormals[clampIndex(normalIndices[i], tempNormals.size())];
+		mesh.normals.push_back(normal.x);
+		mesh.normals.push_back(normal.y);
+		mesh.normals.push_back(normal.z);
+	}
+	return true;
+}
+
+static bool mappedLoad(const string& filename, LoadedMesh& mesh)
+{
+	objparse::MappedFile file;
+	if (!file.open(filename))
+		return false;
+	if (objparse::parse(file.data(), file.size(), mesh.positions, mesh.normals, mesh.texcoords))
+		mesh.faceType = FACETYPE::QUAD;
+	return true;
+}
+
+struct BenchResult
+{
+	double bestMs = 1e30;
+	size_t allocations = 0;
+	LoadedMesh mesh;
+};
+
+static bool bench(bool (*load)(const string&, LoadedMesh&), const string& path, BenchResult& result)
+{
+	auto started = chrono::steady_clock::now();
+	for (int i = 0; i < MIN_REPEAT
+		|| (i < MAX_REPEAT && chrono::steady_clock::now() - started < chrono::duration<double>(MAX_SECONDS)); i++)
+	{
+		LoadedMesh mesh;
+		size_t allocationsBefore = allocationCount;
+		auto start = chrono::steady_clock::now();
+		bool ok = load(path, mesh);
+		chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+		if (!ok)
+			return false;
+		result.allocations = allocationCount - allocationsBefore;
+		result.bestMs = min(result.bestMs, elapsed.count());
+		if (i == 0)
+			result.mesh = move(mesh);
+	}
+	return true;
+}
+
+static void benchFile(const string& path)
+{
+	BenchResult legacy, mapped;
+	if (!bench(legacyLoad, path, legacy) || !bench(mappedLoad, path, mapped))
+	{
+		fprintf(stderr, "Failed to load %s\n", path.c_str());
+		return;
+	}
+
+	double megabytes = filesystem::file_size(path) / 1e6;
+	bool same = legacy.mesh.positions == mapped.mesh.positions && legacy.mesh.normals == mapped.mesh.normals
+		&& legacy.mesh.texcoords == mapped.mesh.texcoords;
+	string name = filesystem::path(path).filename().string();
+	printf("%-16s %6zu/%-6zu tris %-9s %9.1f us %9.1f us %8.1f MB/s %8.1f MB/s %7zu allocs %5zu allocs %6.2fx\n",
+		name.c_str(), legacy.mesh.positions.size() / 9, mapped.mesh.positions.size() / 9, same ? "same" : "differ",
+		legacy.bestMs * 1000.0, mapped.bestMs * 1000.0, megabytes / legacy.bestMs * 1000.0,
+		megabytes / mapped.bestMs * 1000.0, legacy.allocations, mapped.allocations, legacy.bestMs / mapped.bestMs);
+}
+
+int main(int argc, char** argv)
+{
+	vector<string> paths;
+	for (int i = 1; i < argc; i++)
+		paths.push_back(argv[i]);
+	if (paths.empty())
+	{
+		for (const auto& entry : filesystem::directory_iterator(BENCH_ASSET_DIR))
+		{
+			if (entry.path().extension() == ".obj")
+				paths.push_back(entry.path().string());
+		}
+		sort(paths.begin(), paths.end());
+	}
+
+	printf("%-16s %-18s %-9s %12s %12s %13s %13s %14s %12s %7s\n", "file", "tris (old/new)", "output",
+		"old", "mapped", "old", "mapped", "old", "mapped", "speedup");
+	for (const string& path : paths)
+		benchFile(path);
+	return 0;
+}
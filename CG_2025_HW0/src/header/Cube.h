@@ -1,15 +1,66 @@
+#pragma once
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <bits/stdc++.h>
+
+#include "Primitives.h"
+
 using namespace std;
+
+// Unit cube centered on the origin, built from the compile-time mesh in
+// Primitives.h instead of parsing cube.obj: one interleaved vertex buffer
+// and 16-bit indices.
 class Cube{
 public:
     void draw();
     void change_color(int r, int g, int b);
     Cube();
+    ~Cube();
 private: 
     unsigned int VAO;
+    unsigned int VBO;
+    unsigned int EBO;
     glm::vec3 color;
-};
\ No newline at end of file
+};
+
+inline Cube::Cube() : color(1.0f, 1.0f, 1.0f){
+    const PrimitiveMesh<24, 36>& mesh = primitiveCube();
+    glGenVertexArrays(1, &VAO);
+    glBindVertexArray(VAO);
+
+    glGenBuffers(1, &VBO);
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(mesh.vertices), mesh.vertices, GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(PrimitiveVertex), (void*)offsetof(PrimitiveVertex, position));
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(PrimitiveVertex), (void*)offsetof(PrimitiveVertex, normal));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(PrimitiveVertex), (void*)offsetof(PrimitiveVertex, texcoord));
+    glEnableVertexAttribArray(2);
+
+    // Recorded in the VAO
+    glGenBuffers(1, &EBO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(mesh.indices), mesh.indices, GL_STATIC_DRAW);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+inline Cube::~Cube(){
+    glDeleteVertexArrays(1, &VAO);
+    glDeleteBuffers(1, &VBO);
+    glDeleteBuffers(1, &EBO);
+}
+
+// 0-255 per channel
+inline void Cube::change_color(int r, int g, int b){
+    color = glm::vec3(r / 255.0f, g / 255.0f, b / 255.0f);
+}
+
+inline void Cube::draw(){
+    glBindVertexArray(VAO);
+    glDrawElements(GL_TRIANGLES, PrimitiveMesh<24, 36>::indexCount, GL_UNSIGNED_SHORT, 0);
+}
@@ -0,0 +1,258 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iterator>
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "fast_number.h"
+
+using namespace std;
+
+// The GL-free half of the OBJ loader: mapping the file and turning its text
+// into vertex arrays. Kept apart from Object.h, and in a namespace of its
+// own, so tools can include it next to another Object (HW1's mesh_bench).
+namespace objparse
+{
+
+// Read-only view of a whole file. Uses mmap where available so the text can
+// be tokenized in place; elsewhere the file is read into one buffer.
+class MappedFile
+{
+public:
+	MappedFile() {}
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	~MappedFile() { close(); }
+
+	bool open(const string& path)
+	{
+		close();
+#if defined(__linux__) || defined(__APPLE__)
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0)
+			return false;
+		struct stat st;
+		if (fstat(fd, &st) != 0)
+		{
+			::close(fd);
+			return false;
+		}
+		// An empty file is valid, there is just nothing to map
+		if (st.st_size == 0)
+		{
+			::close(fd);
+			return true;
+		}
+		void* ptr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);
+		if (ptr == MAP_FAILED)
+			return false;
+		madvise(ptr, st.st_size, MADV_SEQUENTIAL);
+		map_ptr = ptr;
+		map_size = st.st_size;
+		return true;
+#else
+		ifstream fs(path, ios::binary);
+		if (!fs.is_open())
+			return false;
+		fallback.assign(istreambuf_iterator<char>(fs), istreambuf_iterator<char>());
+		return true;
+#endif
+	}
+
+	void close()
+	{
+#if defined(__linux__) || defined(__APPLE__)
+		if (map_ptr)
+			munmap(map_ptr, map_size);
+		map_ptr = nullptr;
+		map_size = 0;
+#else
+		fallback.clear();
+#endif
+	}
+
+	const char* data() const
+	{
+#if defined(__linux__) || defined(__APPLE__)
+		return static_cast<const char*>(map_ptr);
+#else
+		return fallback.data();
+#endif
+	}
+
+	size_t size() const
+	{
+#if defined(__linux__) || defined(__APPLE__)
+		return map_size;
+#else
+		return fallback.size();
+#endif
+	}
+
+private:
+#if defined(__linux__) || defined(__APPLE__)
+	void* map_ptr = nullptr;
+	size_t map_size = 0;
+#else
+	vector<char> fallback;
+#endif
+};
+
+struct Index
+{
+	int vertex;
+	int uv;
+	int normal;
+};
+
+inline bool isSpace(char c)
+{
+	return c == ' ' || c == '\t';
+}
+
+inline const char* skipSpaces(const char* p, const char* end)
+{
+	while (p < end && isSpace(*p))
+		p++;
+	return p;
+}
+
+// Parse up to `count` floats from [p, end) and append them to `values`.
+// Locale independent and without going through a stream's num_get.
+inline void readFloats(const char* p, const char* end, vector<float>& values, int count)
+{
+	for (int i = 0; i < count; i++)
+	{
+		float value = 0.0f;
+		p = fastnum::parseFloat(skipSpaces(p, end), end, value);
+		values.push_back(value);
+	}
+}
+
+// Zero-based element of an OBJ reference into `count` elements, -1 if none
+inline int resolveIndex(int index, size_t count)
+{
+	if (index > 0)
+		return index - 1;
+	if (index < 0 && size_t(-index) <= count)
+		return int(count) + index;
+	return -1;
+}
+
+// Element `index` of `pool`, zero if it has none
+inline void copyElement(const vector<float>& pool, int index, int width, float* dst)
+{
+	bool valid = index >= 0 && size_t(index + 1) * width <= pool.size();
+	for (int k = 0; k < width; k++)
+		dst[k] = valid ? pool[size_t(index) * width + k] : 0.0f;
+}
+
+// Tokenize OBJ text in place and expand it into per-corner positions,
+// normals and texcoords, three corners per triangle. Polygons of any size
+// are fan triangulated; returns true if any face has more than three
+// corners. Missing or out of range references read as zero.
+// Nothing is allocated per line: the only growth is the attribute pools
+// and the corner list. Needs no GL context.
+inline bool parse(const char* data, size_t size, vector<float>& positions, vector<float>& normals,
+	vector<float>& texcoords)
+{
+	vector<float> tempVertices, tempNormals, tempTexcoords;
+	vector<Index> corners;
+	bool quads = false;
+
+	const char* p = data;
+	const char* end = data + size;
+	while (p < end)
+	{
+		const char* lineEnd = fastnum::findByte(p, end, '\n');
+		const char* q = skipSpaces(p, lineEnd);
+		size_t length = lineEnd - q;
+
+		// This line represents a vertex coordinate
+		if (length >= 2 && q[0] == 'v' && isSpace(q[1]))
+		{
+			readFloats(q + 2, lineEnd, tempVertices, 3);
+		}
+		// This line represents a normal
+		else if (length >= 3 && q[0] == 'v' && q[1] == 'n' && isSpace(q[2]))
+		{
+			readFloats(q + 3, lineEnd, tempNormals, 3);
+		}
+		// This line represents a texture coordinate
+		else if (length >= 3 && q[0] == 'v' && q[1] == 't' && isSpace(q[2]))
+		{
+			readFloats(q + 3, lineEnd, tempTexcoords, 2);
+		}
+		// This line represents a face: "v/vt/vn" triplets until the end of line
+		else if (length >= 2 && q[0] == 'f' && isSpace(q[1]))
+		{
+			const char* c = q + 2;
+			Index first, previous;
+			int numIndices = 0;
+			while (true)
+			{
+				c = skipSpaces(c, lineEnd);
+				int triplet[3];
+				const char* next = fastnum::parseIndexTriplet(c, lineEnd, triplet, 0);
+				if (next == c)
+					break;
+				c = next;
+
+				// OBJ indices are 1-based, negative ones count back from the
+				// newest element; -1 marks a missing member
+				Index index{ resolveIndex(triplet[0], tempVertices.size() / 3),
+					resolveIndex(triplet[1], tempTexcoords.size() / 2),
+					resolveIndex(triplet[2], tempNormals.size() / 3) };
+				// Fan around the first corner. Triangles after the first
+				// start at `previous`, so quads split into (0,1,2) (2,3,0)
+				// exactly as before
+				if (numIndices == 2)
+				{
+					corners.push_back(first);
+					corners.push_back(previous);
+					corners.push_back(index);
+				}
+				else if (numIndices > 2)
+				{
+					corners.push_back(previous);
+					corners.push_back(index);
+					corners.push_back(first);
+				}
+				else if (numIndices == 0)
+				{
+					first = index;
+				}
+				previous = index;
+				numIndices++;
+			}
+			// Check face type
+			if (numIndices >= 4)
+				quads = true;
+		}
+		p = lineEnd + 1;
+	}
+
+	// Store information of object
+	size_t count = corners.size();
+	positions.resize(count * 3);
+	normals.resize(count * 3);
+	texcoords.resize(count * 2);
+	for (size_t i = 0; i < count; i++)
+	{
+		const Index& index = corners[i];
+		copyElement(tempVertices, index.vertex, 3, &positions[i * 3]);
+		copyElement(tempTexcoords, index.uv, 2, &texcoords[i * 2]);
+		copyElement(tempNormals, index.normal, 3, &normals[i * 3]);
+	}
+	return quads;
+}
+
+}
@@ -5,6 +5,7 @@
 
 #include "./header/Shader.h"
 #include "./header/Object.h"
+#include "./header/Cube.h"
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void processInput(GLFWwindow *window);
@@ -15,7 +16,7 @@ const unsigned int SCR_HEIGHT = 600;
 
 float rY = 0;
 Shader *shader;
-Object *cube;
+Cube *cube;
 
 void drawModel(const string& name, 
                glm::mat4 model, glm::mat4 view, glm::mat4 projection, 
@@ -76,7 +77,7 @@ int main()
     string v = dirShader + "easy.vert";
     string f = dirShader + "easy.frag";
     shader = new Shader(v.c_str(),f.c_str());
-    cube = new Object(dirAsset + "cube.obj");
+    cube = new Cube();
 
     // render loop
     // -----------
@@ -0,0 +1,523 @@
+// CPU side OBJ loading benchmark for both assignments' loaders.
+//
+// Usage: mesh_bench [options] [file.obj ...]
+//   --faces 10K,100K,1M        synthetic face counts, K/M suffixes, up to 50M
+//   --attributes ptn           attribute mixes: p, pt, pn, ptn
+//   --groups 1,1000            `o`/`g` groups per synthetic file
+//   --polygon 3                corners per synthetic face, 3 or 4
+//   --loaders hw0,hw1,hw1_serial
+//   --repeat 3                 loads per file and loader, best time wins
+//   --dir .                    where synthetic files are written
+//   --keep                     keep synthetic files instead of removing them
+//   --no-assets                skip the shipped assets
+//   --out results.json         write the JSON here instead of stdout
+//
+// Runs every loader over the shipped assets of both assignments, the given
+// files and one generated file per combination of faces, attributes, groups
+// and polygon size. Loaders: hw0 is CG_2025_HW0's mapped tokenizer
+// (objparse::parse), hw1 and hw1_serial are Object::loadOBJ with and without
+// the parallel tinyobj parse. No GL context is created. Per file and loader
+// the JSON holds the best time, MB/s, faces/s, peak RSS and heap
+// allocations; progress goes to stderr.
+
+#include <glad/glad.h>
+
+#include "Object.h"
+#include "../../CG_2025_HW0/src/header/ObjParse.h"
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+using namespace std;
+
+// Every operator new in the process is counted; LoadObjParallel allocates
+// from several threads
+static atomic<size_t> allocationCount{ 0 };
+static atomic<size_t> allocationBytes{ 0 };
+
+void* operator new(size_t size)
+{
+	allocationCount.fetch_add(1, memory_order_relaxed);
+	allocationBytes.fetch_add(size, memory_order_relaxed);
+	if (void* ptr = malloc(size ? size : 1))
+		return ptr;
+	throw bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept
+{
+	free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+	free(ptr);
+}
+
+// Peak resident set size. On Linux the high-water mark can be reset between
+// loads, so each result gets its own peak; elsewhere it only grows over the
+// run and later results include earlier peaks.
+static bool resetPeakRss()
+{
+#if defined(__linux__)
+	ofstream fs("/proc/self/clear_refs");
+	fs << "5";
+	fs.close();
+	return !fs.fail();
+#else
+	return false;
+#endif
+}
+
+static size_t peakRssBytes()
+{
+#if defined(__linux__)
+	ifstream fs("/proc/self/status");
+	string line;
+	while (getline(fs, line)) {
+		if (line.compare(0, 6, "VmHWM:") == 0)
+			return strtoull(line.c_str() + 6, nullptr, 10) * 1024;
+	}
+	return 0;
+#elif defined(__APPLE__)
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return size_t(usage.ru_maxrss); // bytes on macOS
+#else
+	return 0;
+#endif
+}
+
+struct SyntheticSpec
+{
+	size_t faces = 0;
+	string attributes = "ptn";
+	int groups = 1;
+	int polygon = 3;
+
+	bool hasUv() const { return attributes.find('t') != string::npos; }
+	bool hasNormal() const { return attributes.find('n') != string::npos; }
+};
+
+// Buffered text output with std::to_chars, fast enough for multi-GB files
+class ObjWriter
+{
+public:
+	explicit ObjWriter(FILE* file) : file(file), buffer(1 << 20) {}
+	~ObjWriter() { flush(); }
+
+	void text(const char* s)
+	{
+		while (*s) {
+			reserve(1);
+			buffer[used++] = *s++;
+		}
+	}
+	void number(size_t value)
+	{
+		reserve(24);
+		used = to_chars(&buffer[used], &buffer[0] + buffer.size(), value).ptr - &buffer[0];
+	}
+	void number(float value)
+	{
+		reserve(48);
+		used = to_chars(&buffer[used], &buffer[0] + buffer.size(), value, chars_format::fixed, 5).ptr - &buffer[0];
+	}
+	void flush()
+	{
+		fwrite(buffer.data(), 1, used, file);
+		used = 0;
+	}
+
+private:
+	void reserve(size_t bytes)
+	{
+		if (used + bytes > buffer.size())
+			flush();
+	}
+
+	FILE* file;
+	vector<char> buffer;
+	size_t used = 0;
+};
+
+// Faces are spread evenly over the groups; each group is a square grid patch
+// with its own positions, uvs and normals, so every index stays local.
+static bool writeSyntheticObj(const string& path, const SyntheticSpec& spec)
+{
+	FILE* file = fopen(path.c_str(), "wb");
+	if (!file)
+		return false;
+	{
+		ObjWriter out(file);
+		size_t vertexBase = 0;
+		for (int g = 0; g < spec.groups; g++) {
+			size_t faces = spec.faces / spec.groups + (size_t(g) < spec.faces % spec.groups ? 1 : 0);
+			size_t cells = spec.polygon == 4 ? faces : (faces + 1) / 2;
+			size_t side = max<size_t>(1, size_t(ceil(sqrt(double(cells)))));
+
+			out.text(g % 2 ? "g group" : "o object");
+			out.number(size_t(g));
+			out.text("\n");
+			for (size_t y = 0; y <= side; y++) {
+				for (size_t x = 0; x <= side; x++) {
+					float u = float(x) / side, v = float(y) / side;
+					float height = 0.05f * sin(u * 6.2831853f) * cos(v * 6.2831853f);
+					out.text("v ");
+					out.number(u + g);
+					out.text(" ");
+					out.number(height);
+					out.text(" ");
+					out.number(v);
+					out.text("\n");
+					if (spec.hasUv()) {
+						out.text("vt ");
+						out.number(u);
+						out.text(" ");
+						out.number(v);
+						out.text("\n");
+					}
+					if (spec.hasNormal()) {
+						glm::vec3 n = glm::normalize(glm::vec3(-height, 1.0f, height));
+						out.text("vn ");
+						out.number(n.x);
+						out.text(" ");
+						out.number(n.y);
+						out.text(" ");
+						out.number(n.z);
+						out.text("\n");
+					}
+				}
+			}
+
+			auto corner = [&](size_t index) {
+				out.text(" ");
+				out.number(index);
+				if (spec.hasUv() || spec.hasNormal()) {
+					out.text("/");
+					if (spec.hasUv())
+						out.number(index);
+					if (spec.hasNormal()) {
+						out.text("/");
+						out.number(index);
+					}
+				}
+			};
+			size_t emitted = 0;
+			for (size_t cell = 0; emitted < faces; cell++) {
+				size_t a = vertexBase + (cell / side) * (side + 1) + cell % side + 1;
+				size_t b = a + 1, c = a + side + 2, d = a + side + 1;
+				if (spec.polygon == 4) {
+					out.text("f");
+					corner(a), corner(b), corner(c), corner(d);
+					out.text("\n");
+					emitted++;
+					continue;
+				}
+				out.text("f");
+				corner(a), corner(b), corner(c);
+				out.text("\n");
+				if (++emitted < faces) {
+					out.text("f");
+					corner(a), corner(c), corner(d);
+					out.text("\n");
+					emitted++;
+				}
+			}
+			vertexBase += (side + 1) * (side + 1);
+		}
+	}
+	return fclose(file) == 0;
+}
+
+static size_t countFaces(const string& path)
+{
+	MappedFile file;
+	if (!file.open(path))
+		return 0;
+	const char* p = reinterpret_cast<const char*>(file.data());
+	const char* end = p + file.size();
+	size_t faces = 0;
+	while (p < end) {
+		while (p < end && (*p == ' ' || *p == '\t'))
+			p++;
+		if (end - p >= 2 && p[0] == 'f' && (p[1] == ' ' || p[1] == '\t'))
+			faces++;
+		p = fastnum::findByte(p, end, '\n') + 1;
+	}
+	return faces;
+}
+
+static bool loadHw0Obj(const string& path, size_t& triangles)
+{
+	objparse::MappedFile file;
+	if (!file.open(path))
+		return false;
+	vector<float> positions, normals, texcoords;
+	objparse::parse(file.data(), file.size(), positions, normals, texcoords);
+	triangles = positions.size() / 9;
+	return true;
+}
+
+static bool loadHw1Obj(const string& path, bool parallel, size_t& triangles)
+{
+	ObjectConfig config;
+	config.binaryCache = false;
+	config.parallelParse = parallel;
+	Object object(config);
+	if (!object.loadOBJ(path))
+		return false;
+	triangles = object.positions.size() / 9;
+	return true;
+}
+
+struct Loader
+{
+	string name;
+	bool (*load)(const string& path, size_t& triangles);
+};
+
+static const Loader LOADERS[] = {
+	{ "hw0", loadHw0Obj },
+	{ "hw1", [](const string& path, size_t& triangles) { return loadHw1Obj(path, true, triangles); } },
+	{ "hw1_serial", [](const string& path, size_t& triangles) { return loadHw1Obj(path, false, triangles); } },
+};
+
+struct BenchInput
+{
+	string path;
+	string source; // "asset", "file" or "synthetic"
+	SyntheticSpec spec;
+};
+
+struct BenchResult
+{
+	double seconds = 1e30;
+	size_t triangles = 0;
+	size_t peakRss = 0;
+	size_t allocations = 0;
+	size_t allocatedBytes = 0;
+};
+
+static bool runLoader(const Loader& loader, const string& path, int repeat, BenchResult& result)
+{
+	for (int i = 0; i < repeat; i++) {
+		resetPeakRss();
+		size_t allocationsBefore = allocationCount.load();
+		size_t bytesBefore = allocationBytes.load();
+		auto start = chrono::steady_clock::now();
+		size_t triangles = 0;
+		bool ok = loader.load(path, triangles);
+		chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+		if (!ok)
+			return false;
+		result.seconds = min(result.seconds, elapsed.count());
+		result.triangles = triangles;
+		result.peakRss = max(result.peakRss, peakRssBytes());
+		result.allocations = allocationCount.load() - allocationsBefore;
+		result.allocatedBytes = allocationBytes.load() - bytesBefore;
+	}
+	return true;
+}
+
+static string jsonString(const string& s)
+{
+	string quoted = "\"";
+	for (char c : s) {
+		if (static_cast<unsigned char>(c) < 0x20) {
+			char escaped[8];
+			snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned char>(c));
+			quoted += escaped;
+			continue;
+		}
+		if (c == '"' || c == '\\')
+			quoted += '\\';
+		quoted += c;
+	}
+	return quoted + "\"";
+}
+
+static vector<string> splitList(const string& list)
+{
+	vector<string> items;
+	stringstream ss(list);
+	string item;
+	while (getline(ss, item, ','))
+		if (!item.empty())
+			items.push_back(item);
+	return items;
+}
+
+static size_t parseCount(const string& text)
+{
+	size_t value = strtoull(text.c_str(), nullptr, 10);
+	char suffix = text.empty() ? 0 : char(toupper(text.back()));
+	return suffix == 'K' ? value * 1000 : suffix == 'M' ? value * 1000000 : value;
+}
+
+int main(int argc, char** argv)
+{
+	vector<string> faceCounts = { "10K", "100K", "1M" };
+	vector<string> attributeMixes = { "ptn" };
+	vector<string> groupCounts = { "1", "1000" };
+	vector<string> polygons = { "3" };
+	vector<string> loaderNames = { "hw0", "hw1", "hw1_serial" };
+	int repeat = 3;
+	string directory = ".";
+	string outPath;
+	bool keep = false, assets = true;
+	vector<BenchInput> inputs;
+
+	for (int i = 1; i < argc; i++) {
+		string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--faces" && hasValue)
+			faceCounts = splitList(argv[++i]);
+		else if (arg == "--attributes" && hasValue)
+			attributeMixes = splitList(argv[++i]);
+		else if (arg == "--groups" && hasValue)
+			groupCounts = splitList(argv[++i]);
+		else if (arg == "--polygon" && hasValue)
+			polygons = splitList(argv[++i]);
+		else if (arg == "--loaders" && hasValue)
+			loaderNames = splitList(argv[++i]);
+		else if (arg == "--repeat" && hasValue)
+			repeat = max(1, atoi(argv[++i]));
+		else if (arg == "--dir" && hasValue)
+			directory = argv[++i];
+		else if (arg == "--out" && hasValue)
+			outPath = argv[++i];
+		else if (arg == "--keep")
+			keep = true;
+		else if (arg == "--no-assets")
+			assets = false;
+		else if (arg.compare(0, 2, "--") == 0) {
+			cerr << "Unknown option " << arg << endl;
+			return 1;
+		} else
+			inputs.push_back({ arg, "file", SyntheticSpec() });
+	}
+
+	vector<const Loader*> loaders;
+	for (const string& name : loaderNames) {
+		auto found = find_if(begin(LOADERS), end(LOADERS), [&](const Loader& loader) { return loader.name == name; });
+		if (found == end(LOADERS)) {
+			cerr << "Unknown loader " << name << endl;
+			return 1;
+		}
+		loaders.push_back(found);
+	}
+
+	if (assets) {
+		vector<string> paths;
+		for (const char* dir : { BENCH_ASSET_DIR, HW0_ASSET_DIR }) {
+			for (const auto& entry : filesystem::directory_iterator(dir))
+				if (entry.path().extension() == ".obj")
+					paths.push_back(entry.path().string());
+		}
+		sort(paths.begin(), paths.end());
+		for (const string& path : paths)
+			inputs.push_back({ path, "asset", SyntheticSpec() });
+	}
+
+	for (const string& faces : faceCounts) {
+		for (const string& attributes : attributeMixes) {
+			for (const string& groups : groupCounts) {
+				for (const string& polygon : polygons) {
+					SyntheticSpec spec;
+					spec.faces = parseCount(faces);
+					spec.attributes = attributes;
+					spec.groups = max(1, atoi(groups.c_str()));
+					spec.polygon = polygon == "4" ? 4 : 3;
+					if (spec.faces == 0 || attributes.empty() || attributes[0] != 'p') {
+						cerr << "Skipping synthetic " << faces << " faces, attributes " << attributes << endl;
+						continue;
+					}
+					string name = "mesh_bench_" + faces + "_" + attributes + "_g" + to_string(spec.groups)
+						+ "_" + to_string(spec.polygon) + ".obj";
+					inputs.push_back({ (filesystem::path(directory) / name).string(), "synthetic", spec });
+				}
+			}
+		}
+	}
+
+	bool rssResettable = resetPeakRss();
+	stringstream json;
+	json << "{\n  \"benchmark\": \"mesh_bench\",\n  \"repeat\": " << repeat
+		<< ",\n  \"peak_rss_per_result\": " << (rssResettable ? "true" : "false") << ",\n  \"results\": [";
+	bool firstResult = true;
+
+	for (const BenchInput& input : inputs) {
+		if (input.source == "synthetic") {
+			cerr << "Writing " << input.path << endl;
+			if (!writeSyntheticObj(input.path, input.spec)) {
+				cerr << "Failed to write " << input.path << endl;
+				continue;
+			}
+		}
+		error_code ec;
+		size_t bytes = filesystem::file_size(input.path, ec);
+		if (ec) {
+			cerr << "Failed to open " << input.path << endl;
+			continue;
+		}
+		size_t faces = countFaces(input.path);
+
+		for (const Loader* loader : loaders) {
+			BenchResult result;
+			if (!runLoader(*loader, input.path, repeat, result)) {
+				cerr << loader->name << " failed to load " << input.path << endl;
+				continue;
+			}
+			double megabytesPerSecond = bytes / 1e6 / result.seconds;
+			double facesPerSecond = faces / result.seconds;
+			fprintf(stderr, "%-48s %-10s %10.2f ms %9.1f MB/s %12.0f faces/s %7.1f MB RSS %10zu allocs\n",
+				filesystem::path(input.path).filename().string().c_str(), loader->name.c_str(), result.seconds * 1000.0,
+				megabytesPerSecond, facesPerSecond, result.peakRss / 1e6, result.allocations);
+
+			json << (firstResult ? "\n" : ",\n") << "    {\"file\": " << jsonString(input.path)
+				<< ", \"source\": \"" << input.source << "\"";
+			if (input.source == "synthetic") {
+				json << ", \"attributes\": \"" << input.spec.attributes << "\", \"groups\": " << input.spec.groups
+					<< ", \"polygon\": " << input.spec.polygon;
+			}
+			json << ", \"loader\": \"" << loader->name << "\", \"bytes\": " << bytes << ", \"faces\": " << faces
+				<< ", \"triangles\": " << result.triangles << ", \"seconds\": " << result.seconds
+				<< ", \"mb_per_s\": " << megabytesPerSecond << ", \"faces_per_s\": " << facesPerSecond
+				<< ", \"peak_rss_bytes\": " << result.peakRss << ", \"allocations\": " << result.allocations
+				<< ", \"allocated_bytes\": " << result.allocatedBytes << "}";
+			firstResult = false;
+		}
+
+		if (input.source == "synthetic" && !keep)
+			filesystem::remove(input.path, ec);
+	}
+	json << "\n  ]\n}\n";
+
+	if (outPath.empty()) {
+		cout << json.str();
+	} else {
+		ofstream fs(outPath);
+		fs << json.str();
+		if (!fs) {
+			cerr << "Failed to write " << outPath << endl;
+			return 1;
+		}
+	}
+	return 0;
+}
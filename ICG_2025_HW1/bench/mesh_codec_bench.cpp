@@ -0,0 +1,147 @@
+// Compression ratio and decode speed of MeshCodec.h.
+//
+// Usage: mesh_codec_bench [--layout quantized|packed|interleaved] [file.obj ...]
+//
+// Every OBJ in src/asset (or the given files) is prepared the way a cache
+// miss would be, without writing a .meshbin, and its vertex and index
+// buffers are encoded. Decoding runs until it has taken at least a quarter
+// of a second and the best pass is reported, next to a plain memcpy of the
+// same bytes. Every pass is checked against the original buffers. No GL
+// context is created, so decoding goes to ordinary memory here rather than
+// a mapped buffer.
+
+#include <glad/glad.h>
+
+#include "Object.h"
+#include "MeshCodec.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+const double MIN_SECONDS = 0.25;
+const int MIN_REPEAT = 5;
+
+struct Result
+{
+	size_t rawBytes = 0;
+	size_t encodedBytes = 0;
+	double encodeSeconds = 0.0;
+	double decodeSeconds = 0.0;
+	double copySeconds = 0.0;
+	bool exact = true;
+};
+
+// Best time of `pass` over at least MIN_REPEAT runs and MIN_SECONDS
+template <class Pass>
+static double bestTime(Pass&& pass)
+{
+	double best = 1e30, total = 0.0;
+	for (int i = 0; i < MIN_REPEAT || total < MIN_SECONDS; i++) {
+		auto start = chrono::steady_clock::now();
+		pass();
+		chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+		best = min(best, elapsed.count());
+		total += elapsed.count();
+	}
+	return best;
+}
+
+static bool measure(const string& path, VERTEXLAYOUT layout, Result& result)
+{
+	ObjectConfig config;
+	config.binaryCache = false;
+	config.layout = layout;
+	Object object(config);
+	PreparedMesh mesh;
+	if (!object.prepare(path, mesh))
+		return false;
+	const MeshBlob& blob = mesh.blob;
+	size_t stride = blob.format.vertexSize;
+	size_t indexSize = blob.indexCount ? blob.indexBytes / blob.indexCount : 0;
+
+	vector<unsigned char> vertices, indices;
+	result.encodeSeconds = bestTime([&] {
+		vertices = encodeVertexBuffer(blob.vertexData, blob.vertexCount, stride);
+		if (blob.indexCount)
+			indices = encodeIndexBuffer(blob.indexData, blob.indexCount, indexSize);
+	});
+	result.rawBytes = blob.vertexBytes + blob.indexBytes;
+	result.encodedBytes = vertices.size() + indices.size();
+
+	vector<unsigned char> decodedVertices(blob.vertexBytes), decodedIndices(blob.indexBytes);
+	result.decodeSeconds = bestTime([&] {
+		result.exact &= decodeVertexBuffer(decodedVertices.data(), blob.vertexCount, stride, vertices.data(),
+			vertices.size());
+		if (blob.indexCount)
+			result.exact &= decodeIndexBuffer(decodedIndices.data(), blob.indexCount, indexSize, indices.data(),
+				indices.size());
+	});
+	result.exact = result.exact && memcmp(decodedVertices.data(), blob.vertexData, blob.vertexBytes) == 0
+		&& (!blob.indexBytes || memcmp(decodedIndices.data(), blob.indexData, blob.indexBytes) == 0);
+
+	result.copySeconds = bestTime([&] {
+		memcpy(decodedVertices.data(), blob.vertexData, blob.vertexBytes);
+		if (blob.indexBytes)
+			memcpy(decodedIndices.data(), blob.indexData, blob.indexBytes);
+	});
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	VERTEXLAYOUT layout = VERTEXLAYOUT::QUANTIZED;
+	vector<string> files;
+	for (int i = 1; i < argc; i++) {
+		string arg = argv[i];
+		if (arg == "--layout" && i + 1 < argc) {
+			string name = argv[++i];
+			if (name == "packed")
+				layout = VERTEXLAYOUT::PACKED;
+			else if (name == "interleaved")
+				layout = VERTEXLAYOUT::INTERLEAVED;
+			else if (name != "quantized") {
+				fprintf(stderr, "Unknown layout: %s\n", name.c_str());
+				return 1;
+			}
+		} else {
+			files.push_back(arg);
+		}
+	}
+	if (files.empty()) {
+		for (const auto& entry : filesystem::directory_iterator(BENCH_ASSET_DIR))
+			if (entry.path().extension() == ".obj")
+				files.push_back(entry.path().string());
+		sort(files.begin(), files.end());
+	}
+
+	printf("%s layout\n", layoutName(layout));
+	printf("%-14s %10s %10s %7s %10s %12s %12s\n", "file", "raw B", "encoded B", "ratio", "encode ms",
+		"decode GB/s", "memcpy GB/s");
+	size_t totalRaw = 0, totalEncoded = 0;
+	bool exact = true;
+	for (const string& path : files) {
+		Result result;
+		if (!measure(path, layout, result)) {
+			fprintf(stderr, "Failed to load %s\n", path.c_str());
+			return 1;
+		}
+		totalRaw += result.rawBytes;
+		totalEncoded += result.encodedBytes;
+		exact &= result.exact;
+		printf("%-14s %10zu %10zu %6.2fx %10.3f %12.2f %12.2f%s\n",
+			filesystem::path(path).filename().string().c_str(), result.rawBytes, result.encodedBytes,
+			double(result.rawBytes) / double(max<size_t>(result.encodedBytes, 1)), result.encodeSeconds * 1e3,
+			result.rawBytes / result.decodeSeconds * 1e-9, result.rawBytes / result.copySeconds * 1e-9,
+			result.exact ? "" : "  MISMATCH");
+	}
+	printf("%-14s %10zu %10zu %6.2fx\n", "total", totalRaw, totalEncoded,
+		double(totalRaw) / double(max<size_t>(totalEncoded, 1)));
+	return exact ? 0 : 1;
+}
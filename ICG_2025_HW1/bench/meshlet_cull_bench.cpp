@@ -0,0 +1,194 @@
+// Draws a large school of one mesh (fish1.obj by default) with and without
+// meshlet culling and compares triangles submitted, CPU submit time and GPU
+// time per frame.
+//
+// Usage: meshlet_cull_bench [file.obj] [instances]
+// The camera sits inside the school, so most instances are partly or fully
+// off screen and every visible one shows its back half to the camera.
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "Object.h"
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+const int WIDTH = 1280;
+const int HEIGHT = 720;
+const int FRAMES = 60;
+const int DEFAULT_INSTANCES = 10000;
+
+static const char* VERTEX_SOURCE = R"(#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+uniform mat4 mvp;
+uniform vec3 dequantScale;
+uniform vec3 dequantOffset;
+out vec3 normal;
+void main()
+{
+	normal = aNormal;
+	gl_Position = mvp * vec4(aPos * dequantScale + dequantOffset, 1.0);
+}
+)";
+
+static const char* FRAGMENT_SOURCE = R"(#version 330 core
+in vec3 normal;
+out vec4 color;
+void main()
+{
+	color = vec4(normalize(normal) * 0.5 + 0.5, 1.0);
+}
+)";
+
+static GLuint compileProgram()
+{
+	GLuint program = glCreateProgram();
+	for (GLenum type : { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER }) {
+		GLuint shader = glCreateShader(type);
+		const char* source = type == GL_VERTEX_SHADER ? VERTEX_SOURCE : FRAGMENT_SOURCE;
+		glShaderSource(shader, 1, &source, nullptr);
+		glCompileShader(shader);
+		glAttachShader(program, shader);
+		glDeleteShader(shader);
+	}
+	glLinkProgram(program);
+	return program;
+}
+
+struct FrameResult
+{
+	double cpuMs = 0;
+	double gpuMs = 0;
+	size_t triangles = 0;
+	size_t culled = 0;
+};
+
+int main(int argc, char** argv)
+{
+	string path = argc > 1 ? argv[1] : string(BENCH_ASSET_DIR) + "fish1.obj";
+	int instances = argc > 2 ? atoi(argv[2]) : DEFAULT_INSTANCES;
+
+	glfwInit();
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+#ifdef __APPLE__
+	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	GLFWwindow* window = glfwCreateWindow(WIDTH, HEIGHT, "meshlet_cull_bench", nullptr, nullptr);
+	if (!window) {
+		cerr << "Failed to create GLFW window" << endl;
+		glfwTerminate();
+		return 1;
+	}
+	glfwMakeContextCurrent(window);
+	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+		cerr << "Failed to initialize GLAD" << endl;
+		return 1;
+	}
+
+	// Render off screen so a hidden window still gets its pixels shaded
+	GLuint fbo, color, depth;
+	glGenFramebuffers(1, &fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glGenRenderbuffers(1, &color);
+	glBindRenderbuffer(GL_RENDERBUFFER, color);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, WIDTH, HEIGHT);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+	glGenRenderbuffers(1, &depth);
+	glBindRenderbuffer(GL_RENDERBUFFER, depth);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, WIDTH, HEIGHT);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+	glViewport(0, 0, WIDTH, HEIGHT);
+	glEnable(GL_DEPTH_TEST);
+	glEnable(GL_CULL_FACE);
+
+	ObjectConfig config;
+	config.binaryCache = false;
+	Object mesh(path, config);
+	if (!mesh.resident())
+		return 1;
+
+	GLuint program = compileProgram();
+	glUseProgram(program);
+	glUniform3fv(glGetUniformLocation(program, "dequantScale"), 1, &mesh.dequantScale[0]);
+	glUniform3fv(glGetUniformLocation(program, "dequantOffset"), 1, &mesh.dequantOffset[0]);
+	GLint mvpLocation = glGetUniformLocation(program, "mvp");
+
+	// School spread over a box around the camera
+	mt19937 rng(1234);
+	uniform_real_distribution<float> spread(-60.0f, 60.0f), turn(0.0f, 6.2831853f);
+	vector<glm::mat4> models(instances);
+	for (glm::mat4& model : models) {
+		model = glm::translate(glm::mat4(1.0f), glm::vec3(spread(rng), spread(rng) * 0.3f, spread(rng)));
+		model = glm::rotate(model, turn(rng), glm::vec3(0.0f, 1.0f, 0.0f));
+		model = glm::scale(model, glm::vec3(2.0f));
+	}
+
+	glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	glm::mat4 projection = glm::perspective(glm::radians(45.0f), float(WIDTH) / float(HEIGHT), 0.1f, 1000.0f);
+
+	GLuint query;
+	glGenQueries(1, &query);
+
+	auto runFrames = [&](bool culled) {
+		FrameResult total;
+		for (int frame = 0; frame < FRAMES; frame++) {
+			glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+			glBeginQuery(GL_TIME_ELAPSED, query);
+			auto start = chrono::steady_clock::now();
+			for (const glm::mat4& model : models) {
+				glm::mat4 mvp = projection * view * model;
+				glUniformMatrix4fv(mvpLocation, 1, GL_FALSE, &mvp[0][0]);
+				size_t skipped = culled ? mesh.drawCulled(model, view, projection) : (mesh.draw(0), 0);
+				total.triangles += mesh.triangleCount(0) - skipped;
+				total.culled += skipped;
+			}
+			chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+			glEndQuery(GL_TIME_ELAPSED);
+
+			GLuint64 gpuNs = 0;
+			glGetQueryObjectui64v(query, GL_QUERY_RESULT, &gpuNs);
+			// Skip the first frames while the driver warms up
+			if (frame >= 5) {
+				total.cpuMs += elapsed.count();
+				total.gpuMs += gpuNs / 1e6;
+			}
+		}
+		int measured = FRAMES - 5;
+		total.cpuMs /= measured;
+		total.gpuMs /= measured;
+		total.triangles /= FRAMES;
+		total.culled /= FRAMES;
+		return total;
+	};
+
+	printf("%s: %d instances, %zu triangles and %zu meshlets each, %dx%d\n", path.c_str(), instances,
+		mesh.triangleCount(0), mesh.meshletCount(), WIDTH, HEIGHT);
+	for (bool culled : { false, true }) {
+		FrameResult result = runFrames(culled);
+		printf("%-16s %12zu tris/frame %12zu culled %10.2f ms CPU %10.2f ms GPU\n",
+			culled ? "meshlet culling" : "plain draw", result.triangles, result.culled, result.cpuMs, result.gpuMs);
+	}
+
+	glDeleteQueries(1, &query);
+	glDeleteProgram(program);
+	glDeleteFramebuffers(1, &fbo);
+	glDeleteRenderbuffers(1, &color);
+	glDeleteRenderbuffers(1, &depth);
+	glfwDestroyWindow(window);
+	glfwTerminate();
+	return 0;
+}
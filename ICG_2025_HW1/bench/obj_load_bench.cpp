@@ -0,0 +1,101 @@
+// Times tinyobj::LoadObj on OBJ files split into many `o`/`g` groups.
+//
+// Usage: obj_load_bench [file.obj ...]
+// Without arguments it writes synthetic files with the same number of faces
+// spread over 1 to 20000 groups, which is where the per-group vertex cache
+// dominates load time.
+
+#include <tiny_obj_loader.h>
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+const int TOTAL_QUADS = 200000;
+const int REPEAT = 5;
+
+// One grid patch of quads per group, with positions, normals and uvs.
+static void writeGroupedObj(const string& path, int groups, int totalQuads)
+{
+	ofstream fs(path);
+	int quadsPerGroup = totalQuads / groups;
+	int side = 1;
+	while (side * side < quadsPerGroup)
+		side++;
+
+	int vertexBase = 0;
+	for (int g = 0; g < groups; g++) {
+		fs << (g % 2 ? "g group" : "o object") << g << "\n";
+		for (int y = 0; y <= side; y++) {
+			for (int x = 0; x <= side; x++) {
+				fs << "v " << x * 0.01f << " " << y * 0.01f << " " << g * 0.1f << "\n";
+				fs << "vt " << x / float(side) << " " << y / float(side) << "\n";
+			}
+		}
+		fs << "vn 0 0 1\n";
+
+		int emitted = 0;
+		for (int y = 0; y < side && emitted < quadsPerGroup; y++) {
+			for (int x = 0; x < side && emitted < quadsPerGroup; x++, emitted++) {
+				int a = vertexBase + y * (side + 1) + x + 1;
+				int b = a + 1;
+				int c = a + side + 2;
+				int d = a + side + 1;
+				fs << "f " << a << "/" << a << "/" << g + 1 << " " << b << "/" << b << "/" << g + 1
+					<< " " << c << "/" << c << "/" << g + 1 << " " << d << "/" << d << "/" << g + 1 << "\n";
+			}
+		}
+		vertexBase += (side + 1) * (side + 1);
+	}
+}
+
+static void benchFile(const string& path)
+{
+	double best = 1e30;
+	size_t shapeCount = 0, faceCount = 0;
+
+	for (int i = 0; i < REPEAT; i++) {
+		vector<tinyobj::shape_t> shapes;
+		vector<tinyobj::material_t> materials;
+		string err;
+
+		auto start = chrono::steady_clock::now();
+		bool ok = tinyobj::LoadObj(shapes, materials, err, path.c_str());
+		chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+		if (!ok) {
+			cerr << "Failed to load " << path << ": " << err << endl;
+			return;
+		}
+
+		best = min(best, elapsed.count());
+		shapeCount = shapes.size();
+		faceCount = 0;
+		for (const auto& shape : shapes)
+			faceCount += shape.mesh.num_vertices.size();
+	}
+
+	printf("%-40s %8zu shapes %10zu tris %10.2f ms %10.2f Mtris/s\n", path.c_str(), shapeCount,
+		faceCount, best, faceCount / best / 1000.0);
+}
+
+int main(int argc, char** argv)
+{
+	if (argc > 1) {
+		for (int i = 1; i < argc; i++)
+			benchFile(argv[i]);
+		return 0;
+	}
+
+	for (int groups : { 1, 100, 2000, 20000 }) {
+		string path = "grouped_" + to_string(groups) + ".obj";
+		writeGroupedObj(path, groups, TOTAL_QUADS);
+		benchFile(path);
+		remove(path.c_str());
+	}
+	return 0;
+}
@@ -0,0 +1,130 @@
+// Per-draw cost of writing uniforms, the way drawModel() used to and the
+// two ways Shader.h offers now.
+//
+// Usage: uniform_bench [draws]
+//
+// Each simulated draw writes the per-draw uniforms of easy.vert
+// (dequantScale, dequantOffset) without drawing anything, so only the
+// uniform path is measured; camera matrices come from the Frame block once
+// per frame and are not part of it:
+//   string lookup   std::string from the literal + glGetUniformLocation
+//   set_uniform     name hashed at compile time, location from the table
+//                   Shader builds at link time
+//   UniformHandle   location resolved once; GLState compares the value,
+//                   which changes every draw here, before the glUniform
+// Every variant runs until it has taken at least a quarter of a second and
+// the best pass is reported.
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+
+#include "Shader.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+using namespace std;
+
+const int DEFAULT_DRAWS = 100000;
+const double MIN_SECONDS = 0.25;
+const int MIN_REPEAT = 5;
+
+// Best time of `pass` over at least MIN_REPEAT runs and MIN_SECONDS; the
+// driver has to finish the uniform writes within the pass
+template <class Pass>
+static double bestTime(Pass&& pass)
+{
+	double best = 1e30, total = 0.0;
+	for (int i = 0; i < MIN_REPEAT || total < MIN_SECONDS; i++) {
+		auto start = chrono::steady_clock::now();
+		pass();
+		glFinish();
+		chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+		best = min(best, elapsed.count());
+		total += elapsed.count();
+	}
+	return best;
+}
+
+// What the old const string& overloads of set_uniform did
+static void stringLookup(unsigned int program, const string& name, const glm::vec3& value)
+{
+	glUniform3fv(glGetUniformLocation(program, name.c_str()), 1, &value[0]);
+}
+
+int main(int argc, char** argv)
+{
+	int draws = argc > 1 ? atoi(argv[1]) : DEFAULT_DRAWS;
+
+	glfwInit();
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+#ifdef __APPLE__
+	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	GLFWwindow* window = glfwCreateWindow(64, 64, "uniform_bench", nullptr, nullptr);
+	if (!window) {
+		fprintf(stderr, "Failed to create GLFW window\n");
+		glfwTerminate();
+		return 1;
+	}
+	glfwMakeContextCurrent(window);
+	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+		fprintf(stderr, "Failed to initialize GLAD\n");
+		return 1;
+	}
+
+	Shader shader(BENCH_SHADER_DIR "easy.vert", BENCH_SHADER_DIR "easy.frag");
+	shader.use();
+	UniformHandle<glm::vec3> dequantScale = shader.uniform<glm::vec3>("dequantScale");
+	UniformHandle<glm::vec3> dequantOffset = shader.uniform<glm::vec3>("dequantOffset");
+	for (const char* name : { "dequantScale", "dequantOffset" }) {
+		if (shader.location(string(name)) < 0) {
+			fprintf(stderr, "easy.vert has no uniform %s\n", name);
+			return 1;
+		}
+	}
+
+	// Values change every draw, as they would for different objects
+	glm::vec3 vector(1.0f);
+	auto next = [&](int i) { vector.x = float(i); };
+
+	double stringSeconds = bestTime([&] {
+		for (int i = 0; i < draws; i++) {
+			next(i);
+			stringLookup(shader.ID, "dequantScale", vector);
+			stringLookup(shader.ID, "dequantOffset", vector);
+		}
+	});
+	double hashedSeconds = bestTime([&] {
+		for (int i = 0; i < draws; i++) {
+			next(i);
+			shader.set_uniform("dequantScale", vector);
+			shader.set_uniform("dequantOffset", vector);
+		}
+	});
+	double handleSeconds = bestTime([&] {
+		for (int i = 0; i < draws; i++) {
+			next(i);
+			dequantScale.set(vector);
+			dequantOffset.set(vector);
+		}
+	});
+
+	printf("%d draws, 2 uniforms each\n", draws);
+	printf("%-16s %12s %10s\n", "path", "ns/draw", "speedup");
+	for (auto result : { make_pair("string lookup", stringSeconds), make_pair("set_uniform", hashedSeconds),
+			 make_pair("UniformHandle", handleSeconds) }) {
+		printf("%-16s %12.1f %9.2fx\n", result.first, result.second / draws * 1e9, stringSeconds / result.second);
+	}
+
+	glfwDestroyWindow(window);
+	glfwTerminate();
+	return 0;
+}
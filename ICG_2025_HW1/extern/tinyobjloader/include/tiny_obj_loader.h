@@ -45,6 +45,8 @@
 #include <string>
 #include <vector>
 
+#include "fast_number.h"
+
 namespace tinyobj
 {
 
@@ -155,6 +157,17 @@ bool LoadObj(std::vector<shape_t> &shapes,       // [output]
              std::istream &inStream, MaterialReader &readMatFn,
              bool triangulate = true);
 
+/// Loads .obj from a file using several threads.
+/// The file is split into chunks at line boundaries and `v`/`vn`/`vt`/`f`
+/// records are tokenized on all threads, then the chunks are merged in file
+/// order. The result is identical to LoadObj() on the same file.
+/// 'num_threads' <= 0 uses one thread per hardware core.
+bool LoadObjParallel(std::vector<shape_t> &shapes,       // [output]
+                     std::vector<material_t> &materials, // [output]
+                     std::string &err,                   // [output]
+                     const char *filename, const char *mtl_basepath = NULL,
+                     bool triangulate = true, int num_threads = 0);
+
 /// Loads materials into std::map
 void LoadMtl(std::map<std::string, int> &material_map, // [output]
              std::vector<material_t> &materials,       // [output]
@@ -169,10 +182,12 @@ void LoadMtl(std::map<std::string, int> &material_map, // [output]
 #include <cstdlib>
 #include <cstring>
 
+#include <climits>
 #include <fstream>
 #include <map>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "tiny_obj_loader.h"
@@ -203,18 +218,107 @@ struct tag_sizes
     int num_strings;
 };
 
-// for std::map
-static inline bool operator<(const vertex_index &a, const vertex_index &b)
+// Open addressing hash map from a face corner (v/vt/vn triple) to the index
+// of the vertex already emitted for it. One instance is reused for every
+// group: clear() only bumps a generation counter, and reserve() grows the
+// table up front from the number of corners about to be inserted.
+class vertex_index_map
 {
-    if (a.v_idx != b.v_idx)
-        return (a.v_idx < b.v_idx);
-    if (a.vn_idx != b.vn_idx)
-        return (a.vn_idx < b.vn_idx);
-    if (a.vt_idx != b.vt_idx)
-        return (a.vt_idx < b.vt_idx);
-
-    return false;
-}
+public:
+    vertex_index_map() : generation_(1), size_(0) {}
+
+    void reserve(size_t count)
+    {
+        size_t capacity = 16;
+        while (capacity < count * 2)
+            capacity *= 2;
+        if (capacity > slots_.size())
+            rehash(capacity);
+    }
+
+    void clear()
+    {
+        size_ = 0;
+        if (++generation_ == 0)
+        {
+            // Generation wrapped around; really wipe the table once.
+            for (size_t i = 0; i < slots_.size(); i++)
+                slots_[i].generation = 0;
+            generation_ = 1;
+        }
+    }
+
+    // Returns the value slot for `key`. `inserted` tells whether the key was
+    // new, in which case the caller must store the value.
+    unsigned int &lookup(const vertex_index &key, bool &inserted)
+    {
+        if ((size_ + 1) * 2 > slots_.size())
+            rehash(slots_.empty() ? 16 : slots_.size() * 2);
+
+        size_t mask = slots_.size() - 1;
+        size_t pos = hash(key) & mask;
+        for (;;)
+        {
+            slot &s = slots_[pos];
+            if (s.generation != generation_)
+            {
+                s.key = key;
+                s.value = 0;
+                s.generation = generation_;
+                size_++;
+                inserted = true;
+                return s.value;
+            }
+            if (s.key.v_idx == key.v_idx && s.key.vt_idx == key.vt_idx &&
+                s.key.vn_idx == key.vn_idx)
+            {
+                inserted = false;
+                return s.value;
+            }
+            pos = (pos + 1) & mask;
+        }
+    }
+
+private:
+    struct slot
+    {
+        slot() : value(0), generation(0) {}
+        vertex_index key;
+        unsigned int value;
+        unsigned int generation;
+    };
+
+    static size_t hash(const vertex_index &key)
+    {
+        unsigned long long h = static_cast<unsigned int>(key.v_idx);
+        h = h * 0x9E3779B97F4A7C15ull ^ static_cast<unsigned int>(key.vt_idx);
+        h = h * 0x9E3779B97F4A7C15ull ^ static_cast<unsigned int>(key.vn_idx);
+        h *= 0x9E3779B97F4A7C15ull;
+        return static_cast<size_t>(h >> 20);
+    }
+
+    void rehash(size_t capacity)
+    {
+        std::vector<slot> old;
+        old.swap(slots_);
+        slots_.resize(capacity);
+        size_ = 0;
+        unsigned int old_generation = generation_;
+        generation_ = 1;
+        for (size_t i = 0; i < old.size(); i++)
+        {
+            if (old[i].generation == old_generation)
+            {
+                bool inserted;
+                lookup(old[i].key, inserted) = old[i].value;
+            }
+        }
+    }
+
+    std::vector<slot> slots_;
+    unsigned int generation_;
+    size_t size_;
+};
 
 struct obj_shape
 {
@@ -224,7 +328,6 @@ struct obj_shape
 };
 
 #define IS_SPACE(x) (((x) == ' ') || ((x) == '\t'))
-#define IS_DIGIT(x) ((unsigned int)((x) - '0') < (unsigned int)10)
 #define IS_NEW_LINE(x) (((x) == '\r') || ((x) == '\n') || ((x) == '\0'))
 
 // Make index zero-base, and also support relative index.
@@ -250,164 +353,24 @@ static inline std::string parseString(const char *&token)
 static inline int parseInt(const char *&token)
 {
     token += strspn(token, " \t");
-    int i = atoi(token);
-    token += strcspn(token, " \t\r");
+    const char *end = token + strcspn(token, " \t\r");
+    int i = 0;
+    fastnum::parseInt(token, end, i);
+    token = end;
     return i;
 }
 
-// Tries to parse a floating point number located at s.
-//
-// s_end should be a location in the string where reading should absolutely
-// stop. For example at the end of the string, to prevent buffer overflows.
-//
-// Parses the following EBNF grammar:
-//   sign    = "+" | "-" ;
-//   END     = ? anything not in digit ?
-//   digit   = "0" | "1" | "2" | "3" | "4" | "5" | "6" | "7" | "8" | "9" ;
-//   integer = [sign] , digit , {digit} ;
-//   decimal = integer , ["." , integer] ;
-//   float   = ( decimal , END ) | ( decimal , ("E" | "e") , integer , END ) ;
-//
-//  Valid strings are for example:
-//   -0	 +3.1417e+2  -0.0E-3  1.0324  -1.41   11e2
-//
-// If the parsing is a success, result is set to the parsed value and true
-// is returned.
-//
-// The function is greedy and will parse until any of the following happens:
-//  - a non-conforming character is encountered.
-//  - s_end is reached.
-//
-// The following situations triggers a failure:
-//  - s >= s_end.
-//  - parse failure.
-//
-static bool tryParseDouble(const char *s, const char *s_end, double *result)
+// Reads one member of a face triple and leaves `token` on the following '/'
+// or delimiter.
+static inline int parseIndexValue(const char *&token)
 {
-    if (s >= s_end)
-    {
-        return false;
-    }
-
-    double mantissa = 0.0;
-    // This exponent is base 2 rather than 10.
-    // However the exponent we parse is supposed to be one of ten,
-    // thus we must take care to convert the exponent/and or the
-    // mantissa to a * 2^E, where a is the mantissa and E is the
-    // exponent.
-    // To get the final double we will use ldexp, it requires the
-    // exponent to be in base 2.
-    int exponent = 0;
-
-    // NOTE: THESE MUST BE DECLARED HERE SINCE WE ARE NOT ALLOWED
-    // TO JUMP OVER DEFINITIONS.
-    char sign = '+';
-    char exp_sign = '+';
-    char const *curr = s;
-
-    // How many characters were read in a loop.
-    int read = 0;
-    // Tells whether a loop terminated due to reaching s_end.
-    bool end_not_reached = false;
-
-    /*
-            BEGIN PARSING.
-    */
-
-    // Find out what sign we've got.
-    if (*curr == '+' || *curr == '-')
-    {
-        sign = *curr;
-        curr++;
-    }
-    else if (IS_DIGIT(*curr))
-    { /* Pass through. */
-    }
-    else
-    {
-        goto fail;
-    }
-
-    // Read the integer part.
-    while ((end_not_reached = (curr != s_end)) && IS_DIGIT(*curr))
-    {
-        mantissa *= 10;
-        mantissa += static_cast<int>(*curr - 0x30);
-        curr++;
-        read++;
-    }
-
-    // We must make sure we actually got something.
-    if (read == 0)
-        goto fail;
-    // We allow numbers of form "#", "###" etc.
-    if (!end_not_reached)
-        goto assemble;
-
-    // Read the decimal part.
-    if (*curr == '.')
-    {
-        curr++;
-        read = 1;
-        while ((end_not_reached = (curr != s_end)) && IS_DIGIT(*curr))
-        {
-            // NOTE: Don't use powf here, it will absolutely murder precision.
-            mantissa += static_cast<int>(*curr - 0x30) * pow(10.0, -read);
-            read++;
-            curr++;
-        }
-    }
-    else if (*curr == 'e' || *curr == 'E')
-    {
-    }
-    else
-    {
-        goto assemble;
-    }
-
-    if (!end_not_reached)
-        goto assemble;
-
-    // Read the exponent part.
-    if (*curr == 'e' || *curr == 'E')
-    {
-        curr++;
-        // Figure out if a sign is present and if it is.
-        if ((end_not_reached = (curr != s_end)) &&
-            (*curr == '+' || *curr == '-'))
-        {
-            exp_sign = *curr;
-            curr++;
-        }
-        else if (IS_DIGIT(*curr))
-        { /* Pass through. */
-        }
-        else
-        {
-            // Empty E is not allowed.
-            goto fail;
-        }
-
-        read = 0;
-        while ((end_not_reached = (curr != s_end)) && IS_DIGIT(*curr))
-        {
-            exponent *= 10;
-            exponent += static_cast<int>(*curr - 0x30);
-            curr++;
-            read++;
-        }
-        exponent *= (exp_sign == '+' ? 1 : -1);
-        if (read == 0)
-            goto fail;
-    }
-
-assemble:
-    *result =
-        (sign == '+' ? 1 : -1) * ldexp(mantissa * pow(5.0, exponent), exponent);
-    return true;
-fail:
-    return false;
+    const char *end = token + strcspn(token, "/ \t\r");
+    int i = 0;
+    fastnum::parseInt(token, end, i);
+    token = end;
+    return i;
 }
+
 static inline float parseFloat(const char *&token)
 {
     token += strspn(token, " \t");
@@ -416,9 +379,8 @@ static inline float parseFloat(const char *&token)
     token += strcspn(token, " \t\r");
 #else
     const char *end = token + strcspn(token, " \t\r");
-    double val = 0.0;
-    tryParseDouble(token, end, &val);
-    float f = static_cast<float>(val);
+    float f = 0.0f;
+    fastnum::parseFloat(token, end, f);
     token = end;
 #endif
     return f;
@@ -469,8 +431,7 @@ static vertex_index parseTriple(const char *&token, int vsize, int vnsize,
 {
     vertex_index vi(-1);
 
-    vi.v_idx = fixIndex(atoi(token), vsize);
-    token += strcspn(token, "/ \t\r");
+    vi.v_idx = fixIndex(parseIndexValue(token), vsize);
     if (token[0] != '/')
     {
         return vi;
@@ -481,14 +442,12 @@ static vertex_index parseTriple(const char *&token, int vsize, int vnsize,
     if (token[0] == '/')
     {
         token++;
-        vi.vn_idx = fixIndex(atoi(token), vnsize);
-        token += strcspn(token, "/ \t\r");
+        vi.vn_idx = fixIndex(parseIndexValue(token), vnsize);
         return vi;
     }
 
     // i/j/k or i/j
-    vi.vt_idx = fixIndex(atoi(token), vtsize);
-    token += strcspn(token, "/ \t\r");
+    vi.vt_idx = fixIndex(parseIndexValue(token), vtsize);
     if (token[0] != '/')
     {
         return vi;
@@ -496,26 +455,25 @@ static vertex_index parseTriple(const char *&token, int vsize, int vnsize,
 
     // i/j/k
     token++; // skip '/'
-    vi.vn_idx = fixIndex(atoi(token), vnsize);
-    token += strcspn(token, "/ \t\r");
+    vi.vn_idx = fixIndex(parseIndexValue(token), vnsize);
     return vi;
 }
 
 static unsigned int
-updateVertex(std::map<vertex_index, unsigned int> &vertexCache,
+updateVertex(vertex_index_map &vertexCache,
              std::vector<float> &positions, std::vector<float> &normals,
              std::vector<float> &texcoords,
              const std::vector<float> &in_positions,
              const std::vector<float> &in_normals,
              const std::vector<float> &in_texcoords, const vertex_index &i)
 {
-    const std::map<vertex_index, unsigned int>::iterator it =
-        vertexCache.find(i);
+    bool inserted;
+    unsigned int &cached = vertexCache.lookup(i, inserted);
 
-    if (it != vertexCache.end())
+    if (!inserted)
     {
         // found cache
-        return it->second;
+        return cached;
     }
 
     assert(in_positions.size() > static_cast<unsigned int>(3 * i.v_idx + 2));
@@ -542,7 +500,7 @@ updateVertex(std::map<vertex_index, unsigned int> &vertexCache,
     }
 
     unsigned int idx = static_cast<unsigned int>(positions.size() / 3 - 1);
-    vertexCache[i] = idx;
+    cached = idx;
 
     return idx;
 }
@@ -573,7 +531,7 @@ static void InitMaterial(material_t &material)
 }
 
 static bool exportFaceGroupToShape(
-    shape_t &shape, std::map<vertex_index, unsigned int> vertexCache,
+    shape_t &shape, vertex_index_map &vertexCache,
     const std::vector<float> &in_positions,
     const std::vector<float> &in_normals,
     const std::vector<float> &in_texcoords,
@@ -586,6 +544,12 @@ static bool exportFaceGroupToShape(
         return false;
     }
 
+    // Size the cache for the worst case of one vertex per corner.
+    size_t corners = 0;
+    for (size_t i = 0; i < faceGroup.size(); i++)
+        corners += faceGroup[i].size();
+    vertexCache.reserve(corners);
+
     // Flatten vertices and indices
     for (size_t i = 0; i < faceGroup.size(); i++)
     {
@@ -966,12 +930,11 @@ bool LoadObj(std::vector<shape_t> &shapes,       // [output]
     return LoadObj(shapes, materials, err, ifs, matFileReader, trianglulate);
 }
 
-bool LoadObj(std::vector<shape_t> &shapes,       // [output]
-             std::vector<material_t> &materials, // [output]
-             std::string &err, std::istream &inStream,
-             MaterialReader &readMatFn, bool triangulate)
+// Parser state carried from line to line. Shared by LoadObj and
+// LoadObjParallel so both build shapes with exactly the same rules.
+struct obj_state
 {
-    std::stringstream errss;
+    obj_state() : material(-1) {}
 
     std::vector<float> v;
     std::vector<float> vn;
@@ -982,10 +945,225 @@ bool LoadObj(std::vector<shape_t> &shapes,       // [output]
 
     // material
     std::map<std::string, int> material_map;
-    std::map<vertex_index, unsigned int> vertexCache;
-    int material = -1;
+    vertex_index_map vertexCache;
+    int material;
 
     shape_t shape;
+};
+
+// Handles the lines that change grouping state: usemtl, mtllib, g, o and t.
+// Returns 1 if the line was consumed, 0 if it is not one of these commands
+// and -1 if loading must stop.
+static int parseGroupingCommand(obj_state &state, const char *token,
+                                std::vector<shape_t> &shapes,
+                                std::vector<material_t> &materials,
+                                std::string &err, MaterialReader &readMatFn,
+                                bool triangulate)
+{
+    std::vector<float> &v = state.v;
+    std::vector<float> &vn = state.vn;
+    std::vector<float> &vt = state.vt;
+    std::vector<tag_t> &tags = state.tags;
+    std::vector<std::vector<vertex_index>> &faceGroup = state.faceGroup;
+    std::string &name = state.name;
+    std::map<std::string, int> &material_map = state.material_map;
+    vertex_index_map &vertexCache = state.vertexCache;
+    int &material = state.material;
+    shape_t &shape = state.shape;
+
+    // use mtl
+    if ((0 == strncmp(token, "usemtl", 6)) && IS_SPACE((token[6])))
+    {
+
+        char namebuf[TINYOBJ_SSCANF_BUFFER_SIZE];
+        token += 7;
+#ifdef _MSC_VER
+        sscanf_s(token, "%s", namebuf, (unsigned)_countof(namebuf));
+#else
+        sscanf(token, "%s", namebuf);
+#endif
+
+        int newMaterialId = -1;
+        if (material_map.find(namebuf) != material_map.end())
+        {
+            newMaterialId = material_map[namebuf];
+        }
+        else
+        {
+            // { error!! material not found }
+        }
+
+        if (newMaterialId != material)
+        {
+            // Create per-face material
+            exportFaceGroupToShape(shape, vertexCache, v, vn, vt, faceGroup,
+                                   tags, material, name, true, triangulate);
+            faceGroup.clear();
+            material = newMaterialId;
+        }
+
+        return 1;
+    }
+
+    // load mtl
+    if ((0 == strncmp(token, "mtllib", 6)) && IS_SPACE((token[6])))
+    {
+        char namebuf[TINYOBJ_SSCANF_BUFFER_SIZE];
+        token += 7;
+#ifdef _MSC_VER
+        sscanf_s(token, "%s", namebuf, (unsigned)_countof(namebuf));
+#else
+        sscanf(token, "%s", namebuf);
+#endif
+
+        std::string err_mtl;
+        bool ok = readMatFn(namebuf, materials, material_map, err_mtl);
+        err += err_mtl;
+
+        if (!ok)
+        {
+            faceGroup.clear(); // for safety
+            return -1;
+        }
+
+        return 1;
+    }
+
+    // group name
+    if (token[0] == 'g' && IS_SPACE((token[1])))
+    {
+
+        // flush previous face group.
+        bool ret =
+            exportFaceGroupToShape(shape, vertexCache, v, vn, vt, faceGroup,
+                                   tags, material, name, true, triangulate);
+        if (ret)
+        {
+            shapes.push_back(shape);
+        }
+
+        shape = shape_t();
+
+        // material = -1;
+        faceGroup.clear();
+
+        std::vector<std::string> names;
+        names.reserve(2);
+
+        while (!IS_NEW_LINE(token[0]))
+        {
+            std::string str = parseString(token);
+            names.push_back(str);
+            token += strspn(token, " \t\r"); // skip tag
+        }
+
+        assert(names.size() > 0);
+
+        // names[0] must be 'g', so skip the 0th element.
+        if (names.size() > 1)
+        {
+            name = names[1];
+        }
+        else
+        {
+            name = "";
+        }
+
+        return 1;
+    }
+
+    // object name
+    if (token[0] == 'o' && IS_SPACE((token[1])))
+    {
+
+        // flush previous face group.
+        bool ret =
+            exportFaceGroupToShape(shape, vertexCache, v, vn, vt, faceGroup,
+                                   tags, material, name, true, triangulate);
+        if (ret)
+        {
+            shapes.push_back(shape);
+        }
+
+        // material = -1;
+        faceGroup.clear();
+        shape = shape_t();
+
+        // @todo { multiple object name? }
+        char namebuf[TINYOBJ_SSCANF_BUFFER_SIZE];
+        token += 2;
+#ifdef _MSC_VER
+        sscanf_s(token, "%s", namebuf, (unsigned)_countof(namebuf));
+#else
+        sscanf(token, "%s", namebuf);
+#endif
+        name = std::string(namebuf);
+
+        return 1;
+    }
+
+    if (token[0] == 't' && IS_SPACE(token[1]))
+    {
+        tag_t tag;
+
+        char namebuf[4096];
+        token += 2;
+        sscanf(token, "%s", namebuf);
+        tag.name = std::string(namebuf);
+
+        token += tag.name.size() + 1;
+
+        tag_sizes ts = parseTagTriple(token);
+
+        tag.intValues.resize(static_cast<size_t>(ts.num_ints));
+
+        for (size_t i = 0; i < static_cast<size_t>(ts.num_ints); ++i)
+        {
+            tag.intValues[i] = atoi(token);
+            token += strcspn(token, "/ \t\r") + 1;
+        }
+
+        tag.floatValues.resize(static_cast<size_t>(ts.num_floats));
+        for (size_t i = 0; i < static_cast<size_t>(ts.num_floats); ++i)
+        {
+            tag.floatValues[i] = parseFloat(token);
+            token += strcspn(token, "/ \t\r") + 1;
+        }
+
+        tag.stringValues.resize(static_cast<size_t>(ts.num_strings));
+        for (size_t i = 0; i < static_cast<size_t>(ts.num_strings); ++i)
+        {
+            char stringValueBuffer[4096];
+
+            sscanf(token, "%s", stringValueBuffer);
+            tag.stringValues[i] = stringValueBuffer;
+            token += tag.stringValues[i].size() + 1;
+        }
+
+        tags.push_back(tag);
+        return 1;
+    }
+
+    return 0;
+}
+
+bool LoadObj(std::vector<shape_t> &shapes,       // [output]
+             std::vector<material_t> &materials, // [output]
+             std::string &err, std::istream &inStream,
+             MaterialReader &readMatFn, bool triangulate)
+{
+    std::stringstream errss;
+
+    obj_state state;
+    std::vector<float> &v = state.v;
+    std::vector<float> &vn = state.vn;
+    std::vector<float> &vt = state.vt;
+    std::vector<tag_t> &tags = state.tags;
+    std::vector<std::vector<vertex_index>> &faceGroup = state.faceGroup;
+    std::string &name = state.name;
+    vertex_index_map &vertexCache = state.vertexCache;
+    int &material = state.material;
+    shape_t &shape = state.shape;
 
     int maxchars = 8192;                                  // Alloc enough size.
     std::vector<char> buf(static_cast<size_t>(maxchars)); // Alloc enough size.
@@ -1086,190 +1264,352 @@ bool LoadObj(std::vector<shape_t> &shapes,       // [output]
             continue;
         }
 
-        // use mtl
-        if ((0 == strncmp(token, "usemtl", 6)) && IS_SPACE((token[6])))
+        int handled = parseGroupingCommand(state, token, shapes, materials,
+                                           err, readMatFn, triangulate);
+        if (handled < 0)
         {
+            return false;
+        }
 
-            char namebuf[TINYOBJ_SSCANF_BUFFER_SIZE];
-            token += 7;
-#ifdef _MSC_VER
-            sscanf_s(token, "%s", namebuf, (unsigned)_countof(namebuf));
-#else
-            sscanf(token, "%s", namebuf);
-#endif
+        // Ignore unknown command.
+    }
 
-            int newMaterialId = -1;
-            if (material_map.find(namebuf) != material_map.end())
-            {
-                newMaterialId = material_map[namebuf];
-            }
-            else
-            {
-                // { error!! material not found }
-            }
+    bool ret = exportFaceGroupToShape(shape, vertexCache, v, vn, vt, faceGroup,
+                                      tags, material, name, true, triangulate);
+    if (ret)
+    {
+        shapes.push_back(shape);
+    }
+    faceGroup.clear(); // for safety
 
-            if (newMaterialId != material)
-            {
-                // Create per-face material
-                exportFaceGroupToShape(shape, vertexCache, v, vn, vt, faceGroup,
-                                       tags, material, name, true, triangulate);
-                faceGroup.clear();
-                material = newMaterialId;
-            }
+    err += errss.str();
+    return true;
+}
 
-            continue;
-        }
+// Vertex counts seen so far, used to resolve relative (negative) indices.
+struct obj_counts
+{
+    obj_counts() : v(0), vn(0), vt(0) {}
+    int v, vn, vt;
+};
 
-        // load mtl
-        if ((0 == strncmp(token, "mtllib", 6)) && IS_SPACE((token[6])))
-        {
-            char namebuf[TINYOBJ_SSCANF_BUFFER_SIZE];
-            token += 7;
-#ifdef _MSC_VER
-            sscanf_s(token, "%s", namebuf, (unsigned)_countof(namebuf));
-#else
-            sscanf(token, "%s", namebuf);
-#endif
+// Everything one thread extracts from its slice of the file. Face indices are
+// kept as written (RAW_INDEX_NONE when absent) together with the chunk-local
+// vertex counts, because relative indices can only be resolved once the
+// counts of the preceding chunks are known.
+struct obj_chunk
+{
+    static const int RAW_INDEX_NONE = INT_MIN;
 
-            std::string err_mtl;
-            bool ok = readMatFn(namebuf, materials, material_map, err_mtl);
-            err += err_mtl;
+    struct deferred_line
+    {
+        size_t face_index; // number of faces in this chunk before the line
+        const char *token;
+    };
 
-            if (!ok)
-            {
-                faceGroup.clear(); // for safety
-                return false;
-            }
+    const char *begin;
+    const char *end;
 
-            continue;
-        }
+    std::vector<float> v;
+    std::vector<float> vn;
+    std::vector<float> vt;
+    std::vector<int> corners;            // raw v/vt/vn triple per corner
+    std::vector<unsigned int> face_size; // corners per face
+    std::vector<obj_counts> face_counts; // local counts when the face was read
+    std::vector<deferred_line> deferred; // usemtl, mtllib, g, o, t
+};
 
-        // group name
-        if (token[0] == 'g' && IS_SPACE((token[1])))
-        {
+// Same grammar as parseTriple(), without resolving the indices.
+static void parseRawTriple(const char *&token, int raw[3])
+{
+    raw[0] = parseIndexValue(token);
+    raw[1] = obj_chunk::RAW_INDEX_NONE;
+    raw[2] = obj_chunk::RAW_INDEX_NONE;
+    if (token[0] != '/')
+    {
+        return;
+    }
+    token++;
 
-            // flush previous face group.
-            bool ret =
-                exportFaceGroupToShape(shape, vertexCache, v, vn, vt, faceGroup,
-                                       tags, material, name, true, triangulate);
-            if (ret)
-            {
-                shapes.push_back(shape);
-            }
+    // i//k
+    if (token[0] == '/')
+    {
+        token++;
+        raw[2] = parseIndexValue(token);
+        return;
+    }
 
-            shape = shape_t();
+    // i/j/k or i/j
+    raw[1] = parseIndexValue(token);
+    if (token[0] != '/')
+    {
+        return;
+    }
 
-            // material = -1;
-            faceGroup.clear();
+    // i/j/k
+    token++; // skip '/'
+    raw[2] = parseIndexValue(token);
+}
 
-            std::vector<std::string> names;
-            names.reserve(2);
+// Tokenize the lines in [chunk.begin, chunk.end). Line ends are overwritten
+// with '\0' in place so the usual C-string token parsers can be used.
+static void parseObjChunk(obj_chunk &chunk)
+{
+    char *line = const_cast<char *>(chunk.begin);
+    char *end = const_cast<char *>(chunk.end);
+    obj_counts counts;
 
-            while (!IS_NEW_LINE(token[0]))
-            {
-                std::string str = parseString(token);
-                names.push_back(str);
-                token += strspn(token, " \t\r"); // skip tag
-            }
+    while (line < end)
+    {
+        char *eol = const_cast<char *>(fastnum::findByte(line, end, '\n'));
+        *eol = '\0';
+        if (eol > line && eol[-1] == '\r')
+            eol[-1] = '\0';
 
-            assert(names.size() > 0);
+        const char *token = line;
+        line = eol + 1;
 
-            // names[0] must be 'g', so skip the 0th element.
-            if (names.size() > 1)
-            {
-                name = names[1];
-            }
-            else
-            {
-                name = "";
-            }
+        token += strspn(token, " \t");
+        if (token[0] == '\0' || token[0] == '#')
+            continue;
 
+        if (token[0] == 'v' && IS_SPACE((token[1])))
+        {
+            token += 2;
+            float x, y, z;
+            parseFloat3(x, y, z, token);
+            chunk.v.push_back(x);
+            chunk.v.push_back(y);
+            chunk.v.push_back(z);
+            counts.v++;
             continue;
         }
 
-        // object name
-        if (token[0] == 'o' && IS_SPACE((token[1])))
+        if (token[0] == 'v' && token[1] == 'n' && IS_SPACE((token[2])))
         {
+            token += 3;
+            float x, y, z;
+            parseFloat3(x, y, z, token);
+            chunk.vn.push_back(x);
+            chunk.vn.push_back(y);
+            chunk.vn.push_back(z);
+            counts.vn++;
+            continue;
+        }
 
-            // flush previous face group.
-            bool ret =
-                exportFaceGroupToShape(shape, vertexCache, v, vn, vt, faceGroup,
-                                       tags, material, name, true, triangulate);
-            if (ret)
-            {
-                shapes.push_back(shape);
-            }
-
-            // material = -1;
-            faceGroup.clear();
-            shape = shape_t();
+        if (token[0] == 'v' && token[1] == 't' && IS_SPACE((token[2])))
+        {
+            token += 3;
+            float x, y;
+            parseFloat2(x, y, token);
+            chunk.vt.push_back(x);
+            chunk.vt.push_back(y);
+            counts.vt++;
+            continue;
+        }
 
-            // @todo { multiple object name? }
-            char namebuf[TINYOBJ_SSCANF_BUFFER_SIZE];
+        if (token[0] == 'f' && IS_SPACE((token[1])))
+        {
             token += 2;
-#ifdef _MSC_VER
-            sscanf_s(token, "%s", namebuf, (unsigned)_countof(namebuf));
-#else
-            sscanf(token, "%s", namebuf);
-#endif
-            name = std::string(namebuf);
+            token += strspn(token, " \t");
 
+            unsigned int n = 0;
+            while (!IS_NEW_LINE(token[0]))
+            {
+                int raw[3];
+                parseRawTriple(token, raw);
+                chunk.corners.insert(chunk.corners.end(), raw, raw + 3);
+                n++;
+                token += strspn(token, " \t\r");
+            }
+            chunk.face_size.push_back(n);
+            chunk.face_counts.push_back(counts);
             continue;
         }
 
-        if (token[0] == 't' && IS_SPACE(token[1]))
-        {
-            tag_t tag;
+        obj_chunk::deferred_line deferred;
+        deferred.face_index = chunk.face_size.size();
+        deferred.token = token;
+        chunk.deferred.push_back(deferred);
+    }
+}
 
-            char namebuf[4096];
-            token += 2;
-            sscanf(token, "%s", namebuf);
-            tag.name = std::string(namebuf);
+static inline int resolveRawIndex(int raw, int n)
+{
+    return raw == obj_chunk::RAW_INDEX_NONE ? -1 : fixIndex(raw, n);
+}
+
+bool LoadObjParallel(std::vector<shape_t> &shapes,       // [output]
+                     std::vector<material_t> &materials, // [output]
+                     std::string &err, const char *filename,
+                     const char *mtl_basepath, bool triangulate,
+                     int num_threads)
+{
+    shapes.clear();
+
+    std::ifstream ifs(filename, std::ios::binary);
+    if (!ifs)
+    {
+        std::stringstream errss;
+        errss << "Cannot open file [" << filename << "]" << std::endl;
+        err = errss.str();
+        return false;
+    }
 
-            token += tag.name.size() + 1;
+    std::string basePath;
+    if (mtl_basepath)
+    {
+        basePath = mtl_basepath;
+    }
+    MaterialFileReader matFileReader(basePath);
 
-            tag_sizes ts = parseTagTriple(token);
+    // A stream whose size cannot be told (a pipe, say) is read serially.
+    ifs.seekg(0, std::ios::end);
+    std::streamoff end = ifs.tellg();
+    ifs.seekg(0, std::ios::beg);
+    if (end < 0 || !ifs)
+    {
+        ifs.clear();
+        return LoadObj(shapes, materials, err, ifs, matFileReader, triangulate);
+    }
+    size_t size = static_cast<size_t>(end);
+    std::vector<char> text(size + 1);
+    ifs.read(&text[0], static_cast<std::streamsize>(size));
+    if (static_cast<size_t>(ifs.gcount()) != size)
+    {
+        std::stringstream errss;
+        errss << "Cannot read file [" << filename << "]" << std::endl;
+        err = errss.str();
+        return false;
+    }
+    text[size] = '\n';
+
+    // Small files are not worth the thread start-up cost.
+    const size_t min_chunk_size = 256 * 1024;
+    size_t threads = num_threads > 0
+                         ? static_cast<size_t>(num_threads)
+                         : static_cast<size_t>(std::thread::hardware_concurrency());
+    if (threads < 1)
+        threads = 1;
+    size_t max_chunks = size / min_chunk_size + 1;
+    if (threads > max_chunks)
+        threads = max_chunks;
+
+    // Split at line boundaries.
+    std::vector<obj_chunk> chunks(threads);
+    const char *cursor = &text[0];
+    const char *text_end = &text[0] + size + 1;
+    for (size_t i = 0; i < threads; i++)
+    {
+        const char *split = &text[0] + (size + 1) * (i + 1) / threads;
+        if (split < cursor)
+            split = cursor;
+        if (i + 1 < threads && split < text_end)
+        {
+            const char *nl = fastnum::findByte(split, text_end, '\n');
+            split = nl < text_end ? nl + 1 : text_end;
+        }
+        else
+        {
+            split = text_end;
+        }
+        chunks[i].begin = cursor;
+        chunks[i].end = split;
+        cursor = split;
+    }
 
-            tag.intValues.resize(static_cast<size_t>(ts.num_ints));
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < threads; i++)
+    {
+        workers.push_back(std::thread(parseObjChunk, std::ref(chunks[i])));
+    }
+    parseObjChunk(chunks[0]);
+    for (size_t i = 0; i < workers.size(); i++)
+    {
+        workers[i].join();
+    }
 
-            for (size_t i = 0; i < static_cast<size_t>(ts.num_ints); ++i)
-            {
-                tag.intValues[i] = atoi(token);
-                token += strcspn(token, "/ \t\r") + 1;
-            }
+    // Merge in file order.
+    obj_state state;
+    size_t total_v = 0, total_vn = 0, total_vt = 0;
+    for (size_t i = 0; i < chunks.size(); i++)
+    {
+        total_v += chunks[i].v.size();
+        total_vn += chunks[i].vn.size();
+        total_vt += chunks[i].vt.size();
+    }
+    state.v.reserve(total_v);
+    state.vn.reserve(total_vn);
+    state.vt.reserve(total_vt);
 
-            tag.floatValues.resize(static_cast<size_t>(ts.num_floats));
-            for (size_t i = 0; i < static_cast<size_t>(ts.num_floats); ++i)
+    for (size_t c = 0; c < chunks.size(); c++)
+    {
+        obj_chunk &chunk = chunks[c];
+        obj_counts base;
+        base.v = static_cast<int>(state.v.size() / 3);
+        base.vn = static_cast<int>(state.vn.size() / 3);
+        base.vt = static_cast<int>(state.vt.size() / 2);
+        state.v.insert(state.v.end(), chunk.v.begin(), chunk.v.end());
+        state.vn.insert(state.vn.end(), chunk.vn.begin(), chunk.vn.end());
+        state.vt.insert(state.vt.end(), chunk.vt.begin(), chunk.vt.end());
+
+        size_t next_deferred = 0;
+        size_t corner = 0;
+        for (size_t f = 0; f <= chunk.face_size.size(); f++)
+        {
+            while (next_deferred < chunk.deferred.size() &&
+                   chunk.deferred[next_deferred].face_index == f)
             {
-                tag.floatValues[i] = parseFloat(token);
-                token += strcspn(token, "/ \t\r") + 1;
+                int handled = parseGroupingCommand(
+                    state, chunk.deferred[next_deferred].token, shapes,
+                    materials, err, matFileReader, triangulate);
+                if (handled < 0)
+                {
+                    return false;
+                }
+                next_deferred++;
             }
 
-            tag.stringValues.resize(static_cast<size_t>(ts.num_strings));
-            for (size_t i = 0; i < static_cast<size_t>(ts.num_strings); ++i)
-            {
-                char stringValueBuffer[4096];
+            if (f == chunk.face_size.size())
+                break;
 
-                sscanf(token, "%s", stringValueBuffer);
-                tag.stringValues[i] = stringValueBuffer;
-                token += tag.stringValues[i].size() + 1;
-            }
+            const obj_counts &local = chunk.face_counts[f];
+            int vsize = base.v + local.v;
+            int vnsize = base.vn + local.vn;
+            int vtsize = base.vt + local.vt;
 
-            tags.push_back(tag);
+            std::vector<vertex_index> face;
+            face.reserve(chunk.face_size[f]);
+            for (unsigned int k = 0; k < chunk.face_size[f]; k++, corner++)
+            {
+                const int *raw = &chunk.corners[corner * 3];
+                vertex_index vi(-1);
+                vi.v_idx = fixIndex(raw[0], vsize);
+                vi.vt_idx = resolveRawIndex(raw[1], vtsize);
+                vi.vn_idx = resolveRawIndex(raw[2], vnsize);
+                face.push_back(vi);
+            }
+            state.faceGroup.push_back(std::vector<vertex_index>());
+            state.faceGroup[state.faceGroup.size() - 1].swap(face);
         }
 
-        // Ignore unknown command.
+        // Release per-chunk storage as soon as it has been merged.
+        std::vector<float>().swap(chunk.v);
+        std::vector<float>().swap(chunk.vn);
+        std::vector<float>().swap(chunk.vt);
+        std::vector<int>().swap(chunk.corners);
     }
 
-    bool ret = exportFaceGroupToShape(shape, vertexCache, v, vn, vt, faceGroup,
-                                      tags, material, name, true, triangulate);
+    bool ret = exportFaceGroupToShape(
+        state.shape, state.vertexCache, state.v, state.vn, state.vt,
+        state.faceGroup, state.tags, state.material, state.name, true,
+        triangulate);
     if (ret)
     {
-        shapes.push_back(shape);
+        shapes.push_back(state.shape);
     }
-    faceGroup.clear(); // for safety
+    state.faceGroup.clear(); // for safety
 
-    err += errss.str();
     return true;
 }
 
@@ -0,0 +1,361 @@
+#pragma once
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <string>
+#include <memory>
+#include <chrono>
+#include <iostream>
+#include <algorithm>
+#include <functional>
+#include <unordered_map>
+#include <condition_variable>
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include "Object.h"
+
+using namespace std;
+
+// Loads Objects in the background so the first frame does not wait for them.
+//
+// Worker threads run Object::prepare() (cache mapping or OBJ parse, weld and
+// pack). A single upload thread owns a hidden GLFW window whose context
+// shares objects with the main one; it fills the buffers and fences them.
+// update(), called once per frame on the main thread, polls the fences and
+// builds the VAO of every finished mesh, which makes it resident().
+//
+// reload() runs the same pipeline for a mesh that is already resident and
+// swaps the result into it in update(), so a frame sees either the old or the
+// new mesh. schedule() queues other GL work, such as relinking a program, on
+// the upload thread.
+//
+// If the shared context cannot be created, uploads happen in update() on
+// the main context instead.
+class AssetLoader
+{
+public:
+	AssetLoader(GLFWwindow* mainWindow, unsigned int workerCount = 0)
+	{
+		// Must be created on the main thread; the upload thread only makes it current
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+		upload_window = glfwCreateWindow(1, 1, "asset upload", nullptr, mainWindow);
+		glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+		if (!upload_window)
+			cerr << "AssetLoader: no shared context, uploading on the main thread" << endl;
+		else
+			upload_thread = thread(&AssetLoader::uploadLoop, this);
+
+		if (workerCount == 0)
+			workerCount = max(1u, min(4u, thread::hardware_concurrency() / 2));
+		for (unsigned int i = 0; i < workerCount; i++)
+			workers.emplace_back(&AssetLoader::prepareLoop, this);
+	}
+
+	AssetLoader(const AssetLoader&) = delete;
+	AssetLoader& operator=(const AssetLoader&) = delete;
+
+	// Stops the threads; meshes still in flight stay non-resident. Call with
+	// the main context current.
+	~AssetLoader()
+	{
+		{
+			lock_guard<mutex> lock(queue_mutex);
+			stopping = true;
+		}
+		prepare_ready.notify_all();
+		upload_ready.notify_all();
+		for (thread& worker : workers)
+			worker.join();
+		if (upload_thread.joinable())
+			upload_thread.join();
+		if (upload_window)
+			glfwDestroyWindow(upload_window);
+
+		for (Job* job : parse_queue)
+			delete job;
+		for (Job* job : upload_queue)
+			delete job;
+		for (Job* job : fenced) {
+			if (job->fence)
+				glDeleteSync(job->fence);
+			delete job;
+		}
+	}
+
+	// Returns immediately with a non-resident Object. The loader keeps its own
+	// reference until the job is done, and only ever drops it on the main
+	// thread, so the GL objects are never released without a context.
+	shared_ptr<Object> load(const string& filename, const ObjectConfig& config = ObjectConfig())
+	{
+		shared_ptr<Object> object = make_shared<Object>(config);
+		Job* job = new Job();
+		job->object = object;
+		job->filename = filename;
+		queue(job);
+		return object;
+	}
+
+	// Load `filename` again with the options of `target` and swap it into
+	// `target` once resident. `target` keeps drawing the old mesh meanwhile,
+	// and keeps it for good if the new one fails to load. Of several reloads
+	// in flight for the same object only the last one requested is kept.
+	void reload(const shared_ptr<Object>& target, const string& filename)
+	{
+		Job* job = new Job();
+		job->object = make_shared<Object>(target->configuration());
+		job->filename = filename;
+		job->target = target;
+		{
+			lock_guard<mutex> lock(queue_mutex);
+			job->generation = ++reload_generation[target.get()];
+		}
+		queue(job);
+	}
+
+	// Run `work` on the upload context (the main one if there is none), then
+	// `finish(ok)` in update() once the GPU is done with what `work` issued;
+	// `ok` is what `work` returned. Dropped unrun if the loader is destroyed
+	// first.
+	void schedule(function<bool()> work, function<void(bool)> finish)
+	{
+		Job* job = new Job();
+		job->work = move(work);
+		job->finish = move(finish);
+		{
+			lock_guard<mutex> lock(queue_mutex);
+			upload_queue.push_back(job);
+		}
+		upload_ready.notify_one();
+	}
+
+	// Main thread, once per frame: make every mesh whose upload has completed
+	// drawable. Never blocks on the GPU.
+	void update()
+	{
+		// Without an upload context the uploads run here, outside the lock so
+		// the workers can keep queueing meanwhile
+		if (!upload_window) {
+			deque<Job*> uploads;
+			{
+				lock_guard<mutex> lock(queue_mutex);
+				uploads.swap(upload_queue);
+			}
+			bool reparse = false;
+			for (Job* job : uploads) {
+				bool uploaded = uploadJob(job);
+				lock_guard<mutex> lock(queue_mutex);
+				if (uploaded) {
+					fenced.push_back(job);
+				} else {
+					parse_queue.push_back(job);
+					reparse = true;
+				}
+			}
+			if (reparse)
+				prepare_ready.notify_one();
+		}
+
+		vector<Job*> ready;
+		{
+			lock_guard<mutex> lock(queue_mutex);
+			for (size_t i = 0; i < fenced.size();) {
+				Job* job = fenced[i];
+				if (!job->failed && glClientWaitSync(job->fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+					i++;
+					continue;
+				}
+				ready.push_back(job);
+				fenced[i] = fenced.back();
+				fenced.pop_back();
+			}
+		}
+
+		size_t meshes = 0;
+		for (Job* job : ready) {
+			if (job->fence)
+				glDeleteSync(job->fence);
+			if (job->finish) {
+				job->finish(!job->failed);
+				delete job;
+				continue;
+			}
+			meshes++;
+			if (job->target && !latestReload(job)) {
+				// superseded by a newer reload of the same object
+			} else if (job->failed) {
+				if (job->target)
+					cerr << "AssetLoader: reloading " << job->filename << " failed, keeping the previous version" << endl;
+			} else {
+				job->object->createVertexArray();
+				if (job->target) {
+					// The previous buffers leave with the job's object
+					job->target->swapContents(*job->object);
+					cout << job->report << " (reloaded)" << endl;
+				} else {
+					cout << job->report << endl;
+				}
+			}
+			delete job;
+		}
+
+		if (meshes > 0) {
+			lock_guard<mutex> lock(queue_mutex);
+			pending -= meshes;
+			if (pending == 0) {
+				chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - batch_start;
+				cout << "Meshes resident in " << elapsed.count() << " ms" << endl;
+			}
+		}
+	}
+
+	// Loads that have not become resident (or failed) yet
+	size_t pendingCount()
+	{
+		lock_guard<mutex> lock(queue_mutex);
+		return pending;
+	}
+
+private:
+	struct Job
+	{
+		shared_ptr<Object> object;
+		string filename;
+		unique_ptr<PreparedMesh> mesh;
+		GLsync fence = nullptr;
+		bool failed = false;
+		string report;
+		shared_ptr<Object> target;         // reload(): where the result goes
+		unsigned int generation = 0;
+		bool rebuilt = false;              // the cache did not decode; parsed again
+		function<bool()> work;             // schedule()
+		function<void(bool)> finish;
+	};
+
+	GLFWwindow* upload_window = nullptr;
+	thread upload_thread;
+	vector<thread> workers;
+
+	mutex queue_mutex;
+	condition_variable prepare_ready;
+	condition_variable upload_ready;
+	deque<Job*> parse_queue;
+	deque<Job*> upload_queue;
+	vector<Job*> fenced;   // uploaded (or failed), waiting for update()
+	size_t pending = 0;
+	bool stopping = false;
+	chrono::steady_clock::time_point batch_start;
+	unordered_map<Object*, unsigned int> reload_generation; // latest reload() per target
+
+	void queue(Job* job)
+	{
+		{
+			lock_guard<mutex> lock(queue_mutex);
+			if (pending == 0)
+				batch_start = chrono::steady_clock::now();
+			pending++;
+			parse_queue.push_back(job);
+		}
+		prepare_ready.notify_one();
+	}
+
+	// Whether `job` is the last reload() requested for its target; forgets the
+	// target if so
+	bool latestReload(Job* job)
+	{
+		lock_guard<mutex> lock(queue_mutex);
+		auto latest = reload_generation.find(job->target.get());
+		if (latest == reload_generation.end() || latest->second != job->generation)
+			return false;
+		reload_generation.erase(latest);
+		return true;
+	}
+
+	void prepareLoop()
+	{
+		for (;;) {
+			Job* job;
+			{
+				unique_lock<mutex> lock(queue_mutex);
+				prepare_ready.wait(lock, [this] { return stopping || !parse_queue.empty(); });
+				if (stopping)
+					return;
+				job = parse_queue.front();
+				parse_queue.pop_front();
+			}
+
+			job->mesh.reset(new PreparedMesh());
+			job->failed = !job->object->prepare(job->filename, *job->mesh);
+
+			{
+				lock_guard<mutex> lock(queue_mutex);
+				if (job->failed) {
+					job->mesh.reset();
+					fenced.push_back(job);
+				} else {
+					upload_queue.push_back(job);
+				}
+			}
+			upload_ready.notify_one();
+		}
+	}
+
+	void uploadLoop()
+	{
+		glfwMakeContextCurrent(upload_window);
+		for (;;) {
+			Job* job;
+			{
+				unique_lock<mutex> lock(queue_mutex);
+				upload_ready.wait(lock, [this] { return stopping || !upload_queue.empty(); });
+				if (stopping)
+					break;
+				job = upload_queue.front();
+				upload_queue.pop_front();
+			}
+
+			if (!uploadJob(job)) {
+				{
+					lock_guard<mutex> lock(queue_mutex);
+					parse_queue.push_back(job);
+				}
+				prepare_ready.notify_one();
+				continue;
+			}
+			// Make the fence visible to the main context
+			glFlush();
+
+			lock_guard<mutex> lock(queue_mutex);
+			fenced.push_back(job);
+		}
+		glfwMakeContextCurrent(nullptr);
+	}
+
+	// Runs on whichever context uploads. The source bytes are released as soon
+	// as GL has copied them. False if the job goes back to the parse queue: its
+	// mesh cache did not decode and was deleted, so the OBJ is parsed again
+	// (once; a second failure fails the job).
+	bool uploadJob(Job* job)
+	{
+		if (job->work) {
+			job->failed = !job->work();
+			job->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+			return true;
+		}
+		if (!job->object->uploadBuffers(job->mesh->blob)) {
+			Object::discardCache(*job->mesh);
+			job->mesh.reset();
+			if (job->rebuilt) {
+				job->failed = true;
+				return true;
+			}
+			job->rebuilt = true;
+			return false;
+		}
+		job->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		job->report = job->mesh->report;
+		job->mesh.reset();
+		return true;
+	}
+};
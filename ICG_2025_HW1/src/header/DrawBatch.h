@@ -0,0 +1,104 @@
+#pragma once
+#include <vector>
+#include <cstring>
+#include <algorithm>
+#include <glm/glm.hpp>
+
+#include "Object.h"
+#include "Material.h"
+#include "StreamBuffer.h"
+
+using namespace std;
+
+// Per-draw data, laid out as the std140 `Transform` block in easy.vert; keep
+// the two in sync.
+struct DrawTransform
+{
+	glm::mat4 model;
+};
+
+// Uniform buffer binding point of the Transform block
+const GLuint TRANSFORM_BINDING = 1;
+
+// Draws collected over a frame and issued grouped by material, so each
+// material is bound once per frame however many objects use it. Within a
+// material, draws of the same object stay together and keep the order they
+// were added in. The transforms of a frame go to the GPU in one piece
+// through a StreamBuffer, and each draw binds its own slot at
+// TRANSFORM_BINDING.
+class DrawBatch
+{
+public:
+	struct Item
+	{
+		Object* object;
+		int submesh;
+		int material; // MaterialLibrary id
+		int lod;      // level to draw; only meaningful for single-submesh objects
+		glm::mat4 model;
+	};
+
+	DrawBatch(MaterialLibrary& library, StreamBuffer& stream)
+		: library(library), stream(stream)
+	{
+		GLint alignment = 256;
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+		stride = (sizeof(DrawTransform) + alignment - 1) / alignment * alignment;
+	}
+
+	// Queue every submesh of `object`. Submeshes without a material of their
+	// own are drawn with `fallback`, a MaterialLibrary id.
+	void add(Object* object, const glm::mat4& model, int fallback, int lod = 0)
+	{
+		const vector<Submesh>& submeshes = object->submeshes();
+		for (size_t i = 0; i < submeshes.size(); i++) {
+			int material = submeshes[i].material < 0 ? fallback
+				: library.add(object->materials()[submeshes[i].material]);
+			items.push_back({ object, int(i), material, lod, model });
+		}
+	}
+
+	size_t size() const { return items.size(); }
+
+	// Bind each material once and call `draw(item)` for its items, with the
+	// item's transform bound, which sets the remaining per-draw uniforms and
+	// issues the draw call. Empties the batch.
+	template <class DrawFunction>
+	void flush(DrawFunction&& draw)
+	{
+		stable_sort(items.begin(), items.end(), [](const Item& a, const Item& b) {
+			return a.material != b.material ? a.material < b.material : a.object < b.object;
+		});
+		StreamBuffer::Allocation transforms = stream.allocate(stride * items.size(), stride);
+		if (!transforms) {
+			items.clear();
+			return;
+		}
+		unsigned char* slot = static_cast<unsigned char*>(transforms.data);
+		for (const Item& item : items) {
+			DrawTransform transform = { item.model };
+			memcpy(slot, &transform, sizeof(DrawTransform));
+			slot += stride;
+		}
+		stream.flush();
+
+		int bound = -1;
+		GLintptr offset = transforms.offset;
+		for (const Item& item : items) {
+			if (item.material != bound) {
+				library.bind(item.material);
+				bound = item.material;
+			}
+			glState().bindBufferRange(GL_UNIFORM_BUFFER, TRANSFORM_BINDING, transforms.buffer, offset, sizeof(DrawTransform));
+			offset += stride;
+			draw(item);
+		}
+		items.clear();
+	}
+
+private:
+	MaterialLibrary& library;
+	StreamBuffer& stream;
+	size_t stride; // DrawTransform slot, padded to the uniform buffer offset alignment
+	vector<Item> items;
+};
@@ -0,0 +1,199 @@
+#pragma once
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <chrono>
+#include <cerrno>
+#include <cstdint>
+#include <iostream>
+#include <filesystem>
+
+#if defined(__linux__)
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#endif
+
+#include "MeshFile.h"
+#include "ProgramCache.h"
+
+using namespace std;
+
+// Reports files in watched directories whose content changed.
+//
+// A background thread waits on inotify (Linux only; elsewhere watch() fails
+// and nothing is ever reported). Editors and copies often write a file in
+// several steps, so a file is only looked at once it has been quiet for
+// SETTLE_TIME, and only reported if its bytes differ from the last version
+// seen: touching a file, or copying a whole directory over itself, reports
+// nothing. Each directory is hashed once in the background when it is
+// added, to know what its files looked like before.
+class FileWatcher
+{
+public:
+	struct Change
+	{
+		string path;   // watched directory joined with the file name
+		uint64_t hash; // hashFile() of the new content
+	};
+
+	static constexpr chrono::milliseconds SETTLE_TIME{ 100 };
+
+	FileWatcher()
+	{
+#if defined(__linux__)
+		inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (inotify_fd >= 0 && pipe(wake_pipe) != 0) {
+			close(inotify_fd);
+			inotify_fd = -1;
+		}
+#endif
+	}
+
+	FileWatcher(const FileWatcher&) = delete;
+	FileWatcher& operator=(const FileWatcher&) = delete;
+
+	~FileWatcher()
+	{
+#if defined(__linux__)
+		if (watch_thread.joinable()) {
+			char stop = 1;
+			if (write(wake_pipe[1], &stop, 1) != 1)
+				cerr << "FileWatcher: could not wake the watch thread" << endl;
+			watch_thread.join();
+		}
+		if (inotify_fd >= 0) {
+			close(inotify_fd);
+			close(wake_pipe[0]);
+			close(wake_pipe[1]);
+		}
+#endif
+	}
+
+	// Start watching the files directly inside `directory`
+	bool watch(const string& directory)
+	{
+#if defined(__linux__)
+		if (inotify_fd < 0)
+			return false;
+		string dir = directory;
+		while (dir.size() > 1 && (dir.back() == '/' || dir.back() == '\\'))
+			dir.pop_back();
+		int wd = inotify_add_watch(inotify_fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+		if (wd < 0)
+			return false;
+		{
+			lock_guard<mutex> lock(state_mutex);
+			directories[wd] = dir;
+			unscanned.push_back(dir);
+		}
+		if (!watch_thread.joinable())
+			watch_thread = thread(&FileWatcher::watchLoop, this);
+		return true;
+#else
+		(void)directory;
+		return false;
+#endif
+	}
+
+	// Changes that settled since the last call. Never blocks on the disk.
+	vector<Change> changes()
+	{
+		lock_guard<mutex> lock(state_mutex);
+		vector<Change> result;
+		result.swap(settled);
+		return result;
+	}
+
+	// Files we write ourselves or that editors leave behind
+	static bool ignored(const string& name)
+	{
+		auto endsWith = [&](const string& suffix) {
+			return name.size() >= suffix.size() && name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0;
+		};
+		return name.empty() || name[0] == '.' || endsWith("~") || endsWith(".swp") || endsWith(".tmp")
+			|| endsWith(".stream") || endsWith(MESH_FILE_EXTENSION) || endsWith(PROGRAM_CACHE_EXTENSION);
+	}
+
+private:
+	mutex state_mutex;
+	map<int, string> directories; // watch descriptor -> directory
+	vector<string> unscanned;     // added, not hashed yet
+	vector<Change> settled;
+	thread watch_thread;
+#if defined(__linux__)
+	int inotify_fd = -1;
+	int wake_pipe[2] = { -1, -1 };
+#endif
+
+	// Owned by the watch thread
+	map<string, uint64_t> known;                           // path -> last content hash
+	map<string, chrono::steady_clock::time_point> pending; // path -> last event
+
+#if defined(__linux__)
+	void watchLoop()
+	{
+		alignas(inotify_event) char buffer[4096];
+		for (;;) {
+			scanNewDirectories();
+
+			// Sleep until an event, or until the oldest pending file may have settled
+			int timeout = pending.empty() ? -1 : int(SETTLE_TIME.count());
+			pollfd fds[2] = { { inotify_fd, POLLIN, 0 }, { wake_pipe[0], POLLIN, 0 } };
+			if (poll(fds, 2, timeout) < 0 && errno != EINTR)
+				return;
+			if (fds[1].revents & POLLIN)
+				return;
+
+			auto now = chrono::steady_clock::now();
+			ssize_t length;
+			while ((length = read(inotify_fd, buffer, sizeof(buffer))) > 0) {
+				for (char* p = buffer; p < buffer + length;) {
+					const inotify_event* event = reinterpret_cast<const inotify_event*>(p);
+					p += sizeof(inotify_event) + event->len;
+					if (event->len == 0 || (event->mask & IN_ISDIR) || ignored(event->name))
+						continue;
+					lock_guard<mutex> lock(state_mutex);
+					auto dir = directories.find(event->wd);
+					if (dir != directories.end())
+						pending[dir->second + "/" + event->name] = now;
+				}
+			}
+
+			for (auto it = pending.begin(); it != pending.end();) {
+				if (now - it->second < SETTLE_TIME) {
+					++it;
+					continue;
+				}
+				// 0: gone again, or empty while half written; a later event follows
+				uint64_t hash = hashFile(it->first);
+				if (hash != 0 && known[it->first] != hash) {
+					known[it->first] = hash;
+					lock_guard<mutex> lock(state_mutex);
+					settled.push_back({ it->first, hash });
+				}
+				it = pending.erase(it);
+			}
+		}
+	}
+
+	void scanNewDirectories()
+	{
+		vector<string> dirs;
+		{
+			lock_guard<mutex> lock(state_mutex);
+			dirs.swap(unscanned);
+		}
+		for (const string& dir : dirs) {
+			error_code ec;
+			for (const auto& entry : filesystem::directory_iterator(dir, ec)) {
+				string name = entry.path().filename().string();
+				if (entry.is_regular_file(ec) && !ignored(name))
+					known[dir + "/" + name] = hashFile(dir + "/" + name);
+			}
+		}
+	}
+#endif
+};
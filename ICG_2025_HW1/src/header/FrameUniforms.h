@@ -0,0 +1,54 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <glad/glad.h>
+
+#include "StreamBuffer.h"
+#include "GLState.h"
+
+using namespace std;
+
+// Data every draw of a frame shares, laid out as the std140 `Frame` block in
+// easy.vert and easy.frag; keep them in sync. The vec4s keep std140 from
+// padding anything in between.
+struct FrameUniforms
+{
+	glm::mat4 view;
+	glm::mat4 projection;
+	glm::mat4 viewProjection;
+	glm::vec4 lightPosition; // world space, w unused
+	glm::vec4 lightColor;    // rgb, w unused
+	float time;              // seconds since start
+	float deltaTime;         // seconds since the previous frame
+	float padding[2];
+};
+
+// Uniform buffer binding point of the Frame block. Every Shader binds the
+// block here when it links, so programs need no setup for it.
+const GLuint FRAME_BINDING = 2;
+
+// Writes the FrameUniforms once per frame into a StreamBuffer and binds them
+// at FRAME_BINDING, where every program finds them until the next update.
+class FrameUniformBuffer
+{
+public:
+	explicit FrameUniformBuffer(StreamBuffer& stream) : stream(stream)
+	{
+		GLint offsetAlignment = 256;
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &offsetAlignment);
+		alignment = size_t(offsetAlignment);
+	}
+
+	// Before the frame's first draw
+	void update(const FrameUniforms& frame)
+	{
+		StreamBuffer::Allocation allocation = stream.upload(&frame, sizeof(FrameUniforms), alignment);
+		if (!allocation)
+			return;
+		stream.flush();
+		glState().bindBufferRange(GL_UNIFORM_BUFFER, FRAME_BINDING, allocation.buffer, allocation.offset, allocation.size);
+	}
+
+private:
+	StreamBuffer& stream;
+	size_t alignment;
+};
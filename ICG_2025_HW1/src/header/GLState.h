@@ -0,0 +1,361 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <glad/glad.h>
+
+using namespace std;
+
+// Shadow copy of the GL state this program changes, so a bind or uniform
+// write that would not change anything is dropped before it reaches the
+// driver: the cube VAO drawn thirty times in a row is bound once, and so is
+// the program of every frame after the first.
+//
+// Covers the program, vertex array, buffer bindings (indexed ranges
+// included), texture units, the enable bits and the depth, cull and blend
+// functions, and the uniform values of each program. GL_ELEMENT_ARRAY_BUFFER
+// is vertex array state and always passes through.
+//
+// The shadow is only right if every change goes through it, and GL state
+// belongs to a context: glState() returns one instance per thread, which is
+// one per context here (the drawing thread and AssetLoader's upload thread).
+// Delete objects through it as well, or a recycled name could look bound
+// already. Call invalidate() after anything that changes state behind its
+// back.
+class GLState
+{
+public:
+	enum Kind
+	{
+		PROGRAM,
+		VERTEX_ARRAY,
+		BUFFER,
+		TEXTURE,
+		RENDER_STATE, // enable bits, depth, cull and blend functions
+		UNIFORM,
+		KIND_COUNT
+	};
+
+	// GL calls made and dropped since the last resetStats()
+	struct Stats
+	{
+		size_t issued[KIND_COUNT] = {};
+		size_t elided[KIND_COUNT] = {};
+
+		size_t issuedTotal() const { return sum(issued); }
+		size_t elidedTotal() const { return sum(elided); }
+
+	private:
+		static size_t sum(const size_t (&counts)[KIND_COUNT])
+		{
+			size_t total = 0;
+			for (size_t count : counts)
+				total += count;
+			return total;
+		}
+	};
+
+	GLState() {}
+	GLState(const GLState&) = delete;
+	GLState& operator=(const GLState&) = delete;
+
+	void useProgram(GLuint program)
+	{
+		if (known(PROGRAM, program_known && current_program == program))
+			return;
+		glUseProgram(program);
+		current_program = program;
+		program_known = true;
+	}
+
+	GLuint program() const { return current_program; }
+
+	void bindVertexArray(GLuint vao)
+	{
+		if (known(VERTEX_ARRAY, vao_known && current_vao == vao))
+			return;
+		glBindVertexArray(vao);
+		current_vao = vao;
+		vao_known = true;
+	}
+
+	void bindBuffer(GLenum target, GLuint buffer)
+	{
+		if (target != GL_ELEMENT_ARRAY_BUFFER) {
+			auto it = buffers.find(target);
+			if (known(BUFFER, it != buffers.end() && it->second == buffer))
+				return;
+			buffers[target] = buffer;
+		} else {
+			stats.issued[BUFFER]++;
+		}
+		glBindBuffer(target, buffer);
+	}
+
+	// Also binds `buffer` to the generic `target`, as GL does
+	void bindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+	{
+		BufferRange range = { buffer, offset, size };
+		auto it = ranges.find(key(target, index));
+		if (known(BUFFER, it != ranges.end() && it->second == range))
+			return;
+		glBindBufferRange(target, index, buffer, offset, size);
+		ranges[key(target, index)] = range;
+		buffers[target] = buffer;
+	}
+
+	void bindTexture(GLuint unit, GLenum target, GLuint texture)
+	{
+		auto it = textures.find(key(target, unit));
+		if (known(TEXTURE, it != textures.end() && it->second == texture))
+			return;
+		if (!active_known || active_unit != unit) {
+			glActiveTexture(GL_TEXTURE0 + unit);
+			stats.issued[TEXTURE]++;
+			active_unit = unit;
+			active_known = true;
+		}
+		glBindTexture(target, texture);
+		textures[key(target, unit)] = texture;
+	}
+
+	void setEnabled(GLenum capability, bool enabled)
+	{
+		auto it = capabilities.find(capability);
+		if (known(RENDER_STATE, it != capabilities.end() && it->second == enabled))
+			return;
+		if (enabled)
+			glEnable(capability);
+		else
+			glDisable(capability);
+		capabilities[capability] = enabled;
+	}
+
+	void enable(GLenum capability) { setEnabled(capability, true); }
+	void disable(GLenum capability) { setEnabled(capability, false); }
+
+	void depthFunc(GLenum func)
+	{
+		if (known(RENDER_STATE, depth_func == func))
+			return;
+		glDepthFunc(func);
+		depth_func = func;
+	}
+
+	void depthMask(bool write)
+	{
+		GLenum mask = write ? GL_TRUE : GL_FALSE;
+		if (known(RENDER_STATE, depth_mask == mask))
+			return;
+		glDepthMask(GLboolean(mask));
+		depth_mask = mask;
+	}
+
+	void cullFace(GLenum face)
+	{
+		if (known(RENDER_STATE, cull_face == face))
+			return;
+		glCullFace(face);
+		cull_face = face;
+	}
+
+	void frontFace(GLenum winding)
+	{
+		if (known(RENDER_STATE, front_face == winding))
+			return;
+		glFrontFace(winding);
+		front_face = winding;
+	}
+
+	void blendFunc(GLenum source, GLenum destination)
+	{
+		if (known(RENDER_STATE, blend_source == source && blend_destination == destination))
+			return;
+		glBlendFunc(source, destination);
+		blend_source = source;
+		blend_destination = destination;
+	}
+
+	// Uniforms of the program in use; location -1 is ignored, as GL does
+	void uniform(GLint location, bool value) { uniform(location, int(value)); }
+
+	void uniform(GLint location, int value)
+	{
+		if (changed(location, &value, sizeof(value)))
+			glUniform1i(location, value);
+	}
+
+	void uniform(GLint location, float value)
+	{
+		if (changed(location, &value, sizeof(value)))
+			glUniform1f(location, value);
+	}
+
+	void uniform(GLint location, const glm::vec3& value)
+	{
+		if (changed(location, glm::value_ptr(value), sizeof(value)))
+			glUniform3fv(location, 1, glm::value_ptr(value));
+	}
+
+	void uniform(GLint location, const glm::vec4& value)
+	{
+		if (changed(location, glm::value_ptr(value), sizeof(value)))
+			glUniform4fv(location, 1, glm::value_ptr(value));
+	}
+
+	void uniform(GLint location, const glm::mat4& value)
+	{
+		if (changed(location, glm::value_ptr(value), sizeof(value)))
+			glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(value));
+	}
+
+	// Deleting through these drops the shadowed bindings and uniform values,
+	// so a later object with the same name is bound for real
+	void deleteProgram(GLuint program)
+	{
+		// A deleted program stays in use until another one is, so only the
+		// next useProgram() can be trusted
+		forgetUniforms(program);
+		if (current_program == program)
+			program_known = false;
+		glDeleteProgram(program);
+	}
+
+	void deleteVertexArray(GLuint vao)
+	{
+		if (current_vao == vao)
+			current_vao = 0;
+		glDeleteVertexArrays(1, &vao);
+	}
+
+	void deleteBuffer(GLuint buffer)
+	{
+		for (auto& binding : buffers) {
+			if (binding.second == buffer)
+				binding.second = 0;
+		}
+		for (auto it = ranges.begin(); it != ranges.end();) {
+			if (it->second.buffer == buffer)
+				it = ranges.erase(it);
+			else
+				++it;
+		}
+		glDeleteBuffers(1, &buffer);
+	}
+
+	void deleteTexture(GLuint texture)
+	{
+		for (auto& binding : textures) {
+			if (binding.second == texture)
+				binding.second = 0;
+		}
+		glDeleteTextures(1, &texture);
+	}
+
+	// Forget everything, e.g. after code that calls GL directly
+	void invalidate()
+	{
+		program_known = vao_known = active_known = false;
+		buffers.clear();
+		ranges.clear();
+		textures.clear();
+		capabilities.clear();
+		depth_func = cull_face = front_face = blend_source = blend_destination = depth_mask = UNKNOWN;
+		uniforms.clear();
+	}
+
+	const Stats& frameStats() const { return stats; }
+	void resetStats() { stats = Stats(); }
+
+private:
+	static const GLenum UNKNOWN = ~GLenum(0);
+
+	struct BufferRange
+	{
+		GLuint buffer;
+		GLintptr offset;
+		GLsizeiptr size;
+
+		bool operator==(const BufferRange& other) const
+		{
+			return buffer == other.buffer && offset == other.offset && size == other.size;
+		}
+	};
+
+	struct UniformValue
+	{
+		size_t size;
+		array<unsigned char, sizeof(glm::mat4)> bytes;
+	};
+
+	GLuint current_program = 0;
+	bool program_known = false;
+	GLuint current_vao = 0;
+	bool vao_known = false;
+	GLuint active_unit = 0;
+	bool active_known = false;
+	unordered_map<GLenum, GLuint> buffers;          // generic binding per target
+	unordered_map<uint64_t, BufferRange> ranges;    // (target, index)
+	unordered_map<uint64_t, GLuint> textures;       // (target, unit)
+	unordered_map<GLenum, bool> capabilities;
+	GLenum depth_func = UNKNOWN;
+	GLenum depth_mask = UNKNOWN;
+	GLenum cull_face = UNKNOWN;
+	GLenum front_face = UNKNOWN;
+	GLenum blend_source = UNKNOWN;
+	GLenum blend_destination = UNKNOWN;
+	unordered_map<uint64_t, UniformValue> uniforms; // (program, location)
+	Stats stats;
+
+	static uint64_t key(uint32_t high, uint32_t low) { return uint64_t(high) << 32 | low; }
+
+	// Count the call as elided if the shadow says it changes nothing, as
+	// issued otherwise
+	bool known(Kind kind, bool unchanged)
+	{
+		if (unchanged)
+			stats.elided[kind]++;
+		else
+			stats.issued[kind]++;
+		return unchanged;
+	}
+
+	// Record `size` bytes for `location` of the program in use; false if it
+	// already holds them. With the program unknown nothing is elided.
+	bool changed(GLint location, const void* data, size_t size)
+	{
+		if (location < 0)
+			return false;
+		if (!program_known) {
+			stats.issued[UNIFORM]++;
+			return true;
+		}
+		UniformValue& value = uniforms[key(current_program, uint32_t(location))];
+		if (known(UNIFORM, value.size == size && memcmp(value.bytes.data(), data, size) == 0))
+			return false;
+		value.size = size;
+		memcpy(value.bytes.data(), data, size);
+		return true;
+	}
+
+	void forgetUniforms(GLuint program)
+	{
+		for (auto it = uniforms.begin(); it != uniforms.end();) {
+			if (it->first >> 32 == program)
+				it = uniforms.erase(it);
+			else
+				++it;
+		}
+	}
+};
+
+// The shadow of the context current on this thread
+inline GLState& glState()
+{
+	thread_local GLState state;
+	return state;
+}
@@ -0,0 +1,101 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <filesystem>
+
+#include "Shader.h"
+#include "FileWatcher.h"
+#include "AssetLoader.h"
+#include "MeshCache.h"
+
+using namespace std;
+
+// Picks up edits to shaders and meshes while the app runs.
+//
+// A FileWatcher reports files in the watched directories whose content
+// changed. update() hands each one to what was built from it and nothing
+// else: an OBJ goes to MeshCache::reload(), which reloads every mesh made
+// from that file, and a shader source recompiles the Shaders that use it
+// on the AssetLoader upload thread. Both swap in during AssetLoader::update(),
+// between frames; a shader that fails to compile keeps the running program.
+class HotReload
+{
+public:
+	HotReload(AssetLoader& loader, MeshCache& meshes)
+		: loader(loader), meshes(meshes)
+	{
+	}
+
+	// Watch the files directly inside `directory`
+	bool watch(const string& directory)
+	{
+		if (watcher.watch(directory))
+			return true;
+		cerr << "HotReload: cannot watch " << directory << ", edits there need a restart" << endl;
+		return false;
+	}
+
+	// Recompile `shader` when one of its sources changes. It must outlive
+	// this object and the AssetLoader.
+	void addShader(Shader& shader)
+	{
+		for (const string& source : shader.sources())
+			shader_sources.push_back({ canonical(source), &shader });
+	}
+
+	// Main thread, once per frame before AssetLoader::update()
+	void update()
+	{
+		for (const FileWatcher::Change& change : watcher.changes()) {
+			string path = canonical(change.path);
+			bool used = false;
+			for (const ShaderSource& source : shader_sources) {
+				if (source.path == path) {
+					recompile(*source.shader, path);
+					used = true;
+				}
+			}
+			if (meshes.reload(path, change.hash) > 0)
+				used = true;
+			if (used)
+				cout << "HotReload: " << change.path << " changed" << endl;
+		}
+	}
+
+private:
+	struct ShaderSource
+	{
+		string path;
+		Shader* shader;
+	};
+
+	FileWatcher watcher;
+	AssetLoader& loader;
+	MeshCache& meshes;
+	vector<ShaderSource> shader_sources;
+
+	static string canonical(const string& path)
+	{
+		error_code ec;
+		string result = filesystem::weakly_canonical(path, ec).string();
+		return ec ? path : result;
+	}
+
+	void recompile(Shader& shader, const string& path)
+	{
+		shared_ptr<unsigned int> program = make_shared<unsigned int>(0);
+		loader.schedule(
+			[&shader, program] {
+				*program = shader.compile_program();
+				return *program != 0;
+			},
+			[&shader, program, path](bool ok) {
+				if (ok)
+					shader.replace_program(*program);
+				else
+					cerr << "HotReload: " << path << " does not compile, keeping the previous program" << endl;
+			});
+	}
+};
@@ -0,0 +1,107 @@
+#pragma once
+#include <map>
+#include <array>
+#include <vector>
+#include <cstring>
+#include <glm/glm.hpp>
+#include <glad/glad.h>
+#include <tiny_obj_loader.h>
+
+#include "GLState.h"
+
+using namespace std;
+
+// Surface parameters, laid out as the std140 `Material` block in easy.frag;
+// keep the two in sync.
+struct Material
+{
+	glm::vec4 diffuse;  // Kd, dissolve
+	glm::vec4 emission; // Ke, unused
+};
+
+// Uniform buffer binding point of the Material block
+const GLuint MATERIAL_BINDING = 0;
+
+inline Material colorMaterial(const glm::vec3& color)
+{
+	return { glm::vec4(color, 1.0f), glm::vec4(0.0f) };
+}
+
+inline Material objMaterial(const tinyobj::material_t& material)
+{
+	return { glm::vec4(material.diffuse[0], material.diffuse[1], material.diffuse[2], material.dissolve),
+		glm::vec4(material.emission[0], material.emission[1], material.emission[2], 0.0f) };
+}
+
+// Every distinct material of the scene in one uniform buffer, one aligned
+// slot each. Binding a material is a glBindBufferRange onto
+// MATERIAL_BINDING; the buffer is re-uploaded only when materials were added
+// since the last bind.
+class MaterialLibrary
+{
+public:
+	MaterialLibrary() {}
+	MaterialLibrary(const MaterialLibrary&) = delete;
+	MaterialLibrary& operator=(const MaterialLibrary&) = delete;
+
+	// Needs the context that drew with the library current
+	~MaterialLibrary()
+	{
+		if (UBO)
+			glState().deleteBuffer(UBO);
+	}
+
+	// Id of `material`, adding it the first time it is seen
+	int add(const Material& material)
+	{
+		array<float, 8> key;
+		memcpy(key.data(), &material, sizeof(Material));
+		auto it = ids.find(key);
+		if (it != ids.end())
+			return it->second;
+		int id = int(materials.size());
+		materials.push_back(material);
+		ids.emplace(key, id);
+		dirty = true;
+		return id;
+	}
+
+	size_t size() const { return materials.size(); }
+
+	void bind(int id)
+	{
+		if (dirty)
+			upload();
+		glState().bindBufferRange(GL_UNIFORM_BUFFER, MATERIAL_BINDING, UBO, GLintptr(id) * stride, sizeof(Material));
+		binds++;
+	}
+
+	// glBindBufferRange calls since the last reset
+	size_t bindCount() const { return binds; }
+	void resetStats() { binds = 0; }
+
+private:
+	vector<Material> materials;
+	map<array<float, 8>, int> ids;
+	unsigned int UBO = 0;
+	size_t stride = 0;
+	bool dirty = false;
+	size_t binds = 0;
+
+	void upload()
+	{
+		if (!UBO) {
+			GLint alignment = 256;
+			glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+			stride = (sizeof(Material) + alignment - 1) / alignment * alignment;
+			glGenBuffers(1, &UBO);
+		}
+		vector<unsigned char> bytes(stride * materials.size());
+		for (size_t i = 0; i < materials.size(); i++)
+			memcpy(&bytes[i * stride], &materials[i], sizeof(Material));
+		glState().bindBuffer(GL_UNIFORM_BUFFER, UBO);
+		glBufferData(GL_UNIFORM_BUFFER, bytes.size(), bytes.data(), GL_DYNAMIC_DRAW);
+		glState().bindBuffer(GL_UNIFORM_BUFFER, 0);
+		dirty = false;
+	}
+};
@@ -0,0 +1,277 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <string>
+#include <memory>
+#include <cstdint>
+#include <iostream>
+#include <filesystem>
+#include <unordered_map>
+
+#include "Object.h"
+#include "MeshFile.h"
+#include "AssetLoader.h"
+
+using namespace std;
+
+// Shared reference to a mesh. The GL objects are released when the last
+// handle goes away, so handles must be dropped on the main thread.
+using MeshHandle = shared_ptr<Object>;
+
+// Hands out shared handles so every draw site of the same OBJ uses one set of
+// GPU buffers.
+//
+// Lookups go from cheapest to most expensive:
+//   1. the exact path string already requested: no file system access at all
+//   2. the canonical path: one stat per path component
+//   3. the content hash: a different file with identical bytes. Files are
+//      only hashed when another loaded one has the same size, so a new file
+//      costs one stat on the calling thread, not a read of the whole file.
+// Only a miss on all three loads the mesh, through the AssetLoader when one
+// is given, synchronously otherwise. Each key also includes the
+// ObjectConfig cache key, since different options give different buffers.
+// The cache only holds weak references; a mesh with no handles left is freed.
+class MeshCache
+{
+public:
+	explicit MeshCache(AssetLoader* loader = nullptr)
+		: loader(loader)
+	{
+	}
+
+	MeshHandle load(const string& path, const ObjectConfig& config = ObjectConfig())
+	{
+		string configPrefix = to_string(config.cacheKey()) + "|";
+
+		MeshHandle mesh = find(by_name, configPrefix + path);
+		if (mesh) {
+			hits++;
+			return handOut(mesh);
+		}
+
+		error_code ec;
+		string canonical = filesystem::weakly_canonical(path, ec).string();
+		if (ec)
+			canonical = path;
+		mesh = find(by_path, configPrefix + canonical);
+		if (mesh) {
+			hits++;
+			by_name[configPrefix + path] = mesh;
+			return handOut(mesh);
+		}
+
+		uintmax_t size = filesystem::file_size(canonical, ec);
+		string sizeKey = configPrefix + to_string(size);
+		if (!ec) {
+			mesh = findContent(sizeKey, canonical);
+			if (mesh) {
+				contentHits++;
+				by_name[configPrefix + path] = mesh;
+				by_path[configPrefix + canonical] = mesh;
+				return mesh;
+			}
+		}
+
+		misses++;
+		mesh = loader ? loader->load(canonical, config) : make_shared<Object>(canonical, config);
+		by_name[configPrefix + path] = mesh;
+		by_path[configPrefix + canonical] = mesh;
+		if (!ec)
+			by_size.insert({ sizeKey, { canonical, 0, mesh } });
+		meshes.push_back(mesh);
+		return mesh;
+	}
+
+	// Re-read `path` into every mesh loaded from it (one per ObjectConfig), in
+	// place: existing handles see the new version once it is resident, through
+	// AssetLoader::reload() or right away without a loader. A mesh shared with
+	// another file through a content hit is not touched; `path` gets a mesh
+	// of its own instead, handed out by its next load(), and the handles
+	// already held keep the other file's mesh. `contentHash` is hashFile() of
+	// the new content if the caller has it; otherwise it is only taken if a
+	// later load() needs it. Returns the number of meshes reloaded.
+	size_t reload(const string& path, uint64_t contentHash = 0)
+	{
+		error_code ec;
+		string canonical = filesystem::weakly_canonical(path, ec).string();
+		if (ec)
+			canonical = path;
+		uintmax_t size = filesystem::file_size(canonical, ec);
+		bool sized = !ec;
+
+		// load() below adds to by_path, so collect the matches first
+		vector<pair<string, MeshHandle>> matches;
+		for (auto& entry : by_path) {
+			const string& key = entry.first;
+			size_t prefixLength = key.size() - canonical.size();
+			if (key.size() <= canonical.size() || key[prefixLength - 1] != '|'
+				|| key.compare(prefixLength, canonical.size(), canonical) != 0)
+				continue;
+			MeshHandle mesh = entry.second.lock();
+			if (mesh)
+				matches.push_back({ key, mesh });
+		}
+
+		size_t reloaded = 0;
+		for (auto& [key, mesh] : matches) {
+			size_t prefixLength = key.size() - canonical.size();
+			bool shared = any_of(by_path.begin(), by_path.end(), [&](const EntryMap::value_type& other) {
+				return other.first != key && other.second.lock() == mesh;
+			});
+			if (shared) {
+				detach(key.substr(0, prefixLength), canonical, mesh);
+				detached.push_back(load(canonical, mesh->configuration()));
+				reloads++;
+				reloaded++;
+				continue;
+			}
+
+			// The old content no longer describes this mesh
+			erase_if(by_size, [&](const ContentMap::value_type& content) { return content.second.mesh.lock() == mesh; });
+			if (sized)
+				by_size.insert({ key.substr(0, prefixLength) + to_string(size), { canonical, contentHash, mesh } });
+
+			if (loader) {
+				loader->reload(mesh, canonical);
+			} else {
+				Object fresh(canonical, mesh->configuration());
+				if (fresh.resident())
+					mesh->swapContents(fresh);
+			}
+			reloads++;
+			reloaded++;
+		}
+		return reloaded;
+	}
+
+	// GPU bytes of the meshes that are resident and still referenced
+	size_t residentBytes()
+	{
+		collect();
+		size_t bytes = 0;
+		for (const weak_ptr<Object>& entry : meshes) {
+			MeshHandle mesh = entry.lock();
+			if (mesh && mesh->resident())
+				bytes += mesh->gpuBytes();
+		}
+		return bytes;
+	}
+
+	// Distinct meshes still referenced
+	size_t meshCount()
+	{
+		collect();
+		return meshes.size();
+	}
+
+	// Handles currently held on `path`, 0 if it is not loaded
+	long useCount(const string& path, const ObjectConfig& config = ObjectConfig())
+	{
+		auto it = by_name.find(to_string(config.cacheKey()) + "|" + path);
+		return it == by_name.end() ? 0 : it->second.use_count();
+	}
+
+	void report()
+	{
+		cout << "MeshCache: " << meshCount() << " meshes, " << residentBytes() << " bytes resident, "
+			<< hits << " path hits, " << contentHits << " content hits, " << misses << " loads, "
+			<< reloads << " reloads" << endl;
+	}
+
+	// Forget entries whose mesh has been freed
+	void collect()
+	{
+		prune(by_name);
+		prune(by_path);
+		erase_if(by_size, [](const ContentMap::value_type& entry) { return entry.second.mesh.expired(); });
+		erase_if(meshes, [](const weak_ptr<Object>& entry) { return entry.expired(); });
+	}
+
+private:
+	typedef unordered_map<string, weak_ptr<Object>> EntryMap;
+
+	// A loaded file, for lookups by content
+	struct ContentEntry
+	{
+		string path;   // canonical
+		uint64_t hash; // hashFile() of `path`; 0 until a lookup needs it
+		weak_ptr<Object> mesh;
+	};
+	typedef unordered_multimap<string, ContentEntry> ContentMap;
+
+	AssetLoader* loader;
+	EntryMap by_name;
+	EntryMap by_path;
+	ContentMap by_size; // config prefix + file size
+	vector<weak_ptr<Object>> meshes;
+	size_t hits = 0;
+	size_t contentHits = 0;
+	size_t misses = 0;
+	size_t reloads = 0;
+	vector<MeshHandle> detached; // reloaded apart from a shared mesh, not handed out yet
+
+	static MeshHandle find(EntryMap& map, const string& key)
+	{
+		auto it = map.find(key);
+		if (it == map.end())
+			return nullptr;
+		MeshHandle mesh = it->second.lock();
+		if (!mesh)
+			map.erase(it);
+		return mesh;
+	}
+
+	// A mesh loaded from another file of the same size (`sizeKey`) with the
+	// same bytes as `path`. Hashes `path` and the candidates not hashed yet,
+	// so only when there are any.
+	MeshHandle findContent(const string& sizeKey, const string& path)
+	{
+		uint64_t hash = 0;
+		bool hashed = false;
+		auto range = by_size.equal_range(sizeKey);
+		for (auto it = range.first; it != range.second; ++it) {
+			MeshHandle mesh = it->second.mesh.lock();
+			if (!mesh)
+				continue;
+			if (!hashed) {
+				hash = hashFile(path);
+				hashed = true;
+			}
+			if (it->second.hash == 0)
+				it->second.hash = hashFile(it->second.path);
+			if (hash != 0 && it->second.hash == hash)
+				return mesh;
+		}
+		return nullptr;
+	}
+
+	MeshHandle handOut(const MeshHandle& mesh)
+	{
+		if (!detached.empty())
+			erase(detached, mesh);
+		return mesh;
+	}
+
+	// Forget that `canonical` (under `configPrefix`) was served by the shared
+	// `mesh`, so the next load() reads it again
+	void detach(const string& configPrefix, const string& canonical, const MeshHandle& mesh)
+	{
+		by_path.erase(configPrefix + canonical);
+		erase_if(by_name, [&](const EntryMap::value_type& entry) {
+			if (entry.first.compare(0, configPrefix.size(), configPrefix) != 0 || entry.second.lock() != mesh)
+				return false;
+			error_code ec;
+			string name = entry.first.substr(configPrefix.size());
+			string resolved = filesystem::weakly_canonical(name, ec).string();
+			return (ec ? name : resolved) == canonical;
+		});
+		erase_if(by_size, [&](const ContentMap::value_type& entry) {
+			return entry.second.path == canonical && entry.second.mesh.lock() == mesh;
+		});
+	}
+
+	static void prune(EntryMap& map)
+	{
+		erase_if(map, [](const EntryMap::value_type& entry) { return entry.second.expired(); });
+	}
+};
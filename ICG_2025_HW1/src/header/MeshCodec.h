@@ -0,0 +1,390 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MESH_CODEC_SSE2 1
+#endif
+
+using namespace std;
+
+// Lossless codec for the vertex and index payloads of a .meshbin.
+//
+// A buffer is a run of `count` elements of `stride` bytes (vertices, or
+// 16/32-bit indices). Elements are coded in chunks of MESH_CODEC_CHUNK, and
+// every chunk stores each byte of the element as its own plane:
+//   1. Prediction. Vertex bytes become the difference to the same byte of
+//      the previous vertex; indices become the difference to the previous
+//      index. Both are zigzagged so small steps either way are small codes.
+//      Attributes are already quantized by the vertex layout, and the
+//      optimized vertex/index order keeps neighbours close, so most planes
+//      hold small values.
+//   2. Entropy stage. A plane is cut into blocks of 16 bytes and each block
+//      is stored with 0, 2, 4 or 8 bits per byte, whichever is the smallest
+//      that fits; a 4-byte header holds the 2-bit width of the 16 blocks.
+//      Byte j of a 2-bit block holds values j, j+4, j+8, j+12 from the low
+//      bits up, byte j of a 4-bit block values j and j+8, so that SSE2
+//      unpacks a block with a few shifts.
+// Decoding has no tables and branches once per 16 bytes. Chunks are rebuilt
+// in a small staging area and copied out whole, so the destination is
+// written strictly front to back, which suits write-combined mapped GPU
+// buffers.
+
+const size_t MESH_CODEC_CHUNK = 256;
+const size_t MESH_CODEC_BLOCK = 16;
+const size_t MESH_CODEC_MAX_STRIDE = 64;
+
+namespace meshcodec
+{
+
+inline uint8_t zigzag8(uint8_t delta)
+{
+	return uint8_t((delta << 1) ^ (int8_t(delta) >> 7));
+}
+
+inline uint8_t unzigzag8(uint8_t code)
+{
+	return uint8_t((code >> 1) ^ -(code & 1));
+}
+
+// Append `plane` (a multiple of MESH_CODEC_BLOCK bytes, zero padded) in
+// blocks of the smallest width that holds them
+inline void encodePlane(const uint8_t* plane, size_t blocks, vector<unsigned char>& out)
+{
+	size_t header = out.size();
+	out.resize(header + 4, 0);
+	for (size_t b = 0; b < blocks; b++) {
+		const uint8_t* block = plane + b * MESH_CODEC_BLOCK;
+		uint8_t high = 0;
+		for (size_t i = 0; i < MESH_CODEC_BLOCK; i++)
+			high |= block[i];
+		unsigned mode = high == 0 ? 0 : high < 4 ? 1 : high < 16 ? 2 : 3;
+		out[header + b / 4] |= uint8_t(mode << (b % 4 * 2));
+		if (mode == 1) {
+			for (size_t j = 0; j < 4; j++)
+				out.push_back(uint8_t(block[j] | block[j + 4] << 2 | block[j + 8] << 4 | block[j + 12] << 6));
+		} else if (mode == 2) {
+			for (size_t j = 0; j < 8; j++)
+				out.push_back(uint8_t(block[j] | block[j + 8] << 4));
+		} else if (mode == 3) {
+			out.insert(out.end(), block, block + MESH_CODEC_BLOCK);
+		}
+	}
+}
+
+// Inverse of encodePlane; returns the first byte after the plane, or
+// nullptr if it runs past `end`
+inline const unsigned char* decodePlane(const unsigned char* src, const unsigned char* end, size_t blocks,
+	uint8_t* plane)
+{
+	if (end - src < 4)
+		return nullptr;
+	const unsigned char* header = src;
+	src += 4;
+	for (size_t b = 0; b < blocks; b++) {
+		uint8_t* block = plane + b * MESH_CODEC_BLOCK;
+		switch ((header[b / 4] >> (b % 4 * 2)) & 3) {
+		case 0:
+			memset(block, 0, MESH_CODEC_BLOCK);
+			break;
+		case 1: {
+			if (end - src < 4)
+				return nullptr;
+#ifdef MESH_CODEC_SSE2
+			int packed;
+			memcpy(&packed, src, 4);
+			__m128i x = _mm_cvtsi32_si128(packed);
+			__m128i low = _mm_unpacklo_epi32(x, _mm_srli_epi32(x, 2));
+			__m128i high = _mm_unpacklo_epi32(_mm_srli_epi32(x, 4), _mm_srli_epi32(x, 6));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(block),
+				_mm_and_si128(_mm_unpacklo_epi64(low, high), _mm_set1_epi8(3)));
+#else
+			for (size_t j = 0; j < 4; j++) {
+				block[j] = src[j] & 3;
+				block[j + 4] = (src[j] >> 2) & 3;
+				block[j + 8] = (src[j] >> 4) & 3;
+				block[j + 12] = src[j] >> 6;
+			}
+#endif
+			src += 4;
+			break;
+		}
+		case 2: {
+			if (end - src < 8)
+				return nullptr;
+#ifdef MESH_CODEC_SSE2
+			__m128i x = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(block),
+				_mm_and_si128(_mm_unpacklo_epi64(x, _mm_srli_epi16(x, 4)), _mm_set1_epi8(15)));
+#else
+			for (size_t j = 0; j < 8; j++) {
+				block[j] = src[j] & 15;
+				block[j + 8] = src[j] >> 4;
+			}
+#endif
+			src += 8;
+			break;
+		}
+		default:
+			if (end - src < 16)
+				return nullptr;
+			memcpy(block, src, MESH_CODEC_BLOCK);
+			src += 16;
+			break;
+		}
+	}
+	return src;
+}
+
+enum class PREDICTION
+{
+	BYTE_DELTA,  // vertices: every byte against the same byte of the previous element
+	INDEX_DELTA  // indices: the whole 16/32-bit element against the previous one
+};
+
+// Rebuild `n` elements from their planes into `out`, element-major, carrying
+// the running prediction in `last` (one element) from chunk to chunk.
+inline void reconstructScalar(uint8_t (*planes)[MESH_CODEC_CHUNK], size_t n, size_t stride, PREDICTION prediction,
+	uint8_t* last, uint8_t* out)
+{
+	if (prediction == PREDICTION::BYTE_DELTA) {
+		for (size_t i = 0; i < n; i++) {
+			for (size_t k = 0; k < stride; k++) {
+				last[k] += unzigzag8(planes[k][i]);
+				out[i * stride + k] = last[k];
+			}
+		}
+	} else if (stride == 2) {
+		uint16_t value;
+		memcpy(&value, last, 2);
+		for (size_t i = 0; i < n; i++) {
+			uint16_t code = uint16_t(planes[0][i] | planes[1][i] << 8);
+			value = uint16_t(value + uint16_t((code >> 1) ^ -(code & 1)));
+			memcpy(out + i * 2, &value, 2);
+		}
+		memcpy(last, &value, 2);
+	} else {
+		uint32_t value;
+		memcpy(&value, last, 4);
+		for (size_t i = 0; i < n; i++) {
+			uint32_t code = uint32_t(planes[0][i]) | uint32_t(planes[1][i]) << 8
+				| uint32_t(planes[2][i]) << 16 | uint32_t(planes[3][i]) << 24;
+			value += (code >> 1) ^ (0u - (code & 1));
+			memcpy(out + i * 4, &value, 4);
+		}
+		memcpy(last, &value, 4);
+	}
+}
+
+#ifdef MESH_CODEC_SSE2
+// Same as reconstructScalar, 16 elements at a time; the planes are padded to
+// that. Vertex strides must be a multiple of 4 bytes. Writes up to the
+// padded element count into `out`.
+inline void reconstructSse2(uint8_t (*planes)[MESH_CODEC_CHUNK], size_t n, size_t stride, PREDICTION prediction,
+	uint8_t* last, uint8_t* out)
+{
+	const __m128i one = _mm_set1_epi8(1);
+	const __m128i zero = _mm_setzero_si128();
+	size_t padded = (n + MESH_CODEC_BLOCK - 1) / MESH_CODEC_BLOCK * MESH_CODEC_BLOCK;
+
+	if (prediction == PREDICTION::INDEX_DELTA && stride == 2) {
+		__m128i value = _mm_set1_epi16(short(last[0] | last[1] << 8));
+		for (size_t i = 0; i < padded; i += 16) {
+			__m128i p0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&planes[0][i]));
+			__m128i p1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&planes[1][i]));
+			__m128i codes[2] = { _mm_unpacklo_epi8(p0, p1), _mm_unpackhi_epi8(p0, p1) };
+			for (int h = 0; h < 2; h++) {
+				__m128i code = codes[h];
+				__m128i delta = _mm_xor_si128(_mm_srli_epi16(code, 1),
+					_mm_sub_epi16(zero, _mm_and_si128(code, _mm_set1_epi16(1))));
+				delta = _mm_add_epi16(delta, _mm_slli_si128(delta, 2));
+				delta = _mm_add_epi16(delta, _mm_slli_si128(delta, 4));
+				delta = _mm_add_epi16(delta, _mm_slli_si128(delta, 8));
+				__m128i sum = _mm_add_epi16(value, delta);
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(out + (i + h * 8) * 2), sum);
+				value = _mm_unpackhi_epi64(_mm_shufflehi_epi16(sum, 0xFF), _mm_shufflehi_epi16(sum, 0xFF));
+			}
+		}
+		uint16_t tail = uint16_t(_mm_cvtsi128_si32(value));
+		memcpy(last, &tail, 2);
+		return;
+	}
+
+	// Four planes at a time: interleaving them gives 4-byte pieces of 16
+	// consecutive elements, four elements per register
+	for (size_t k = 0; k < stride; k += 4) {
+		int previous;
+		memcpy(&previous, last + k, 4);
+		__m128i value = _mm_set1_epi32(previous);
+		for (size_t i = 0; i < padded; i += 16) {
+			__m128i p[4];
+			for (int j = 0; j < 4; j++) {
+				p[j] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&planes[k + j][i]));
+				if (prediction == PREDICTION::BYTE_DELTA)
+					p[j] = _mm_xor_si128(_mm_and_si128(_mm_srli_epi16(p[j], 1), _mm_set1_epi8(0x7F)),
+						_mm_sub_epi8(zero, _mm_and_si128(p[j], one)));
+			}
+			__m128i t0 = _mm_unpacklo_epi8(p[0], p[1]);
+			__m128i t1 = _mm_unpackhi_epi8(p[0], p[1]);
+			__m128i t2 = _mm_unpacklo_epi8(p[2], p[3]);
+			__m128i t3 = _mm_unpackhi_epi8(p[2], p[3]);
+			__m128i quads[4] = { _mm_unpacklo_epi16(t0, t2), _mm_unpackhi_epi16(t0, t2),
+				_mm_unpacklo_epi16(t1, t3), _mm_unpackhi_epi16(t1, t3) };
+			for (int q = 0; q < 4; q++) {
+				__m128i delta = quads[q], sum;
+				if (prediction == PREDICTION::BYTE_DELTA) {
+					delta = _mm_add_epi8(delta, _mm_slli_si128(delta, 4));
+					delta = _mm_add_epi8(delta, _mm_slli_si128(delta, 8));
+					sum = _mm_add_epi8(value, delta);
+				} else {
+					delta = _mm_xor_si128(_mm_srli_epi32(delta, 1),
+						_mm_sub_epi32(zero, _mm_and_si128(delta, _mm_set1_epi32(1))));
+					delta = _mm_add_epi32(delta, _mm_slli_si128(delta, 4));
+					delta = _mm_add_epi32(delta, _mm_slli_si128(delta, 8));
+					sum = _mm_add_epi32(value, delta);
+				}
+				value = _mm_shuffle_epi32(sum, 0xFF);
+				uint8_t* dst = out + (i + q * 4) * stride + k;
+				if (stride == 4) {
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(dst), sum);
+				} else {
+					for (int e = 0; e < 4; e++) {
+						int piece = _mm_cvtsi128_si32(sum);
+						memcpy(dst + e * stride, &piece, 4);
+						sum = _mm_srli_si128(sum, 4);
+					}
+				}
+			}
+		}
+		int tail = _mm_cvtsi128_si32(value);
+		memcpy(last + k, &tail, 4);
+	}
+}
+#endif
+
+// Shared by the vertex and index decoders
+inline bool decodeChunks(void* destination, size_t count, size_t stride, const void* encoded, size_t size,
+	PREDICTION prediction)
+{
+	if (stride == 0 || stride > MESH_CODEC_MAX_STRIDE)
+		return false;
+	const unsigned char* src = static_cast<const unsigned char*>(encoded);
+	const unsigned char* end = src + size;
+	unsigned char* dst = static_cast<unsigned char*>(destination);
+	alignas(16) uint8_t planes[MESH_CODEC_MAX_STRIDE][MESH_CODEC_CHUNK];
+	alignas(16) uint8_t staging[MESH_CODEC_MAX_STRIDE * MESH_CODEC_CHUNK];
+	uint8_t last[MESH_CODEC_MAX_STRIDE] = {};
+#ifdef MESH_CODEC_SSE2
+	bool vectorized = prediction == PREDICTION::INDEX_DELTA || stride % 4 == 0;
+#endif
+
+	for (size_t first = 0; first < count; first += MESH_CODEC_CHUNK) {
+		size_t n = min(MESH_CODEC_CHUNK, count - first);
+		size_t blocks = (n + MESH_CODEC_BLOCK - 1) / MESH_CODEC_BLOCK;
+		for (size_t k = 0; k < stride; k++) {
+			src = decodePlane(src, end, blocks, planes[k]);
+			if (!src)
+				return false;
+		}
+#ifdef MESH_CODEC_SSE2
+		if (vectorized)
+			reconstructSse2(planes, n, stride, prediction, last, staging);
+		else
+#endif
+			reconstructScalar(planes, n, stride, prediction, last, staging);
+		memcpy(dst + first * stride, staging, n * stride);
+	}
+	return src == end;
+}
+
+// Inverse of decodeChunks
+inline void encodeChunks(const void* source, size_t count, size_t stride, PREDICTION prediction,
+	vector<unsigned char>& out)
+{
+	const unsigned char* bytes = static_cast<const unsigned char*>(source);
+	uint8_t last[MESH_CODEC_MAX_STRIDE] = {};
+	uint8_t codes[MESH_CODEC_MAX_STRIDE];
+	uint8_t planes[MESH_CODEC_MAX_STRIDE][MESH_CODEC_CHUNK];
+	for (size_t first = 0; first < count; first += MESH_CODEC_CHUNK) {
+		size_t n = min(MESH_CODEC_CHUNK, count - first);
+		size_t blocks = (n + MESH_CODEC_BLOCK - 1) / MESH_CODEC_BLOCK;
+		memset(planes, 0, sizeof(planes));
+		for (size_t i = 0; i < n; i++) {
+			const uint8_t* element = bytes + (first + i) * stride;
+			if (prediction == PREDICTION::BYTE_DELTA) {
+				for (size_t k = 0; k < stride; k++)
+					codes[k] = zigzag8(uint8_t(element[k] - last[k]));
+			} else if (stride == 2) {
+				uint16_t value, previous;
+				memcpy(&value, element, 2);
+				memcpy(&previous, last, 2);
+				uint16_t delta = uint16_t(value - previous);
+				uint16_t code = uint16_t((delta << 1) ^ (int16_t(delta) >> 15));
+				memcpy(codes, &code, 2);
+			} else {
+				uint32_t value, previous;
+				memcpy(&value, element, 4);
+				memcpy(&previous, last, 4);
+				uint32_t delta = value - previous;
+				uint32_t code = (delta << 1) ^ uint32_t(int32_t(delta) >> 31);
+				memcpy(codes, &code, 4);
+			}
+			memcpy(last, element, stride);
+			for (size_t k = 0; k < stride; k++)
+				planes[k][i] = codes[k];
+		}
+		for (size_t k = 0; k < stride; k++)
+			encodePlane(planes[k], blocks, out);
+	}
+}
+
+} // namespace meshcodec
+
+// Whether a stream of `size` bytes can hold `count` elements of `stride`
+// bytes: each chunk takes at least a 4-byte header per plane, and at most
+// that plus the plane's blocks stored whole. Lets a reader reject an element
+// count that does not belong to the stream before sizing a buffer for it.
+inline bool meshCodecSizeFits(size_t count, size_t stride, size_t size)
+{
+	if (stride == 0 || stride > MESH_CODEC_MAX_STRIDE)
+		return false;
+	size_t chunks = (count + MESH_CODEC_CHUNK - 1) / MESH_CODEC_CHUNK;
+	size_t blocks = count / MESH_CODEC_CHUNK * (MESH_CODEC_CHUNK / MESH_CODEC_BLOCK)
+		+ (count % MESH_CODEC_CHUNK + MESH_CODEC_BLOCK - 1) / MESH_CODEC_BLOCK;
+	size_t smallest = chunks * stride * 4;
+	return size >= smallest && size - smallest <= blocks * stride * MESH_CODEC_BLOCK;
+}
+
+// `count` vertices of `stride` bytes (at most MESH_CODEC_MAX_STRIDE)
+inline vector<unsigned char> encodeVertexBuffer(const void* vertices, size_t count, size_t stride)
+{
+	vector<unsigned char> out;
+	meshcodec::encodeChunks(vertices, count, stride, meshcodec::PREDICTION::BYTE_DELTA, out);
+	return out;
+}
+
+// Decode exactly `count` vertices into `destination`. False if `encoded` is
+// not such a stream; `destination` is then partly written.
+inline bool decodeVertexBuffer(void* destination, size_t count, size_t stride, const void* encoded, size_t size)
+{
+	return meshcodec::decodeChunks(destination, count, stride, encoded, size, meshcodec::PREDICTION::BYTE_DELTA);
+}
+
+// `count` indices of `indexSize` bytes (2 or 4)
+inline vector<unsigned char> encodeIndexBuffer(const void* indices, size_t count, size_t indexSize)
+{
+	vector<unsigned char> out;
+	if (indexSize == 2 || indexSize == 4)
+		meshcodec::encodeChunks(indices, count, indexSize, meshcodec::PREDICTION::INDEX_DELTA, out);
+	return out;
+}
+
+inline bool decodeIndexBuffer(void* destination, size_t count, size_t indexSize, const void* encoded, size_t size)
+{
+	if (indexSize != 2 && indexSize != 4)
+		return false;
+	return meshcodec::decodeChunks(destination, count, indexSize, encoded, size, meshcodec::PREDICTION::INDEX_DELTA);
+}
@@ -0,0 +1,143 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <unordered_map>
+#include <iostream>
+#include <glad/glad.h>
+
+using namespace std;
+
+// CPU side copy of a mesh: one entry per unique vertex plus a triangle list
+// indexing into it.
+struct MeshData
+{
+	vector<float> positions;      // xyz per vertex
+	vector<float> normals;        // xyz per vertex
+	vector<float> texcoords;      // uv per vertex
+	vector<unsigned int> indices; // 3 per triangle
+
+	size_t vertexCount() const { return positions.size() / 3; }
+
+	// Smallest element type that can address every vertex.
+	GLenum indexType() const
+	{
+		return vertexCount() <= 0xFFFF ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+	}
+
+	size_t indexSize() const { return indexType() == GL_UNSIGNED_SHORT ? 2 : 4; }
+};
+
+struct WeldKey
+{
+	uint32_t bits[8];
+
+	bool operator==(const WeldKey& other) const
+	{
+		return memcmp(bits, other.bits, sizeof(bits)) == 0;
+	}
+};
+
+struct WeldKeyHash
+{
+	size_t operator()(const WeldKey& key) const
+	{
+		// FNV-1a over the attribute bits
+		uint64_t h = 1469598103934665603ull;
+		for (uint32_t b : key.bits) {
+			h ^= b;
+			h *= 1099511628211ull;
+		}
+		return static_cast<size_t>(h ^ (h >> 32));
+	}
+};
+
+// Run of level 0 indices (or vertices, for unindexed meshes) drawn with one
+// material. Submeshes are sorted by material and never overlap.
+struct Submesh
+{
+	uint32_t indexOffset;
+	uint32_t indexCount;
+	int32_t material; // into the object's own materials; -1: none, the draw's colour
+	uint32_t reserved;
+};
+
+// Collapse per-corner attribute arrays (3 corners per triangle, no indices)
+// into unique (position, normal, uv) vertices and an index buffer.
+// Vertices are compared bit for bit, except that -0.0 and 0.0 are treated alike.
+inline void weldMesh(MeshData& mesh)
+{
+	size_t corners = mesh.positions.size() / 3;
+
+	MeshData welded;
+	welded.positions.reserve(mesh.positions.size());
+	welded.normals.reserve(mesh.normals.size());
+	welded.texcoords.reserve(mesh.texcoords.size());
+	welded.indices.reserve(corners);
+
+	unordered_map<WeldKey, unsigned int, WeldKeyHash> cache;
+	cache.reserve(corners);
+
+	for (size_t i = 0; i < corners; i++) {
+		float attr[8] = {
+			mesh.positions[i * 3 + 0], mesh.positions[i * 3 + 1], mesh.positions[i * 3 + 2],
+			mesh.normals[i * 3 + 0], mesh.normals[i * 3 + 1], mesh.normals[i * 3 + 2],
+			mesh.texcoords[i * 2 + 0], mesh.texcoords[i * 2 + 1]
+		};
+
+		WeldKey key;
+		for (int k = 0; k < 8; k++) {
+			float canonical = attr[k] + 0.0f; // -0.0 -> 0.0
+			memcpy(&key.bits[k], &canonical, sizeof(float));
+		}
+
+		auto it = cache.find(key);
+		if (it != cache.end()) {
+			welded.indices.push_back(it->second);
+			continue;
+		}
+
+		unsigned int index = static_cast<unsigned int>(welded.vertexCount());
+		cache.emplace(key, index);
+		welded.indices.push_back(index);
+		welded.positions.insert(welded.positions.end(), attr, attr + 3);
+		welded.normals.insert(welded.normals.end(), attr + 3, attr + 6);
+		welded.texcoords.insert(welded.texcoords.end(), attr + 6, attr + 8);
+	}
+
+	mesh = std::move(welded);
+}
+
+// Number every distinct position, so vertices that welding kept apart only
+// because of their normal or uv (seams) share an id. Returns the count.
+inline size_t positionIds(const vector<float>& positions, vector<unsigned int>& ids)
+{
+	size_t vertexCount = positions.size() / 3;
+	ids.resize(vertexCount);
+	unordered_map<WeldKey, unsigned int, WeldKeyHash> cache;
+	cache.reserve(vertexCount);
+	for (size_t v = 0; v < vertexCount; v++) {
+		WeldKey key = {};
+		for (int k = 0; k < 3; k++) {
+			float canonical = positions[v * 3 + k] + 0.0f;
+			memcpy(&key.bits[k], &canonical, sizeof(float));
+		}
+		ids[v] = cache.emplace(key, static_cast<unsigned int>(cache.size())).first->second;
+	}
+	return cache.size();
+}
+
+// Print how much vertex data welding saved for one asset.
+inline void reportWeldSavings(const string& name, size_t cornerCount, const MeshData& mesh)
+{
+	const size_t floatsPerVertex = 3 + 3 + 2;
+	size_t before = cornerCount * floatsPerVertex * sizeof(float);
+	size_t after = mesh.vertexCount() * floatsPerVertex * sizeof(float)
+		+ mesh.indices.size() * mesh.indexSize();
+	double saved = before ? 100.0 * (1.0 - double(after) / double(before)) : 0.0;
+
+	cout << name << ": " << cornerCount << " -> " << mesh.vertexCount() << " vertices, "
+		<< before << " -> " << after << " bytes (" << saved << "% saved, "
+		<< (mesh.indexSize() * 8) << "-bit indices)" << endl;
+}
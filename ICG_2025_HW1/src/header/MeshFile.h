@@ -0,0 +1,485 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstddef>
+#include <cstring>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <filesystem>
+#include <glad/glad.h>
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "VertexFormat.h"
+#include "MeshLod.h"
+#include "Meshlet.h"
+#include "Material.h"
+#include "MeshCodec.h"
+
+using namespace std;
+
+// Binary mesh cache written next to an OBJ after its first parse.
+//
+// Layout: MeshFileHeader, then `sectionCount` MeshFileSection records, then
+// the section payloads, each aligned to 16 bytes. Vertex and index payloads
+// are exactly the bytes handed to glBufferData, so a cache hit maps the file
+// and uploads straight from the mapped pages. The index payload holds every
+// LOD level back to back; the LOD section has their ranges, and MSHL the
+// meshlets level 0 is split into. SUBM and MATL hold the per-material
+// ranges of level 0 and the materials they use. VTXZ and IDXZ replace VTX
+// and IDX in compressed caches: the same bytes run through MeshCodec, and
+// decoded straight into the mapped GPU buffers on load.
+
+const uint32_t MESH_FILE_VERSION = 4;
+const char MESH_FILE_MAGIC[8] = { 'I', 'C', 'G', 'M', 'E', 'S', 'H', '\0' };
+const char* const MESH_FILE_EXTENSION = ".meshbin";
+
+constexpr uint32_t meshSectionTag(const char (&name)[5])
+{
+	return uint32_t(uint8_t(name[0])) | uint32_t(uint8_t(name[1])) << 8
+		| uint32_t(uint8_t(name[2])) << 16 | uint32_t(uint8_t(name[3])) << 24;
+}
+
+const uint32_t MESH_SECTION_VERTICES = meshSectionTag("VTX ");
+const uint32_t MESH_SECTION_INDICES = meshSectionTag("IDX ");
+const uint32_t MESH_SECTION_BOUNDS = meshSectionTag("BNDS");
+const uint32_t MESH_SECTION_LODS = meshSectionTag("LOD ");
+const uint32_t MESH_SECTION_MESHLETS = meshSectionTag("MSHL");
+const uint32_t MESH_SECTION_SUBMESHES = meshSectionTag("SUBM");
+const uint32_t MESH_SECTION_MATERIALS = meshSectionTag("MATL");
+const uint32_t MESH_SECTION_VERTICES_ENCODED = meshSectionTag("VTXZ");
+const uint32_t MESH_SECTION_INDICES_ENCODED = meshSectionTag("IDXZ");
+
+struct MeshFileAttribute
+{
+	uint32_t location;
+	int32_t size;
+	uint32_t type;
+	uint32_t normalized;
+	uint32_t stride;
+	uint32_t offset;
+};
+
+struct MeshFileHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t configKey;    // ObjectConfig options that change the payload
+	uint64_t sourceSize;
+	int64_t sourceMtime;
+	uint64_t sourceHash;   // FNV-1a of the OBJ text
+	uint32_t vertexCount;
+	uint32_t indexCount;
+	uint32_t indexType;
+	uint32_t layout;
+	uint32_t vertexSize;
+	uint32_t attributeCount;
+	MeshFileAttribute attributes[4];
+	float dequantScale[3];
+	float dequantOffset[3];
+	uint32_t sectionCount;
+	uint32_t reserved;
+};
+
+struct MeshFileSection
+{
+	uint32_t tag;
+	uint32_t reserved;
+	uint64_t offset;
+	uint64_t size;
+};
+
+// GPU ready mesh: what Object uploads, whether it came from the OBJ parser
+// or from a mapped cache file. The pointers do not own their memory. A
+// non-zero encoded size means the data pointer holds a MeshCodec stream of
+// that many bytes; vertexBytes and indexBytes are always the decoded sizes.
+struct MeshBlob
+{
+	VertexFormat format;
+	size_t vertexCount = 0;
+	size_t indexCount = 0;
+	GLenum indexType = GL_UNSIGNED_INT;
+	const void* vertexData = nullptr;
+	size_t vertexBytes = 0;
+	size_t vertexEncodedBytes = 0;
+	const void* indexData = nullptr;
+	size_t indexBytes = 0;
+	size_t indexEncodedBytes = 0;
+	glm::vec4 bounds = glm::vec4(0.0f); // bounding sphere: center, radius
+	vector<MeshLod> lods;               // empty: one level drawing every index
+	vector<Meshlet> meshlets;           // empty: level 0 is drawn whole
+	vector<Submesh> submeshes;          // empty: one submesh without a material
+	vector<Material> materials;
+};
+
+inline uint64_t hashBytes(const void* data, size_t size, uint64_t h = 1469598103934665603ull)
+{
+	const unsigned char* p = static_cast<const unsigned char*>(data);
+	for (size_t i = 0; i < size; i++) {
+		h ^= p[i];
+		h *= 1099511628211ull;
+	}
+	return h;
+}
+
+// Read-only view of a whole file. Uses mmap where available so the pages
+// can go to the driver without an intermediate copy.
+class MappedFile
+{
+public:
+	MappedFile() {}
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	~MappedFile() { close(); }
+
+	bool open(const string& path)
+	{
+		close();
+		file_path = path;
+#if defined(__linux__) || defined(__APPLE__)
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0)
+			return false;
+		struct stat st;
+		if (fstat(fd, &st) != 0 || st.st_size == 0) {
+			::close(fd);
+			return false;
+		}
+		void* ptr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);
+		if (ptr == MAP_FAILED)
+			return false;
+		map_ptr = ptr;
+		map_size = st.st_size;
+		return true;
+#else
+		ifstream fs(path, ios::binary);
+		if (!fs.is_open())
+			return false;
+		fallback.assign(istreambuf_iterator<char>(fs), istreambuf_iterator<char>());
+		return !fallback.empty();
+#endif
+	}
+
+	void close()
+	{
+#if defined(__linux__) || defined(__APPLE__)
+		if (map_ptr)
+			munmap(map_ptr, map_size);
+		map_ptr = nullptr;
+		map_size = 0;
+#else
+		fallback.clear();
+#endif
+	}
+
+	const unsigned char* data() const
+	{
+#if defined(__linux__) || defined(__APPLE__)
+		return static_cast<const unsigned char*>(map_ptr);
+#else
+		return reinterpret_cast<const unsigned char*>(fallback.data());
+#endif
+	}
+
+	size_t size() const
+	{
+#if defined(__linux__) || defined(__APPLE__)
+		return map_size;
+#else
+		return fallback.size();
+#endif
+	}
+
+	// Of the last open()
+	const string& path() const { return file_path; }
+
+private:
+	string file_path;
+#if defined(__linux__) || defined(__APPLE__)
+	void* map_ptr = nullptr;
+	size_t map_size = 0;
+#else
+	vector<char> fallback;
+#endif
+};
+
+struct SourceStamp
+{
+	uint64_t size = 0;
+	int64_t mtime = 0;
+};
+
+inline bool statSource(const string& path, SourceStamp& stamp)
+{
+	error_code ec;
+	auto size = filesystem::file_size(path, ec);
+	if (ec)
+		return false;
+	auto mtime = filesystem::last_write_time(path, ec);
+	if (ec)
+		return false;
+	stamp.size = size;
+	stamp.mtime = mtime.time_since_epoch().count();
+	return true;
+}
+
+inline uint64_t hashFile(const string& path)
+{
+	MappedFile file;
+	if (!file.open(path))
+		return 0;
+	return hashBytes(file.data(), file.size());
+}
+
+inline string meshCachePath(const string& sourcePath)
+{
+	return sourcePath + MESH_FILE_EXTENSION;
+}
+
+inline size_t alignSection(size_t offset)
+{
+	return (offset + 15) & ~size_t(15);
+}
+
+// Header for `blob`; its data pointers are not used, only sizes and format.
+inline bool makeMeshFileHeader(const MeshBlob& blob, const SourceStamp& stamp, uint64_t sourceHash,
+	uint32_t configKey, MeshFileHeader& header)
+{
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, MESH_FILE_MAGIC, sizeof(header.magic));
+	header.version = MESH_FILE_VERSION;
+	header.configKey = configKey;
+	header.sourceSize = stamp.size;
+	header.sourceMtime = stamp.mtime;
+	header.sourceHash = sourceHash;
+	header.vertexCount = static_cast<uint32_t>(blob.vertexCount);
+	header.indexCount = static_cast<uint32_t>(blob.indexCount);
+	header.indexType = blob.indexType;
+	header.layout = static_cast<uint32_t>(blob.format.layout);
+	header.vertexSize = blob.format.vertexSize;
+	header.attributeCount = static_cast<uint32_t>(blob.format.attributes.size());
+	if (header.attributeCount > 4)
+		return false;
+	for (uint32_t i = 0; i < header.attributeCount; i++) {
+		const VertexAttribute& attr = blob.format.attributes[i];
+		header.attributes[i] = { attr.location, attr.size, attr.type, attr.normalized,
+			attr.stride, static_cast<uint32_t>(attr.offset) };
+	}
+	for (int k = 0; k < 3; k++) {
+		header.dequantScale[k] = blob.format.dequantScale[k];
+		header.dequantOffset[k] = blob.format.dequantOffset[k];
+	}
+	return true;
+}
+
+// Serialize `blob` to `cachePath`. The file is written under a temporary name
+// and renamed, so a crash never leaves a truncated cache behind.
+inline bool writeMeshFile(const string& cachePath, const MeshBlob& blob, const SourceStamp& stamp,
+	uint64_t sourceHash, uint32_t configKey)
+{
+	MeshFileHeader header;
+	if (!makeMeshFileHeader(blob, stamp, sourceHash, configKey, header))
+		return false;
+
+	struct Payload { uint32_t tag; const void* data; size_t size; };
+	vector<Payload> payloads = {
+		blob.vertexEncodedBytes ? Payload{ MESH_SECTION_VERTICES_ENCODED, blob.vertexData, blob.vertexEncodedBytes }
+			: Payload{ MESH_SECTION_VERTICES, blob.vertexData, blob.vertexBytes },
+		blob.indexEncodedBytes ? Payload{ MESH_SECTION_INDICES_ENCODED, blob.indexData, blob.indexEncodedBytes }
+			: Payload{ MESH_SECTION_INDICES, blob.indexData, blob.indexBytes },
+		{ MESH_SECTION_BOUNDS, &blob.bounds[0], sizeof(float) * 4 },
+	};
+	if (!blob.lods.empty())
+		payloads.push_back({ MESH_SECTION_LODS, blob.lods.data(), sizeof(MeshLod) * blob.lods.size() });
+	if (!blob.meshlets.empty())
+		payloads.push_back({ MESH_SECTION_MESHLETS, blob.meshlets.data(), sizeof(Meshlet) * blob.meshlets.size() });
+	if (!blob.submeshes.empty())
+		payloads.push_back({ MESH_SECTION_SUBMESHES, blob.submeshes.data(), sizeof(Submesh) * blob.submeshes.size() });
+	if (!blob.materials.empty())
+		payloads.push_back({ MESH_SECTION_MATERIALS, blob.materials.data(), sizeof(Material) * blob.materials.size() });
+	header.sectionCount = static_cast<uint32_t>(payloads.size());
+
+	vector<MeshFileSection> sections;
+	size_t offset = alignSection(sizeof(header) + sizeof(MeshFileSection) * payloads.size());
+	for (const Payload& payload : payloads) {
+		sections.push_back({ payload.tag, 0, offset, payload.size });
+		offset = alignSection(offset + payload.size);
+	}
+
+	string tmpPath = cachePath + ".tmp";
+	ofstream fs(tmpPath, ios::binary | ios::trunc);
+	if (!fs.is_open())
+		return false;
+	fs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	fs.write(reinterpret_cast<const char*>(sections.data()), sizeof(MeshFileSection) * sections.size());
+	for (size_t i = 0; i < payloads.size(); i++) {
+		size_t pad = sections[i].offset - static_cast<size_t>(fs.tellp());
+		static const char zeros[16] = {};
+		fs.write(zeros, pad);
+		if (payloads[i].size)
+			fs.write(static_cast<const char*>(payloads[i].data), payloads[i].size);
+	}
+	fs.close();
+	if (!fs) {
+		remove(tmpPath.c_str());
+		return false;
+	}
+
+	error_code ec;
+	filesystem::rename(tmpPath, cachePath, ec);
+	return !ec;
+}
+
+// Store `stamp` as the source state of the cache at `cachePath`, whose
+// payload is still right for it. Only the mtime can differ, and the
+// header is rewritten in place.
+inline bool restampMeshFile(const string& cachePath, const SourceStamp& stamp)
+{
+	fstream fs(cachePath, ios::in | ios::out | ios::binary);
+	if (!fs.is_open())
+		return false;
+	fs.seekp(offsetof(MeshFileHeader, sourceMtime));
+	fs.write(reinterpret_cast<const char*>(&stamp.mtime), sizeof(stamp.mtime));
+	return bool(fs);
+}
+
+// Whether [offset, offset + count) lies within the first `limit` elements
+inline bool meshRangeInside(uint32_t offset, uint32_t count, size_t limit)
+{
+	return uint64_t(offset) + count <= limit;
+}
+
+// Validate a mapped cache file against its source and point `blob` into it.
+// A changed mtime alone does not invalidate the cache: the source is then
+// hashed, and if the content is the same the cache is kept and restamped so
+// later runs skip the hash. Payload sizes and draw ranges are checked against
+// the header, so a truncated or stale file is rejected rather than drawn.
+inline bool readMeshFile(const MappedFile& file, const string& sourcePath, uint32_t configKey, MeshBlob& blob)
+{
+	if (file.size() < sizeof(MeshFileHeader))
+		return false;
+	MeshFileHeader header;
+	memcpy(&header, file.data(), sizeof(header));
+	if (memcmp(header.magic, MESH_FILE_MAGIC, sizeof(header.magic)) != 0
+		|| header.version != MESH_FILE_VERSION || header.configKey != configKey
+		|| header.attributeCount > 4
+		|| (header.indexType != GL_UNSIGNED_SHORT && header.indexType != GL_UNSIGNED_INT))
+		return false;
+
+	SourceStamp stamp;
+	if (!statSource(sourcePath, stamp) || stamp.size != header.sourceSize)
+		return false;
+	bool restamp = stamp.mtime != header.sourceMtime;
+	if (restamp && hashFile(sourcePath) != header.sourceHash)
+		return false;
+
+	size_t tableEnd = sizeof(header) + sizeof(MeshFileSection) * size_t(header.sectionCount);
+	if (file.size() < tableEnd)
+		return false;
+	const MeshFileSection* sections = reinterpret_cast<const MeshFileSection*>(file.data() + sizeof(header));
+
+	blob = MeshBlob();
+	for (uint32_t i = 0; i < header.sectionCount; i++) {
+		const MeshFileSection& section = sections[i];
+		if (section.offset > file.size() || section.size > file.size() - section.offset)
+			return false;
+		const void* data = file.data() + section.offset;
+		if (section.tag == MESH_SECTION_VERTICES) {
+			blob.vertexData = data;
+			blob.vertexBytes = section.size;
+		} else if (section.tag == MESH_SECTION_INDICES) {
+			blob.indexData = data;
+			blob.indexBytes = section.size;
+		} else if (section.tag == MESH_SECTION_VERTICES_ENCODED) {
+			blob.vertexData = data;
+			blob.vertexEncodedBytes = section.size;
+		} else if (section.tag == MESH_SECTION_INDICES_ENCODED) {
+			blob.indexData = data;
+			blob.indexEncodedBytes = section.size;
+		} else if (section.tag == MESH_SECTION_BOUNDS && section.size == sizeof(float) * 4) {
+			memcpy(&blob.bounds[0], data, sizeof(float) * 4);
+		} else if (section.tag == MESH_SECTION_LODS && section.size % sizeof(MeshLod) == 0) {
+			blob.lods.resize(section.size / sizeof(MeshLod));
+			memcpy(blob.lods.data(), data, section.size);
+		} else if (section.tag == MESH_SECTION_MESHLETS && section.size % sizeof(Meshlet) == 0) {
+			blob.meshlets.resize(section.size / sizeof(Meshlet));
+			memcpy(blob.meshlets.data(), data, section.size);
+		} else if (section.tag == MESH_SECTION_SUBMESHES && section.size % sizeof(Submesh) == 0) {
+			blob.submeshes.resize(section.size / sizeof(Submesh));
+			memcpy(blob.submeshes.data(), data, section.size);
+		} else if (section.tag == MESH_SECTION_MATERIALS && section.size % sizeof(Material) == 0) {
+			blob.materials.resize(section.size / sizeof(Material));
+			memcpy(blob.materials.data(), data, section.size);
+		}
+	}
+
+	blob.vertexCount = header.vertexCount;
+	blob.indexCount = header.indexCount;
+	blob.indexType = header.indexType;
+	blob.format.layout = static_cast<VERTEXLAYOUT>(header.layout);
+	blob.format.vertexSize = header.vertexSize;
+	for (uint32_t i = 0; i < header.attributeCount; i++) {
+		const MeshFileAttribute& attr = header.attributes[i];
+		blob.format.attributes.push_back({ attr.location, attr.size, attr.type,
+			static_cast<GLboolean>(attr.normalized), attr.stride, attr.offset });
+	}
+	blob.format.dequantScale = glm::vec3(header.dequantScale[0], header.dequantScale[1], header.dequantScale[2]);
+	blob.format.dequantOffset = glm::vec3(header.dequantOffset[0], header.dequantOffset[1], header.dequantOffset[2]);
+	size_t indexSize = blob.indexType == GL_UNSIGNED_SHORT ? 2 : 4;
+	if (!blob.vertexData || (blob.indexCount > 0 && !blob.indexData))
+		return false;
+
+	// Every attribute must lie inside the vertex buffer, and an encoded
+	// section must be a plausible size for the counts it claims, which size
+	// the GL buffers and the decode
+	if (blob.format.vertexSize == 0 || blob.format.attributes.empty())
+		return false;
+	uint64_t vertexBytes = uint64_t(blob.vertexCount) * blob.format.vertexSize;
+	for (const VertexAttribute& attr : blob.format.attributes) {
+		size_t bytes = attributeBytes(attr);
+		if (bytes == 0 || attr.stride < bytes || (blob.vertexCount > 0
+			&& attr.offset + uint64_t(blob.vertexCount - 1) * attr.stride + bytes > vertexBytes))
+			return false;
+	}
+	if (blob.vertexEncodedBytes) {
+		if (!meshCodecSizeFits(blob.vertexCount, blob.format.vertexSize, blob.vertexEncodedBytes))
+			return false;
+		blob.vertexBytes = vertexBytes;
+	}
+	if (blob.indexEncodedBytes && !meshCodecSizeFits(blob.indexCount, indexSize, blob.indexEncodedBytes))
+		return false;
+	if (!blob.vertexEncodedBytes && blob.vertexBytes != uint64_t(header.vertexCount) * header.vertexSize)
+		return false;
+	if (blob.indexData && !blob.indexEncodedBytes && blob.indexBytes != uint64_t(header.indexCount) * indexSize)
+		return false;
+	if (blob.indexEncodedBytes)
+		blob.indexBytes = blob.indexCount * indexSize;
+
+	// Every range a draw reads
+	size_t drawable = blob.indexCount > 0 ? blob.indexCount : blob.vertexCount;
+	for (const MeshLod& lod : blob.lods) {
+		if (!meshRangeInside(lod.indexOffset, lod.indexCount, drawable))
+			return false;
+	}
+	for (const Meshlet& meshlet : blob.meshlets) {
+		if (!meshRangeInside(meshlet.indexOffset, meshlet.indexCount, drawable))
+			return false;
+	}
+	for (const Submesh& submesh : blob.submeshes) {
+		if (!meshRangeInside(submesh.indexOffset, submesh.indexCount, drawable)
+			|| submesh.material >= int32_t(blob.materials.size()))
+			return false;
+	}
+
+	if (restamp && !restampMeshFile(file.path(), stamp))
+		cerr << "Failed to update mesh cache stamp: " << file.path() << endl;
+	return true;
+}
@@ -0,0 +1,376 @@
+#pragma once
+#include <queue>
+#include <cmath>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <iostream>
+#include <algorithm>
+#include <unordered_map>
+#include <glm/glm.hpp>
+
+#include "MeshData.h"
+#include "MeshOptimize.h"
+
+using namespace std;
+
+// Level of detail chain built at load time with quadric error metric
+// (Garland & Heckbert) edge collapses.
+//
+// Every level indexes the same vertex buffer: collapses only move a vertex
+// onto one of its neighbours, never create new ones. Collapses run on
+// positions, so UV and normal seams (which welding keeps as separate
+// vertices) simplify like the rest of the surface; each corner that moves
+// picks the vertex at the target position whose normal and uv are closest.
+// The levels are stored back to back in the element buffer.
+
+struct MeshLod
+{
+	uint32_t indexOffset; // in indices, into the shared element buffer
+	uint32_t indexCount;
+	float error;          // object space distance the level may deviate by
+	uint32_t reserved;
+};
+
+// Sphere around the bounding box center: (center, radius). Loose, but cheap
+// and stable, which is all screen size estimates need.
+inline glm::vec4 computeBoundingSphere(const vector<float>& positions)
+{
+	if (positions.size() < 3)
+		return glm::vec4(0.0f);
+	glm::vec3 lo(positions[0], positions[1], positions[2]), hi = lo;
+	for (size_t i = 3; i + 2 < positions.size(); i += 3) {
+		glm::vec3 p(positions[i], positions[i + 1], positions[i + 2]);
+		lo = glm::min(lo, p);
+		hi = glm::max(hi, p);
+	}
+	glm::vec3 center = (lo + hi) * 0.5f;
+	float radius2 = 0.0f;
+	for (size_t i = 0; i + 2 < positions.size(); i += 3) {
+		glm::vec3 d = glm::vec3(positions[i], positions[i + 1], positions[i + 2]) - center;
+		radius2 = max(radius2, glm::dot(d, d));
+	}
+	return glm::vec4(center, sqrt(radius2));
+}
+
+const int MAX_LOD_LEVELS = 4;
+const float LOD_REDUCTION = 0.5f;    // triangles kept per level
+const float LOD_MIN_REDUCTION = 0.9f; // stop when a level saves less than 10%
+const float LOD_PIXEL_ERROR = 1.0f;   // largest on-screen error a level may show
+const float LOD_HYSTERESIS = 0.25f;   // a coarser level must beat the limit by this much
+
+// Symmetric 4x4 error quadric
+struct Quadric
+{
+	double a2 = 0, ab = 0, ac = 0, ad = 0, b2 = 0, bc = 0, bd = 0, c2 = 0, cd = 0, d2 = 0;
+
+	void addPlane(const glm::dvec3& n, double d, double weight)
+	{
+		a2 += weight * n.x * n.x; ab += weight * n.x * n.y; ac += weight * n.x * n.z; ad += weight * n.x * d;
+		b2 += weight * n.y * n.y; bc += weight * n.y * n.z; bd += weight * n.y * d;
+		c2 += weight * n.z * n.z; cd += weight * n.z * d;
+		d2 += weight * d * d;
+	}
+
+	void add(const Quadric& q)
+	{
+		a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad; b2 += q.b2;
+		bc += q.bc; bd += q.bd; c2 += q.c2; cd += q.cd; d2 += q.d2;
+	}
+
+	// Sum of squared distances from p to the accumulated planes
+	double error(const glm::vec3& p) const
+	{
+		double x = p.x, y = p.y, z = p.z;
+		double e = a2 * x * x + 2 * ab * x * y + 2 * ac * x * z + 2 * ad * x
+			+ b2 * y * y + 2 * bc * y * z + 2 * bd * y
+			+ c2 * z * z + 2 * cd * z + d2;
+		return e > 0 ? e : 0;
+	}
+};
+
+// Collapse edges of `indices` (a triangle list over `mesh`'s vertices) until
+// at most `targetTriangles` remain or the next collapse would cost more than
+// `maxError` (object space distance). Returns the new triangle list and
+// stores the largest accepted error in `resultError`.
+inline vector<unsigned int> simplifyMesh(const MeshData& mesh, const vector<unsigned int>& indices,
+	size_t targetTriangles, float maxError, float& resultError)
+{
+	size_t vertexCount = mesh.vertexCount();
+	size_t triangleCount = indices.size() / 3;
+	resultError = 0.0f;
+
+	// Group vertices that share a position
+	vector<unsigned int> posOf;
+	size_t positionCount = positionIds(mesh.positions, posOf);
+	vector<glm::vec3> pos(positionCount);
+	for (size_t v = 0; v < vertexCount; v++)
+		pos[posOf[v]] = glm::vec3(mesh.positions[v * 3 + 0], mesh.positions[v * 3 + 1], mesh.positions[v * 3 + 2]);
+
+	vector<unsigned int> wedgeOffsets(positionCount + 1, 0), wedges(vertexCount);
+	for (size_t v = 0; v < vertexCount; v++)
+		wedgeOffsets[posOf[v] + 1]++;
+	for (size_t p = 0; p < positionCount; p++)
+		wedgeOffsets[p + 1] += wedgeOffsets[p];
+	{
+		vector<unsigned int> fill(wedgeOffsets.begin(), wedgeOffsets.end() - 1);
+		for (size_t v = 0; v < vertexCount; v++)
+			wedges[fill[posOf[v]]++] = static_cast<unsigned int>(v);
+	}
+
+	// Triangles in position space, plus the vertex each corner uses
+	vector<unsigned int> triPos(indices.size()), triVtx(indices);
+	vector<char> alive(triangleCount, 1);
+	vector<vector<unsigned int>> posTris(positionCount);
+	size_t liveTriangles = 0;
+	for (size_t t = 0; t < triangleCount; t++) {
+		for (int c = 0; c < 3; c++)
+			triPos[t * 3 + c] = posOf[indices[t * 3 + c]];
+		if (triPos[t * 3] == triPos[t * 3 + 1] || triPos[t * 3 + 1] == triPos[t * 3 + 2]
+			|| triPos[t * 3] == triPos[t * 3 + 2]) {
+			alive[t] = 0;
+			continue;
+		}
+		liveTriangles++;
+		for (int c = 0; c < 3; c++)
+			posTris[triPos[t * 3 + c]].push_back(static_cast<unsigned int>(t));
+	}
+
+	// Edge use counts: 1 = border, > 2 = non-manifold
+	unordered_map<uint64_t, unsigned int> edgeUse;
+	auto edgeKey = [](unsigned int a, unsigned int b) {
+		return a < b ? (uint64_t(a) << 32 | b) : (uint64_t(b) << 32 | a);
+	};
+	for (size_t t = 0; t < triangleCount; t++) {
+		if (!alive[t])
+			continue;
+		for (int c = 0; c < 3; c++)
+			edgeUse[edgeKey(triPos[t * 3 + c], triPos[t * 3 + (c + 1) % 3])]++;
+	}
+
+	vector<Quadric> quadrics(positionCount);
+	vector<char> border(positionCount, 0), locked(positionCount, 0);
+	for (size_t t = 0; t < triangleCount; t++) {
+		if (!alive[t])
+			continue;
+		glm::dvec3 p0 = pos[triPos[t * 3]], p1 = pos[triPos[t * 3 + 1]], p2 = pos[triPos[t * 3 + 2]];
+		glm::dvec3 n = glm::cross(p1 - p0, p2 - p0);
+		double area = glm::length(n);
+		if (area <= 0)
+			continue;
+		n /= area;
+		for (int c = 0; c < 3; c++)
+			quadrics[triPos[t * 3 + c]].addPlane(n, -glm::dot(n, p0), 1.0);
+
+		// Keep open borders in place with a plane perpendicular to the face
+		for (int c = 0; c < 3; c++) {
+			unsigned int a = triPos[t * 3 + c], b = triPos[t * 3 + (c + 1) % 3];
+			unsigned int use = edgeUse[edgeKey(a, b)];
+			if (use == 1) {
+				glm::dvec3 pa = pos[a], pb = pos[b];
+				glm::dvec3 edge = pb - pa;
+				glm::dvec3 m = glm::cross(edge, n);
+				double len = glm::length(m);
+				if (len > 0) {
+					m /= len;
+					quadrics[a].addPlane(m, -glm::dot(m, pa), 10.0);
+					quadrics[b].addPlane(m, -glm::dot(m, pa), 10.0);
+				}
+				border[a] = border[b] = 1;
+			} else if (use > 2) {
+				locked[a] = locked[b] = 1;
+			}
+		}
+	}
+
+	struct Collapse
+	{
+		double cost;
+		unsigned int from, to;
+		bool operator<(const Collapse& o) const { return cost > o.cost; }
+	};
+	priority_queue<Collapse> queue;
+	auto pushEdges = [&](unsigned int p) {
+		for (unsigned int t : posTris[p]) {
+			if (!alive[t])
+				continue;
+			for (int c = 0; c < 3; c++) {
+				unsigned int a = triPos[t * 3 + c], b = triPos[t * 3 + (c + 1) % 3];
+				queue.push({ quadrics[a].error(pos[b]), a, b });
+				queue.push({ quadrics[b].error(pos[a]), b, a });
+			}
+		}
+	};
+	for (size_t p = 0; p < positionCount; p++)
+		pushEdges(static_cast<unsigned int>(p));
+
+	vector<char> collapsed(positionCount, 0);
+	double maxCost = double(maxError) * double(maxError);
+	double acceptedCost = 0;
+
+	while (liveTriangles > targetTriangles && !queue.empty()) {
+		Collapse top = queue.top();
+		queue.pop();
+		unsigned int a = top.from, b = top.to;
+		if (collapsed[a] || collapsed[b] || locked[a])
+			continue;
+
+		double cost = quadrics[a].error(pos[b]);
+		if (cost > top.cost * 1.000001 + 1e-30) {
+			queue.push({ cost, a, b }); // stale entry, requeue with the current cost
+			continue;
+		}
+		if (cost > maxCost)
+			break;
+
+		// The edge must still exist; border vertices may only slide along the border
+		unsigned int shared = 0;
+		for (unsigned int t : posTris[a]) {
+			if (alive[t] && (triPos[t * 3] == b || triPos[t * 3 + 1] == b || triPos[t * 3 + 2] == b))
+				shared++;
+		}
+		if (shared == 0 || (border[a] && shared != 1))
+			continue;
+
+		// Reject collapses that flip a remaining triangle
+		bool flips = false;
+		for (unsigned int t : posTris[a]) {
+			if (!alive[t])
+				continue;
+			const unsigned int* tp = &triPos[t * 3];
+			if (tp[0] == b || tp[1] == b || tp[2] == b)
+				continue;
+			glm::vec3 before[3], after[3];
+			for (int c = 0; c < 3; c++) {
+				before[c] = pos[tp[c]];
+				after[c] = tp[c] == a ? pos[b] : pos[tp[c]];
+			}
+			glm::vec3 n0 = glm::cross(before[1] - before[0], before[2] - before[0]);
+			glm::vec3 n1 = glm::cross(after[1] - after[0], after[2] - after[0]);
+			if (glm::dot(n0, n1) <= 0.0f) {
+				flips = true;
+				break;
+			}
+		}
+		if (flips)
+			continue;
+
+		for (unsigned int t : posTris[a]) {
+			if (!alive[t])
+				continue;
+			unsigned int* tp = &triPos[t * 3];
+			if (tp[0] == b || tp[1] == b || tp[2] == b) {
+				alive[t] = 0;
+				liveTriangles--;
+				continue;
+			}
+			for (int c = 0; c < 3; c++) {
+				if (tp[c] != a)
+					continue;
+				tp[c] = b;
+
+				// Keep the corner's normal and uv as close as the target allows
+				unsigned int v = triVtx[t * 3 + c], best = v;
+				float bestDistance = 1e30f;
+				for (unsigned int k = wedgeOffsets[b]; k < wedgeOffsets[b + 1]; k++) {
+					unsigned int w = wedges[k];
+					float d = 0.0f;
+					for (int j = 0; j < 3; j++) {
+						float dn = mesh.normals[w * 3 + j] - mesh.normals[v * 3 + j];
+						d += dn * dn;
+					}
+					for (int j = 0; j < 2; j++) {
+						float dt = mesh.texcoords[w * 2 + j] - mesh.texcoords[v * 2 + j];
+						d += dt * dt;
+					}
+					if (d < bestDistance) {
+						bestDistance = d;
+						best = w;
+					}
+				}
+				triVtx[t * 3 + c] = best;
+			}
+			posTris[b].push_back(t);
+		}
+
+		quadrics[b].add(quadrics[a]);
+		border[b] |= border[a];
+		collapsed[a] = 1;
+		posTris[a].clear();
+		acceptedCost = max(acceptedCost, cost);
+
+		// Drop dead triangles from b's list now and then so it stays short
+		auto& list = posTris[b];
+		list.erase(remove_if(list.begin(), list.end(), [&](unsigned int t) { return !alive[t]; }), list.end());
+		sort(list.begin(), list.end());
+		list.erase(unique(list.begin(), list.end()), list.end());
+		pushEdges(b);
+	}
+
+	vector<unsigned int> result;
+	result.reserve(liveTriangles * 3);
+	for (size_t t = 0; t < triangleCount; t++) {
+		if (alive[t])
+			result.insert(result.end(), &triVtx[t * 3], &triVtx[t * 3] + 3);
+	}
+	resultError = float(sqrt(acceptedCost));
+	return result;
+}
+
+// Append up to MAX_LOD_LEVELS - 1 coarser levels to mesh.indices, each about
+// half the triangles of the previous one, and return the ranges of all
+// levels (level 0 is the original triangle list).
+inline vector<MeshLod> buildLodChain(const string& name, MeshData& mesh, bool optimize)
+{
+	vector<MeshLod> lods;
+	lods.push_back({ 0, static_cast<uint32_t>(mesh.indices.size()), 0.0f, 0 });
+
+	// Past a tenth of the radius the shape is gone; stop there
+	float maxError = 0.1f * computeBoundingSphere(mesh.positions).w;
+
+	vector<unsigned int> previous = mesh.indices;
+	float previousError = 0.0f;
+	while (int(lods.size()) < MAX_LOD_LEVELS) {
+		size_t triangles = previous.size() / 3;
+		size_t target = size_t(triangles * LOD_REDUCTION);
+		float error = 0.0f;
+		vector<unsigned int> level = simplifyMesh(mesh, previous, target, maxError, error);
+		if (level.empty() || level.size() > previous.size() * LOD_MIN_REDUCTION)
+			break;
+		if (optimize)
+			level = optimizeVertexCache(level, mesh.vertexCount());
+
+		// Errors accumulate along the chain
+		previousError += error;
+		lods.push_back({ static_cast<uint32_t>(mesh.indices.size()), static_cast<uint32_t>(level.size()),
+			previousError, 0 });
+		mesh.indices.insert(mesh.indices.end(), level.begin(), level.end());
+		previous.swap(level);
+	}
+
+	cout << name << ": LOD triangles";
+	for (const MeshLod& lod : lods)
+		cout << " " << lod.indexCount / 3;
+	cout << ", max error " << lods.back().error << endl;
+	return lods;
+}
+
+// Coarsest level whose error stays under `threshold` pixels, given how many
+// pixels one object space unit covers at the mesh's bounding sphere.
+// Starting from `current` (the level this draw used last frame), a finer
+// level is taken as soon as the current one exceeds the limit, but a coarser
+// one only once it is `hysteresis` below it, so a mesh sitting right at a
+// threshold does not flip between levels every frame.
+inline int selectLod(const vector<MeshLod>& lods, float pixelsPerUnit, int current,
+	float threshold = LOD_PIXEL_ERROR, float hysteresis = LOD_HYSTERESIS)
+{
+	int count = int(lods.size());
+	if (count <= 1)
+		return 0;
+	int lod = max(0, min(current, count - 1));
+	while (lod > 0 && lods[lod].error * pixelsPerUnit > threshold)
+		lod--;
+	while (lod + 1 < count && lods[lod + 1].error * pixelsPerUnit <= threshold * (1.0f - hysteresis))
+		lod++;
+	return lod;
+}
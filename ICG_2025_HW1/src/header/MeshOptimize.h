@@ -0,0 +1,318 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <numeric>
+#include <iostream>
+#include <algorithm>
+#include <glm/glm.hpp>
+
+#include "MeshData.h"
+
+using namespace std;
+
+// Triangle and vertex reordering for indexed meshes, run after welding:
+//   1. Tipsify (Sander et al. 2007) reorders triangles for the post-transform
+//      vertex cache.
+//   2. The result is cut into clusters where the cache restarts anyway, and the
+//      clusters are sorted so outward facing ones draw first (less overdraw).
+//   3. Vertices are renumbered in first-use order so fetches walk the vertex
+//      buffer front to back.
+// None of this changes the rendered image, only the order of the work.
+
+const unsigned int VERTEX_CACHE_SIZE = 16;
+
+// ACMR: transformed vertices per triangle (0.5 is ideal, 3 is the worst).
+// ATVR: transformed vertices per unique vertex (1 is ideal).
+// Both measured on a FIFO cache of `cacheSize` entries.
+struct VertexCacheStats
+{
+	float acmr = 0.0f;
+	float atvr = 0.0f;
+};
+
+inline VertexCacheStats analyzeVertexCache(const vector<unsigned int>& indices, size_t vertexCount,
+	unsigned int cacheSize = VERTEX_CACHE_SIZE)
+{
+	VertexCacheStats stats;
+	if (indices.empty() || vertexCount == 0)
+		return stats;
+
+	// FIFO cache as per-vertex insertion timestamps
+	vector<unsigned int> cachedAt(vertexCount, 0);
+	unsigned int timestamp = cacheSize + 1;
+	size_t misses = 0;
+	for (unsigned int v : indices) {
+		if (timestamp - cachedAt[v] > cacheSize) {
+			cachedAt[v] = timestamp++;
+			misses++;
+		}
+	}
+
+	stats.acmr = float(misses) / float(indices.size() / 3);
+	stats.atvr = float(misses) / float(vertexCount);
+	return stats;
+}
+
+// Per-vertex list of the triangles using it, in CSR form.
+struct TriangleAdjacency
+{
+	vector<unsigned int> offsets; // vertexCount + 1
+	vector<unsigned int> triangles;
+
+	TriangleAdjacency(const vector<unsigned int>& indices, size_t vertexCount)
+		: offsets(vertexCount + 1, 0), triangles(indices.size())
+	{
+		for (unsigned int v : indices)
+			offsets[v + 1]++;
+		for (size_t v = 0; v < vertexCount; v++)
+			offsets[v + 1] += offsets[v];
+		vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+		for (size_t i = 0; i < indices.size(); i++)
+			triangles[fill[indices[i]]++] = static_cast<unsigned int>(i / 3);
+	}
+};
+
+// Tipsify: fan around a vertex until it is used up, then continue with the
+// candidate that is still in the cache and has the fewest live triangles.
+inline vector<unsigned int> optimizeVertexCache(const vector<unsigned int>& indices, size_t vertexCount,
+	unsigned int cacheSize = VERTEX_CACHE_SIZE)
+{
+	size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0)
+		return indices;
+
+	TriangleAdjacency adjacency(indices, vertexCount);
+	vector<unsigned int> live(vertexCount);
+	for (size_t v = 0; v < vertexCount; v++)
+		live[v] = adjacency.offsets[v + 1] - adjacency.offsets[v];
+
+	vector<unsigned int> cachedAt(vertexCount, 0);
+	vector<char> emitted(triangleCount, 0);
+	vector<unsigned int> deadEnd;
+	vector<unsigned int> candidates;
+	vector<unsigned int> result;
+	result.reserve(indices.size());
+
+	unsigned int timestamp = cacheSize + 1;
+	size_t scan = 0; // next vertex to try when the dead-end stack runs dry
+	long fan = indices[0];
+
+	while (fan >= 0) {
+		candidates.clear();
+		for (unsigned int k = adjacency.offsets[fan]; k < adjacency.offsets[fan + 1]; k++) {
+			unsigned int t = adjacency.triangles[k];
+			if (emitted[t])
+				continue;
+			emitted[t] = 1;
+			for (int c = 0; c < 3; c++) {
+				unsigned int v = indices[t * 3 + c];
+				result.push_back(v);
+				deadEnd.push_back(v);
+				candidates.push_back(v);
+				live[v]--;
+				if (timestamp - cachedAt[v] > cacheSize)
+					cachedAt[v] = timestamp++;
+			}
+		}
+
+		// Prefer a vertex that will still be cached after fanning around it
+		fan = -1;
+		int best = -1;
+		for (unsigned int v : candidates) {
+			if (live[v] == 0)
+				continue;
+			int priority = 0;
+			if (timestamp - cachedAt[v] + 2 * live[v] <= cacheSize)
+				priority = int(timestamp - cachedAt[v]);
+			if (priority > best) {
+				best = priority;
+				fan = v;
+			}
+		}
+
+		if (fan < 0) {
+			while (!deadEnd.empty()) {
+				unsigned int v = deadEnd.back();
+				deadEnd.pop_back();
+				if (live[v] > 0) {
+					fan = v;
+					break;
+				}
+			}
+		}
+		while (fan < 0 && scan < vertexCount) {
+			if (live[scan] > 0)
+				fan = long(scan);
+			scan++;
+		}
+	}
+	return result;
+}
+
+// Cut a cache-optimized index buffer into clusters and sort them front to
+// back as seen from outside the mesh. Cuts go where every vertex of a triangle
+// misses the cache (the order restarts there anyway), plus wherever the
+// running ACMR of a cluster is within `threshold` of that cluster's total, so
+// the cache efficiency is kept.
+inline void optimizeOverdraw(vector<unsigned int>& indices, const vector<float>& positions,
+	unsigned int cacheSize = VERTEX_CACHE_SIZE, float threshold = 1.05f)
+{
+	size_t triangleCount = indices.size() / 3;
+	size_t vertexCount = positions.size() / 3;
+	if (triangleCount < 2)
+		return;
+
+	// Hard boundaries
+	vector<unsigned int> hard;
+	{
+		vector<unsigned int> cachedAt(vertexCount, 0);
+		unsigned int timestamp = cacheSize + 1;
+		for (size_t t = 0; t < triangleCount; t++) {
+			int misses = 0;
+			for (int c = 0; c < 3; c++) {
+				unsigned int v = indices[t * 3 + c];
+				if (timestamp - cachedAt[v] > cacheSize) {
+					cachedAt[v] = timestamp++;
+					misses++;
+				}
+			}
+			if (t == 0 || misses == 3)
+				hard.push_back(static_cast<unsigned int>(t));
+		}
+	}
+	hard.push_back(static_cast<unsigned int>(triangleCount));
+
+	// Soft boundaries inside each hard cluster
+	vector<unsigned int> clusters;
+	{
+		vector<unsigned int> cachedAt(vertexCount, 0);
+		unsigned int timestamp = cacheSize + 1;
+		auto misses = [&](size_t t) {
+			int count = 0;
+			for (int c = 0; c < 3; c++) {
+				unsigned int v = indices[t * 3 + c];
+				if (timestamp - cachedAt[v] > cacheSize) {
+					cachedAt[v] = timestamp++;
+					count++;
+				}
+			}
+			return count;
+		};
+
+		for (size_t h = 0; h + 1 < hard.size(); h++) {
+			size_t begin = hard[h], end = hard[h + 1];
+			timestamp += cacheSize + 1;
+			size_t total = 0;
+			for (size_t t = begin; t < end; t++)
+				total += misses(t);
+			float clusterAcmr = float(total) / float(end - begin);
+
+			timestamp += cacheSize + 1;
+			clusters.push_back(static_cast<unsigned int>(begin));
+			size_t running = 0, start = begin;
+			for (size_t t = begin; t < end; t++) {
+				running += misses(t);
+				if (t + 1 < end && float(running) / float(t + 1 - start) <= clusterAcmr * threshold) {
+					// Measure the next cluster as if it started cold
+					clusters.push_back(static_cast<unsigned int>(t + 1));
+					timestamp += cacheSize + 1;
+					start = t + 1;
+					running = 0;
+				}
+			}
+		}
+	}
+	clusters.push_back(static_cast<unsigned int>(triangleCount));
+	size_t clusterCount = clusters.size() - 1;
+
+	// Area weighted centroid and normal of each cluster and of the mesh
+	vector<glm::vec3> centroids(clusterCount), normals(clusterCount);
+	glm::vec3 meshCentroid(0.0f);
+	float meshArea = 0.0f;
+	for (size_t c = 0; c < clusterCount; c++) {
+		glm::vec3 centroid(0.0f), normal(0.0f);
+		float area = 0.0f;
+		for (size_t t = clusters[c]; t < clusters[c + 1]; t++) {
+			glm::vec3 p[3];
+			for (int k = 0; k < 3; k++) {
+				unsigned int v = indices[t * 3 + k];
+				p[k] = glm::vec3(positions[v * 3 + 0], positions[v * 3 + 1], positions[v * 3 + 2]);
+			}
+			glm::vec3 n = glm::cross(p[1] - p[0], p[2] - p[0]);
+			float a = glm::length(n);
+			centroid += (p[0] + p[1] + p[2]) * (a / 3.0f);
+			normal += n;
+			area += a;
+		}
+		meshCentroid += centroid;
+		meshArea += area;
+		centroids[c] = area > 0.0f ? centroid / area : centroid;
+		normals[c] = glm::length(normal) > 0.0f ? glm::normalize(normal) : normal;
+	}
+	if (meshArea > 0.0f)
+		meshCentroid /= meshArea;
+
+	vector<float> sortKey(clusterCount);
+	for (size_t c = 0; c < clusterCount; c++)
+		sortKey[c] = glm::dot(centroids[c] - meshCentroid, normals[c]);
+
+	vector<unsigned int> order(clusterCount);
+	iota(order.begin(), order.end(), 0u);
+	stable_sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) { return sortKey[a] > sortKey[b]; });
+
+	vector<unsigned int> sorted;
+	sorted.reserve(indices.size());
+	for (unsigned int c : order)
+		sorted.insert(sorted.end(), indices.begin() + clusters[c] * 3, indices.begin() + clusters[c + 1] * 3);
+	indices.swap(sorted);
+}
+
+// Renumber vertices in order of first use and reorder the attribute arrays to
+// match. Unreferenced vertices are dropped.
+inline void optimizeVertexFetch(MeshData& mesh)
+{
+	const unsigned int unused = ~0u;
+	vector<unsigned int> remap(mesh.vertexCount(), unused);
+	MeshData fetched;
+	fetched.positions.reserve(mesh.positions.size());
+	fetched.normals.reserve(mesh.normals.size());
+	fetched.texcoords.reserve(mesh.texcoords.size());
+	fetched.indices.reserve(mesh.indices.size());
+
+	for (unsigned int v : mesh.indices) {
+		if (remap[v] == unused) {
+			remap[v] = static_cast<unsigned int>(fetched.vertexCount());
+			fetched.positions.insert(fetched.positions.end(), &mesh.positions[v * 3], &mesh.positions[v * 3] + 3);
+			fetched.normals.insert(fetched.normals.end(), &mesh.normals[v * 3], &mesh.normals[v * 3] + 3);
+			fetched.texcoords.insert(fetched.texcoords.end(), &mesh.texcoords[v * 2], &mesh.texcoords[v * 2] + 2);
+		}
+		fetched.indices.push_back(remap[v]);
+	}
+	mesh = std::move(fetched);
+}
+
+// All three passes; prints ACMR/ATVR before and after. With more than one
+// submesh, triangles are only reordered within their own submesh's range.
+inline void optimizeMesh(const string& name, MeshData& mesh, const vector<Submesh>& submeshes = {})
+{
+	VertexCacheStats before = analyzeVertexCache(mesh.indices, mesh.vertexCount());
+
+	if (submeshes.size() <= 1) {
+		mesh.indices = optimizeVertexCache(mesh.indices, mesh.vertexCount());
+		optimizeOverdraw(mesh.indices, mesh.positions);
+	} else {
+		for (const Submesh& submesh : submeshes) {
+			auto first = mesh.indices.begin() + submesh.indexOffset;
+			vector<unsigned int> range(first, first + submesh.indexCount);
+			range = optimizeVertexCache(range, mesh.vertexCount());
+			optimizeOverdraw(range, mesh.positions);
+			copy(range.begin(), range.end(), first);
+		}
+	}
+	optimizeVertexFetch(mesh);
+
+	VertexCacheStats after = analyzeVertexCache(mesh.indices, mesh.vertexCount());
+	cout << name << ": ACMR " << before.acmr << " -> " << after.acmr << ", ATVR " << before.atvr
+		<< " -> " << after.atvr << " (FIFO " << VERTEX_CACHE_SIZE << ")" << endl;
+}
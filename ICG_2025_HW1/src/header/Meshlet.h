@@ -0,0 +1,251 @@
+#pragma once
+#include <cmath>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <iostream>
+#include <algorithm>
+#include <glm/glm.hpp>
+#include <glad/glad.h>
+
+#include "MeshData.h"
+#include "MeshOptimize.h"
+
+using namespace std;
+
+// Meshlets: small clusters of triangles that can be culled on their own.
+//
+// Level 0 of an indexed mesh is reordered so every meshlet is a contiguous
+// run of the element buffer. Each meshlet keeps a bounding sphere for
+// frustum culling and a normal cone for backface culling; cullMeshlets()
+// turns the survivors into the ranges of one glMultiDrawElements call.
+
+const unsigned int MESHLET_MAX_VERTICES = 64;
+const unsigned int MESHLET_MAX_TRIANGLES = 124;
+// A triangle joins a meshlet only if its normal is within this cosine of the
+// meshlet's average normal; wider meshlets get cones too wide to ever cull.
+const float MESHLET_MIN_FACING = 0.5f;
+
+struct Meshlet
+{
+	uint32_t indexOffset; // in indices, into the shared element buffer
+	uint32_t indexCount;
+	float center[3];      // bounding sphere
+	float radius;
+	float coneAxis[3];    // average facing of the triangles
+	float coneCutoff;     // sine of the cone's half angle; 1 never culls
+};
+
+// Grow meshlets from the first unassigned triangle, always adding the
+// neighbouring triangle that brings in the fewest new vertices (ties go to
+// the one facing most like the meshlet so far), which keeps clusters compact
+// and their cones narrow. Neighbours are found through shared positions, so
+// growth crosses uv and normal seams. `indices` is reordered in place.
+inline vector<Meshlet> buildMeshlets(vector<unsigned int>& indices, const vector<float>& positions,
+	unsigned int maxVertices = MESHLET_MAX_VERTICES, unsigned int maxTriangles = MESHLET_MAX_TRIANGLES,
+	float minFacing = MESHLET_MIN_FACING)
+{
+	size_t triangleCount = indices.size() / 3;
+	size_t vertexCount = positions.size() / 3;
+	vector<Meshlet> meshlets;
+	if (triangleCount == 0)
+		return meshlets;
+
+	auto position = [&](unsigned int v) {
+		return glm::vec3(positions[v * 3 + 0], positions[v * 3 + 1], positions[v * 3 + 2]);
+	};
+	vector<glm::vec3> faceNormals(triangleCount);
+	for (size_t t = 0; t < triangleCount; t++) {
+		glm::vec3 p0 = position(indices[t * 3]), p1 = position(indices[t * 3 + 1]), p2 = position(indices[t * 3 + 2]);
+		glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+		float length = glm::length(n);
+		faceNormals[t] = length > 0.0f ? n / length : glm::vec3(0.0f);
+	}
+
+	vector<unsigned int> posOf;
+	size_t positionCount = positionIds(positions, posOf);
+	vector<unsigned int> positionIndices(indices.size());
+	for (size_t i = 0; i < indices.size(); i++)
+		positionIndices[i] = posOf[indices[i]];
+	TriangleAdjacency adjacency(positionIndices, positionCount);
+
+	vector<char> emitted(triangleCount, 0);
+	vector<unsigned int> inMeshlet(vertexCount, 0); // meshlet number + 1 that last took the vertex
+	vector<unsigned int> reached(positionCount, 0);  // same, for the positions whose neighbours are queued
+	vector<unsigned int> candidates;
+	vector<unsigned int> reordered;
+	reordered.reserve(indices.size());
+	size_t scan = 0;
+
+	while (reordered.size() < indices.size()) {
+		while (emitted[scan])
+			scan++;
+		unsigned int id = static_cast<unsigned int>(meshlets.size() + 1);
+		unsigned int vertices = 0, triangles = 0;
+		glm::vec3 normalSum(0.0f);
+		size_t begin = reordered.size();
+		candidates.clear();
+
+		long next = long(scan);
+		while (next >= 0) {
+			unsigned int t = static_cast<unsigned int>(next);
+			emitted[t] = 1;
+			triangles++;
+			normalSum += faceNormals[t];
+			for (int c = 0; c < 3; c++) {
+				unsigned int v = indices[t * 3 + c];
+				reordered.push_back(v);
+				if (inMeshlet[v] == id)
+					continue;
+				inMeshlet[v] = id;
+				vertices++;
+				unsigned int p = posOf[v];
+				if (reached[p] == id)
+					continue;
+				reached[p] = id;
+				for (unsigned int k = adjacency.offsets[p]; k < adjacency.offsets[p + 1]; k++) {
+					if (!emitted[adjacency.triangles[k]])
+						candidates.push_back(adjacency.triangles[k]);
+				}
+			}
+			if (triangles == maxTriangles)
+				break;
+
+			next = -1;
+			int bestNew = 4;
+			float bestFacing = -2.0f;
+			size_t live = 0;
+			for (unsigned int candidate : candidates) {
+				if (emitted[candidate])
+					continue;
+				candidates[live++] = candidate;
+				int added = 0;
+				for (int c = 0; c < 3; c++)
+					added += inMeshlet[indices[candidate * 3 + c]] != id;
+				if (vertices + added > maxVertices)
+					continue;
+				float facing = glm::dot(faceNormals[candidate], normalSum);
+				if (facing < minFacing * glm::length(normalSum))
+					continue;
+				if (added < bestNew || (added == bestNew && facing > bestFacing)) {
+					bestNew = added;
+					bestFacing = facing;
+					next = candidate;
+				}
+			}
+			candidates.resize(live);
+		}
+
+		// Bounds over the meshlet's vertices, cone over its triangles
+		Meshlet meshlet;
+		meshlet.indexOffset = static_cast<uint32_t>(begin);
+		meshlet.indexCount = static_cast<uint32_t>(reordered.size() - begin);
+		glm::vec3 lo(position(reordered[begin])), hi = lo;
+		for (size_t i = begin; i < reordered.size(); i++) {
+			lo = glm::min(lo, position(reordered[i]));
+			hi = glm::max(hi, position(reordered[i]));
+		}
+		glm::vec3 center = (lo + hi) * 0.5f;
+		float radius2 = 0.0f;
+		for (size_t i = begin; i < reordered.size(); i++) {
+			glm::vec3 d = position(reordered[i]) - center;
+			radius2 = max(radius2, glm::dot(d, d));
+		}
+
+		float axisLength = glm::length(normalSum);
+		glm::vec3 axis = axisLength > 0.0f ? normalSum / axisLength : glm::vec3(0.0f);
+		float minDot = axisLength > 0.0f ? 1.0f : -1.0f;
+		for (size_t i = begin; i < reordered.size(); i += 3) {
+			glm::vec3 p0 = position(reordered[i]), p1 = position(reordered[i + 1]), p2 = position(reordered[i + 2]);
+			glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+			float length = glm::length(n);
+			if (length > 0.0f)
+				minDot = min(minDot, glm::dot(n / length, axis));
+		}
+
+		for (int k = 0; k < 3; k++) {
+			meshlet.center[k] = center[k];
+			meshlet.coneAxis[k] = axis[k];
+		}
+		meshlet.radius = sqrt(radius2);
+		meshlet.coneCutoff = minDot <= 0.0f ? 1.0f : sqrt(1.0f - minDot * minDot);
+		meshlets.push_back(meshlet);
+	}
+
+	indices.swap(reordered);
+	return meshlets;
+}
+
+// Triangles of `meshlets` that survive culling, as one glMultiDrawElements
+// call. Reused between frames so culling does not allocate.
+struct MeshletDrawList
+{
+	vector<GLsizei> counts;
+	vector<const void*> offsets;
+	size_t culledTriangles = 0;
+};
+
+// Drop meshlets that are outside the frustum or face away from the camera,
+// merging the survivors into as few index ranges as possible. Everything
+// happens in object space: the frustum planes come from the full
+// model-view-projection matrix and the camera is moved into the model's
+// frame. Backface culling assumes GL_CULL_FACE is on.
+inline void cullMeshlets(const vector<Meshlet>& meshlets, const glm::mat4& modelViewProjection,
+	const glm::vec3& cameraPosition, size_t indexSize, MeshletDrawList& list)
+{
+	list.counts.clear();
+	list.offsets.clear();
+	list.culledTriangles = 0;
+
+	// Gribb/Hartmann: planes are sums and differences of the matrix rows
+	glm::vec4 planes[6];
+	glm::mat4 rows = glm::transpose(modelViewProjection);
+	for (int i = 0; i < 3; i++) {
+		planes[i * 2 + 0] = rows[3] + rows[i];
+		planes[i * 2 + 1] = rows[3] - rows[i];
+	}
+	for (glm::vec4& plane : planes)
+		plane /= glm::length(glm::vec3(plane));
+
+	size_t runEnd = ~size_t(0);
+	for (const Meshlet& meshlet : meshlets) {
+		glm::vec3 center(meshlet.center[0], meshlet.center[1], meshlet.center[2]);
+		glm::vec3 axis(meshlet.coneAxis[0], meshlet.coneAxis[1], meshlet.coneAxis[2]);
+
+		bool visible = true;
+		for (const glm::vec4& plane : planes) {
+			if (glm::dot(glm::vec3(plane), center) + plane.w < -meshlet.radius) {
+				visible = false;
+				break;
+			}
+		}
+		// Every triangle faces away if the camera is behind the whole cone,
+		// widened by the bounding sphere
+		glm::vec3 view = center - cameraPosition;
+		if (visible && glm::dot(view, axis) >= meshlet.coneCutoff * glm::length(view) + meshlet.radius)
+			visible = false;
+
+		if (!visible) {
+			list.culledTriangles += meshlet.indexCount / 3;
+			continue;
+		}
+		if (meshlet.indexOffset == runEnd) {
+			list.counts.back() += meshlet.indexCount;
+		} else {
+			list.counts.push_back(meshlet.indexCount);
+			list.offsets.push_back(reinterpret_cast<const void*>(size_t(meshlet.indexOffset) * indexSize));
+		}
+		runEnd = meshlet.indexOffset + meshlet.indexCount;
+	}
+}
+
+inline void reportMeshlets(const string& name, const vector<Meshlet>& meshlets)
+{
+	size_t coned = 0, triangles = 0;
+	for (const Meshlet& meshlet : meshlets) {
+		coned += meshlet.coneCutoff < 1.0f;
+		triangles += meshlet.indexCount / 3;
+	}
+	cout << name << ": " << meshlets.size() << " meshlets, " << (meshlets.empty() ? 0 : triangles / meshlets.size())
+		<< " triangles each on average, " << coned << " with a usable normal cone" << endl;
+}
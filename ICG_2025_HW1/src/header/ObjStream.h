@@ -0,0 +1,581 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <filesystem>
+#include <glm/glm.hpp>
+#include <fast_number.h>
+
+#include "VertexFormat.h"
+#include "MeshFile.h"
+
+using namespace std;
+
+// Streaming OBJ ingestion: turns an OBJ of any size into a .meshbin while
+// holding only a fixed working set, instead of the whole text, tinyobj's
+// shapes and the expanded per-corner arrays.
+//
+// The file is read twice in fixed-size chunks. The first pass spills the
+// `v`/`vt`/`vn` values to temporary files (ObjValuePool) and keeps their
+// bounds, which fix the quantization range. The second pass welds face
+// corners by their (v, vt, vn) indices in a fixed-size hash table, looks the
+// values up through a small page cache over the spill files and writes packed
+// vertices and indices out in bounded batches. When the table fills up it
+// starts over, which can duplicate a vertex but never changes the mesh.
+// Nothing in memory grows with the input.
+//
+// The budget is split between the read chunk (1/8), the vertex batch (1/8),
+// the index batch (1/8), the value pools (1/4) and the weld table (3/8).
+// Streamed meshes are not reordered, simplified or split into meshlets,
+// since those need the whole mesh in memory; SEPARATE is written as
+// INTERLEAVED.
+
+const size_t OBJ_STREAM_MIN_BUDGET = size_t(1) << 20;
+
+struct ObjStreamStats
+{
+	size_t bytesRead = 0;    // both passes
+	size_t faces = 0;
+	size_t vertices = 0;
+	size_t indices = 0;
+	size_t batches = 0;      // vertex and index batches written
+	size_t weldResets = 0;   // times the weld table filled up
+	size_t workingBytes = 0; // chunk, batches, value pools and weld table
+	size_t sourceBytes = 0;  // v/vt/vn values spilled to disk
+	size_t poolReads = 0;    // value pages read back from the spill files
+};
+
+// Hands out the complete lines of a file, reading it `chunkSize` bytes at a
+// time. A line longer than the chunk grows the buffer to fit it.
+class ObjChunkReader
+{
+public:
+	explicit ObjChunkReader(size_t chunkSize)
+		: buffer(chunkSize)
+	{
+	}
+
+	ObjChunkReader(const ObjChunkReader&) = delete;
+	ObjChunkReader& operator=(const ObjChunkReader&) = delete;
+	~ObjChunkReader() { close(); }
+
+	bool open(const string& path)
+	{
+		close();
+		file = fopen(path.c_str(), "rb");
+		begin = fill = 0;
+		eof = false;
+		bytes = 0;
+		hash = 1469598103934665603ull;
+		return file != nullptr;
+	}
+
+	void close()
+	{
+		if (file)
+			fclose(file);
+		file = nullptr;
+	}
+
+	// Next line without its line break; false at the end of the file
+	bool nextLine(const char*& lineBegin, const char*& lineEnd)
+	{
+		for (;;) {
+			const char* data = buffer.data();
+			const char* newline = fastnum::findByte(data + begin, data + fill, '\n');
+			if (newline != data + fill || (eof && begin < fill)) {
+				lineBegin = data + begin;
+				lineEnd = newline;
+				begin = size_t(newline - data) + (newline != data + fill ? 1 : 0);
+				if (lineEnd > lineBegin && lineEnd[-1] == '\r')
+					lineEnd--;
+				return true;
+			}
+			if (eof)
+				return false;
+
+			// Keep the partial line and read behind it
+			memmove(buffer.data(), buffer.data() + begin, fill - begin);
+			fill -= begin;
+			begin = 0;
+			if (fill == buffer.size())
+				buffer.resize(buffer.size() * 2);
+			size_t got = fread(buffer.data() + fill, 1, buffer.size() - fill, file);
+			hash = hashBytes(buffer.data() + fill, got, hash);
+			bytes += got;
+			fill += got;
+			if (got == 0)
+				eof = true;
+		}
+	}
+
+	size_t capacity() const { return buffer.size(); }
+	size_t bytesRead() const { return bytes; }
+	uint64_t contentHash() const { return hash; } // hashBytes() of everything read
+
+private:
+	vector<char> buffer;
+	FILE* file = nullptr;
+	size_t begin = 0;
+	size_t fill = 0;
+	bool eof = false;
+	size_t bytes = 0;
+	uint64_t hash = 1469598103934665603ull;
+};
+
+// One kind of OBJ value (v, vt or vn, `width` floats each), spilled to a
+// temporary file during the first pass and read back by number in the
+// second. Reads go through a direct-mapped cache of pages; faces mostly
+// use values defined shortly before them, so most lookups hit.
+class ObjValuePool
+{
+public:
+	static constexpr size_t PAGE_VALUES = 1024;
+
+	explicit ObjValuePool(size_t width)
+		: width(width)
+	{
+	}
+
+	ObjValuePool(const ObjValuePool&) = delete;
+	ObjValuePool& operator=(const ObjValuePool&) = delete;
+	~ObjValuePool() { close(); }
+
+	// Start writing to a new file at `spillPath`, buffering `bufferBytes`
+	bool open(const string& spillPath, size_t bufferBytes)
+	{
+		close();
+		file.open(spillPath, ios::binary | ios::in | ios::out | ios::trunc);
+		if (!file.is_open())
+			return false;
+		path = spillPath;
+		count = 0;
+		pending.clear();
+		pending.reserve(max(width, bufferBytes / sizeof(float) / width * width));
+		return true;
+	}
+
+	void close()
+	{
+		if (file.is_open()) {
+			file.close();
+			remove(path.c_str());
+		}
+		vector<float>().swap(pending);
+		vector<float>().swap(pages);
+	}
+
+	// First pass: the next value
+	void append(const float* values)
+	{
+		pending.insert(pending.end(), values, values + width);
+		count++;
+		if (pending.size() == pending.capacity())
+			flush();
+	}
+
+	// Second pass: switch to reading, caching about `cacheBytes`. False if the
+	// values could not all be written.
+	bool startReading(size_t cacheBytes)
+	{
+		flush();
+		vector<float>().swap(pending);
+		file.flush();
+		if (!file)
+			return false;
+		size_t pageBytes = PAGE_VALUES * width * sizeof(float);
+		size_t slots = max<size_t>(1, cacheBytes / pageBytes);
+		pages.assign(slots * PAGE_VALUES * width, 0.0f);
+		tags.assign(slots, ~size_t(0));
+		return true;
+	}
+
+	// Value number `index`, valid until the next call; nullptr if there is
+	// none
+	const float* at(size_t index)
+	{
+		if (index >= count)
+			return nullptr;
+		size_t page = index / PAGE_VALUES;
+		size_t slot = page % tags.size();
+		float* data = &pages[slot * PAGE_VALUES * width];
+		if (tags[slot] != page) {
+			size_t values = min(PAGE_VALUES, count - page * PAGE_VALUES);
+			file.clear();
+			file.seekg(page * PAGE_VALUES * width * sizeof(float));
+			file.read(reinterpret_cast<char*>(data), values * width * sizeof(float));
+			if (!file) {
+				tags[slot] = ~size_t(0);
+				return nullptr;
+			}
+			tags[slot] = page;
+			pageReads++;
+		}
+		return data + index % PAGE_VALUES * width;
+	}
+
+	size_t size() const { return count; }
+	size_t spilledBytes() const { return count * width * sizeof(float); }
+	// Held in memory: the write buffer or the page cache
+	size_t bytes() const { return max(pending.capacity(), pages.size()) * sizeof(float); }
+	size_t reads() const { return pageReads; }
+
+private:
+	size_t width;
+	fstream file;
+	string path;
+	size_t count = 0;
+	vector<float> pending;
+	vector<float> pages;
+	vector<size_t> tags; // page held by each slot
+	size_t pageReads = 0;
+
+	void flush()
+	{
+		if (!pending.empty())
+			file.write(reinterpret_cast<const char*>(pending.data()), pending.size() * sizeof(float));
+		pending.clear();
+	}
+};
+
+// Fixed capacity open addressing map from a corner's (v, vt, vn) indices to
+// its vertex number. Cleared instead of grown.
+class CornerWeldTable
+{
+public:
+	explicit CornerWeldTable(size_t byteBudget)
+	{
+		size_t capacity = 1024;
+		while (capacity * 2 * sizeof(Entry) <= byteBudget)
+			capacity *= 2;
+		entries.resize(capacity);
+		clear();
+	}
+
+	// Vertex number of the corner, or ~0u after inserting it with `vertex`
+	unsigned int findOrInsert(const int key[3], unsigned int vertex)
+	{
+		size_t mask = entries.size() - 1;
+		uint64_t h = uint64_t(uint32_t(key[0])) * 0x9E3779B97F4A7C15ull
+			^ uint64_t(uint32_t(key[1])) * 0xC2B2AE3D27D4EB4Full ^ uint64_t(uint32_t(key[2])) * 0x165667B19E3779F9ull;
+		size_t i = size_t(h ^ (h >> 29)) & mask;
+		for (size_t probes = 0; probes < entries.size(); probes++, i = (i + 1) & mask) {
+			Entry& entry = entries[i];
+			if (entry.vertex == EMPTY) {
+				memcpy(entry.key, key, sizeof(entry.key));
+				entry.vertex = vertex;
+				used++;
+				return EMPTY;
+			}
+			if (memcmp(entry.key, key, sizeof(entry.key)) == 0)
+				return entry.vertex;
+		}
+		// No free slot: the corner becomes a new vertex, just not remembered
+		return EMPTY;
+	}
+
+	// Past 70% load probes get long; the caller clears before the next insert
+	bool full() const { return used * 10 >= entries.size() * 7; }
+
+	void clear()
+	{
+		for (Entry& entry : entries)
+			entry.vertex = EMPTY;
+		used = 0;
+	}
+
+	size_t bytes() const { return entries.size() * sizeof(Entry); }
+
+	static const unsigned int EMPTY = ~0u;
+
+private:
+	struct Entry
+	{
+		int key[3];
+		unsigned int vertex;
+	};
+	vector<Entry> entries;
+	size_t used = 0;
+};
+
+// Stream `objPath` into a .meshbin at `cachePath` (the format readMeshFile()
+// maps) in a working set of about `budget` bytes, whatever the input size.
+// Needs disk space next to `cachePath` for the values and indices.
+inline bool streamObjToMeshFile(const string& objPath, const string& cachePath, VERTEXLAYOUT layout,
+	size_t budget, uint32_t configKey, ObjStreamStats& stats)
+{
+	budget = max(budget, OBJ_STREAM_MIN_BUDGET);
+	stats = ObjStreamStats();
+	ObjChunkReader reader(budget / 8);
+
+	// Output: header and section table are written last, once the sizes are
+	// known. Vertices go straight to their final place; indices are spilled
+	// as 32-bit until the vertex count decides their type. The value pools
+	// remove their own files.
+	string tmpPath = cachePath + ".tmp";
+	string spillPath = cachePath + ".idx";
+	ofstream out;
+	fstream spill;
+	auto fail = [&](const string& message) {
+		if (!message.empty())
+			cerr << message << endl;
+		out.close();
+		spill.close();
+		remove(tmpPath.c_str());
+		remove(spillPath.c_str());
+		return false;
+	};
+
+	auto skipSpaces = [](const char* p, const char* end) {
+		while (p < end && (*p == ' ' || *p == '\t'))
+			p++;
+		return p;
+	};
+	auto readFloats = [&](const char* p, const char* end, float* values, int count) {
+		for (int k = 0; k < count; k++) {
+			values[k] = 0.0f;
+			p = fastnum::parseFloat(skipSpaces(p, end), end, values[k]);
+		}
+	};
+
+	// Pass 1: attribute values and their ranges. Positions and normals get
+	// 3/8 of the pool share each, texcoords the remaining 2/8.
+	size_t poolBudget = budget / 4;
+	ObjValuePool positions(3), texcoords(2), normals(3);
+	glm::vec3 minPos(0.0f), maxPos(0.0f);
+	bool uvInUnitRange = true;
+	if (!positions.open(cachePath + ".v.tmp", poolBudget * 3 / 8)
+		|| !texcoords.open(cachePath + ".vt.tmp", poolBudget * 2 / 8)
+		|| !normals.open(cachePath + ".vn.tmp", poolBudget * 3 / 8))
+		return fail("Failed to write mesh cache: " + cachePath);
+	if (!reader.open(objPath))
+		return fail("Failed to open OBJ file: " + objPath);
+	const char* line;
+	const char* end;
+	while (reader.nextLine(line, end)) {
+		line = skipSpaces(line, end);
+		if (end - line < 2 || line[0] != 'v')
+			continue;
+		float values[3];
+		if (line[1] == ' ' || line[1] == '\t') {
+			readFloats(line + 2, end, values, 3);
+			glm::vec3 p(values[0], values[1], values[2]);
+			minPos = positions.size() == 0 ? p : glm::min(minPos, p);
+			maxPos = positions.size() == 0 ? p : glm::max(maxPos, p);
+			positions.append(values);
+		} else if (line[1] == 't') {
+			readFloats(line + 2, end, values, 2);
+			uvInUnitRange = uvInUnitRange && values[0] >= 0.0f && values[0] <= 1.0f
+				&& values[1] >= 0.0f && values[1] <= 1.0f;
+			texcoords.append(values);
+		} else if (line[1] == 'n') {
+			readFloats(line + 2, end, values, 3);
+			normals.append(values);
+		}
+	}
+	uint64_t sourceHash = reader.contentHash();
+	stats.bytesRead = reader.bytesRead();
+	stats.sourceBytes = positions.spilledBytes() + texcoords.spilledBytes() + normals.spilledBytes();
+	size_t writeBuffers = positions.bytes() + texcoords.bytes() + normals.bytes();
+	if (!positions.startReading(poolBudget * 3 / 8) || !texcoords.startReading(poolBudget * 2 / 8)
+		|| !normals.startReading(poolBudget * 3 / 8))
+		return fail("Failed to spill OBJ values next to " + cachePath);
+
+	MeshBlob blob;
+	blob.format = interleavedFormat(layout, uvInUnitRange, minPos, maxPos);
+	glm::vec3 center = (minPos + maxPos) * 0.5f;
+	float radius2 = 0.0f;
+	for (size_t i = 0; i < positions.size(); i++) {
+		const float* p = positions.at(i);
+		if (!p)
+			break;
+		glm::vec3 d = glm::vec3(p[0], p[1], p[2]) - center;
+		radius2 = max(radius2, glm::dot(d, d));
+	}
+	blob.bounds = glm::vec4(center, sqrt(radius2));
+
+	const int SECTION_COUNT = 3;
+	size_t vertexOffset = alignSection(sizeof(MeshFileHeader) + sizeof(MeshFileSection) * SECTION_COUNT);
+	out.open(tmpPath, ios::binary | ios::trunc);
+	spill.open(spillPath, ios::binary | ios::in | ios::out | ios::trunc);
+	if (!out.is_open() || !spill.is_open())
+		return fail("Failed to write mesh cache: " + cachePath);
+	static const char zeros[16] = {};
+	out.seekp(vertexOffset);
+
+	unsigned int stride = blob.format.vertexSize;
+	vector<unsigned char> vertexBatch(max<size_t>(stride, budget / 8 / stride * stride));
+	vector<unsigned int> indexBatch(max<size_t>(3, budget / 8 / sizeof(unsigned int)));
+	size_t vertexFill = 0, indexFill = 0;
+	CornerWeldTable weld(budget * 3 / 8);
+	size_t poolBytes = max(writeBuffers, positions.bytes() + texcoords.bytes() + normals.bytes());
+	stats.workingBytes = reader.capacity() + vertexBatch.size() + indexBatch.size() * sizeof(unsigned int)
+		+ poolBytes + weld.bytes();
+
+	auto flushVertices = [&]() {
+		if (vertexFill) {
+			out.write(reinterpret_cast<const char*>(vertexBatch.data()), vertexFill);
+			stats.batches++;
+		}
+		vertexFill = 0;
+	};
+	auto flushIndices = [&]() {
+		if (indexFill) {
+			spill.write(reinterpret_cast<const char*>(indexBatch.data()), indexFill * sizeof(unsigned int));
+			stats.batches++;
+		}
+		indexFill = 0;
+	};
+
+	// OBJ indices are 1-based, or relative to the values read so far when negative
+	auto resolve = [](int index, size_t count) {
+		if (index > 0)
+			return index - 1;
+		if (index < 0)
+			return int(count) + index;
+		return -1;
+	};
+
+	// Pass 2: faces
+	const float defaultNormal[3] = { 0.0f, 1.0f, 0.0f };
+	const float defaultTexcoord[2] = { 0.0f, 0.0f };
+	const float zeroPosition[3] = { 0.0f, 0.0f, 0.0f };
+	size_t seenPositions = 0, seenTexcoords = 0, seenNormals = 0;
+	unsigned int vertexCount = 0;
+	vector<unsigned int> polygon;
+	if (!reader.open(objPath))
+		return fail("Failed to open OBJ file: " + objPath);
+	while (reader.nextLine(line, end)) {
+		line = skipSpaces(line, end);
+		if (end - line < 2)
+			continue;
+		if (line[0] == 'v') {
+			if (line[1] == ' ' || line[1] == '\t')
+				seenPositions++;
+			else if (line[1] == 't')
+				seenTexcoords++;
+			else if (line[1] == 'n')
+				seenNormals++;
+			continue;
+		}
+		if (line[0] != 'f' || (line[1] != ' ' && line[1] != '\t'))
+			continue;
+
+		polygon.clear();
+		const char* p = skipSpaces(line + 2, end);
+		while (p < end) {
+			int triplet[3];
+			const char* next = fastnum::parseIndexTriplet(p, end, triplet, 0);
+			if (next == p)
+				break;
+			p = skipSpaces(next, end);
+
+			// Cleared between corners, not faces, so one huge face cannot
+			// overfill the table; `polygon` keeps the numbers already handed
+			// out, the worst case is a duplicated vertex
+			if (weld.full()) {
+				weld.clear();
+				stats.weldResets++;
+			}
+			int key[3] = { resolve(triplet[0], seenPositions), resolve(triplet[1], seenTexcoords),
+				resolve(triplet[2], seenNormals) };
+			unsigned int vertex = weld.findOrInsert(key, vertexCount);
+			if (vertex == CornerWeldTable::EMPTY) {
+				vertex = vertexCount++;
+				const float* position = key[0] >= 0 ? positions.at(size_t(key[0])) : nullptr;
+				const float* texcoord = key[1] >= 0 ? texcoords.at(size_t(key[1])) : nullptr;
+				const float* normal = key[2] >= 0 ? normals.at(size_t(key[2])) : nullptr;
+				if (vertexFill + stride > vertexBatch.size())
+					flushVertices();
+				packVertex(blob.format, position ? position : zeroPosition, normal ? normal : defaultNormal,
+					texcoord ? texcoord : defaultTexcoord, vertexBatch.data() + vertexFill);
+				vertexFill += stride;
+			}
+			polygon.push_back(vertex);
+		}
+		if (polygon.size() < 3)
+			continue;
+		stats.faces++;
+
+		// Fan, like tinyobj and Object::loadOBJ
+		for (size_t k = 1; k + 1 < polygon.size(); k++) {
+			if (indexFill + 3 > indexBatch.size())
+				flushIndices();
+			indexBatch[indexFill++] = polygon[0];
+			indexBatch[indexFill++] = polygon[k];
+			indexBatch[indexFill++] = polygon[k + 1];
+			stats.indices += 3;
+		}
+		if (!spill)
+			return fail("Failed to spill mesh indices next to " + cachePath);
+	}
+	flushVertices();
+	flushIndices();
+	if (!out || !spill)
+		return fail("Failed to write mesh cache: " + cachePath);
+	stats.bytesRead += reader.bytesRead();
+	stats.vertices = vertexCount;
+	stats.poolReads = positions.reads() + texcoords.reads() + normals.reads();
+	reader.close();
+	positions.close();
+	texcoords.close();
+	normals.close();
+
+	// Indices: copy the spill across, narrowed to 16 bits when they fit
+	blob.vertexCount = vertexCount;
+	blob.vertexBytes = size_t(vertexCount) * stride;
+	blob.indexCount = stats.indices;
+	blob.indexType = vertexCount <= 0xFFFF ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+	size_t indexSize = blob.indexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+	blob.indexBytes = stats.indices * indexSize;
+	size_t indexOffset = alignSection(vertexOffset + blob.vertexBytes);
+	size_t boundsOffset = alignSection(indexOffset + blob.indexBytes);
+
+	out.write(zeros, indexOffset - (vertexOffset + blob.vertexBytes));
+	spill.seekg(0);
+	vector<unsigned short> narrow(indexBatch.size());
+	for (size_t done = 0; done < stats.indices;) {
+		size_t count = min(indexBatch.size(), stats.indices - done);
+		spill.read(reinterpret_cast<char*>(indexBatch.data()), count * sizeof(unsigned int));
+		if (blob.indexType == GL_UNSIGNED_SHORT) {
+			for (size_t i = 0; i < count; i++)
+				narrow[i] = static_cast<unsigned short>(indexBatch[i]);
+			out.write(reinterpret_cast<const char*>(narrow.data()), count * sizeof(unsigned short));
+		} else {
+			out.write(reinterpret_cast<const char*>(indexBatch.data()), count * sizeof(unsigned int));
+		}
+		done += count;
+	}
+	if (!spill || !out)
+		return fail("Failed to write mesh cache: " + cachePath);
+	spill.close();
+	remove(spillPath.c_str());
+	out.write(zeros, boundsOffset - (indexOffset + blob.indexBytes));
+	out.write(reinterpret_cast<const char*>(&blob.bounds[0]), sizeof(float) * 4);
+
+	SourceStamp stamp;
+	MeshFileHeader header;
+	if (!statSource(objPath, stamp) || !makeMeshFileHeader(blob, stamp, sourceHash, configKey, header))
+		return fail("");
+	header.sectionCount = SECTION_COUNT;
+	MeshFileSection sections[SECTION_COUNT] = {
+		{ MESH_SECTION_VERTICES, 0, vertexOffset, blob.vertexBytes },
+		{ MESH_SECTION_INDICES, 0, indexOffset, blob.indexBytes },
+		{ MESH_SECTION_BOUNDS, 0, boundsOffset, sizeof(float) * 4 },
+	};
+	out.seekp(0);
+	out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	out.write(reinterpret_cast<const char*>(sections), sizeof(sections));
+	out.close();
+	if (!out)
+		return fail("Failed to write mesh cache: " + cachePath);
+
+	error_code ec;
+	filesystem::rename(tmpPath, cachePath, ec);
+	return !ec;
+}
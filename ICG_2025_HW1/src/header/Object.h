@@ -1,10 +1,25 @@
+#pragma once
 #include <vector>
 #include <string>
+#include <numeric>
 #include <iostream>
+#include <algorithm>
 #include <glm/glm.hpp>
 #include <glad/glad.h>
 #include <tiny_obj_loader.h>
 
+#include "MeshData.h"
+#include "VertexFormat.h"
+#include "MeshFile.h"
+#include "MeshOptimize.h"
+#include "MeshLod.h"
+#include "Meshlet.h"
+#include "Material.h"
+#include "ObjStream.h"
+#include "MeshCodec.h"
+#include "Primitives.h"
+#include "GLState.h"
+
 using namespace std;
 
 enum class FACETYPE
@@ -13,35 +28,419 @@ enum class FACETYPE
 	QUAD
 };
 
+struct ObjectConfig
+{
+	// Weld identical (position, normal, uv) corners into unique vertices and
+	// draw through an element buffer instead of one vertex per corner.
+	bool indexed = true;
+	// How attributes are laid out and compressed in the vertex buffer.
+	VERTEXLAYOUT layout = VERTEXLAYOUT::QUANTIZED;
+	// Keep a <file>.meshbin next to the OBJ and upload from it on later runs.
+	bool binaryCache = true;
+	// Store the cached vertices and indices through MeshCodec.h; a cache hit
+	// decodes them into the mapped GPU buffers. Streamed caches stay raw.
+	bool compressCache = true;
+	// Tokenize the OBJ on all cores (tinyobj::LoadObjParallel).
+	bool parallelParse = true;
+	// Reorder welded triangles and vertices for the vertex cache, overdraw and
+	// fetch locality (MeshOptimize.h). Needs `indexed`.
+	bool optimize = true;
+	// Simplify into up to MAX_LOD_LEVELS levels of detail (MeshLod.h) that
+	// share the vertex buffer. Needs `indexed`.
+	bool lods = true;
+	// Split level 0 into meshlets (Meshlet.h) so drawCulled() can skip the
+	// clusters that are off screen or facing away. Needs `indexed`.
+	bool meshlets = true;
+	// Non-zero: ingest the OBJ with ObjStream.h through a working set of about
+	// this many bytes instead of parsing it whole. For files too big to hold
+	// in memory several times over; skips optimize, lods and meshlets.
+	size_t streamBudget = 0;
+
+	bool streamed() const { return indexed && streamBudget > 0; }
+
+	// Options that change the cached bytes; part of the cache validity check.
+	uint32_t cacheKey() const
+	{
+		if (streamed())
+			return 1u | static_cast<uint32_t>(layout) << 1 | 1u << 6;
+		return (indexed ? 1u : 0u) | static_cast<uint32_t>(layout) << 1
+			| (indexed && optimize ? 1u : 0u) << 3 | (indexed && lods ? 1u : 0u) << 4
+			| (indexed && meshlets ? 1u : 0u) << 5 | (compressCache ? 1u : 0u) << 7;
+	}
+};
+
+// CPU side result of Object::prepare(): the bytes to upload, either packed
+// from a freshly parsed OBJ or pointing into a mapped .meshbin.
+struct PreparedMesh
+{
+	MeshBlob blob;
+	MappedFile cacheFile;
+	vector<unsigned char> vertexStorage;
+	vector<unsigned char> indexStorage;
+	string report; // one line summary, printed once the mesh is resident
+};
+
 class Object
 {
 public:
 	vector<float> positions;
 	vector<float> normals;
 	vector<float> texcoords;
+	vector<unsigned int> indices;
 	FACETYPE faceType = FACETYPE::TRIANGLE;
 
-	void draw(){
-		glBindVertexArray(VAO);
-		glDrawArrays(GL_TRIANGLES, 0, vertex_cnt);
+	// Set as the dequantScale/dequantOffset uniforms of easy.vert before drawing
+	glm::vec3 dequantScale = glm::vec3(1.0f);
+	glm::vec3 dequantOffset = glm::vec3(0.0f);
+
+	size_t gpuBytes() const { return gpu_bytes; }
+
+	const ObjectConfig& configuration() const { return config; }
+
+	// False until the VAO exists, i.e. while AssetLoader is still working on it
+	bool resident() const { return VAO != 0; }
+
+	// Level 0 is the full mesh; there is always at least that one
+	int lodCount() const { return int(lod_levels.size()); }
+	size_t triangleCount(int lod = 0) const { return lod_levels.empty() ? 0 : lod_levels[lod].indexCount / 3; }
+
+	// Object space bounding sphere: center, radius
+	const glm::vec4& boundingSphere() const { return bounds; }
+
+	// Level to draw with this transform, starting from the level the same draw
+	// site used last time (see selectLod() in MeshLod.h)
+	int selectLod(const glm::mat4& modelView, const glm::mat4& projection, int viewportHeight, int current = 0) const {
+		if (lod_levels.size() <= 1)
+			return 0;
+		float distance = -(modelView * glm::vec4(glm::vec3(bounds), 1.0f)).z;
+		float scale = max(glm::length(glm::vec3(modelView[0])),
+			max(glm::length(glm::vec3(modelView[1])), glm::length(glm::vec3(modelView[2]))));
+		// Camera inside or right at the sphere: full detail
+		if (distance <= bounds.w * scale)
+			return 0;
+		float pixelsPerUnit = scale * projection[1][1] * 0.5f * float(viewportHeight) / distance;
+		return ::selectLod(lod_levels, pixelsPerUnit, current);
+	}
+
+	size_t meshletCount() const { return meshlet_list.size(); }
+
+	// Level 0 split by material, sorted by material; always at least one.
+	// Meshes with several submeshes have no meshlets and a single LOD level.
+	const vector<Submesh>& submeshes() const { return submesh_list; }
+	// What Submesh::material indexes
+	const vector<Material>& materials() const { return material_list; }
+
+	// Draw level 0 without the meshlets that are outside the frustum or
+	// facing away; returns how many triangles were skipped. Falls back to a
+	// plain draw() for meshes without meshlets.
+	size_t drawCulled(const glm::mat4& model, const glm::mat4& view, const glm::mat4& projection){
+		if (meshlet_list.empty()) {
+			draw(0);
+			return 0;
+		}
+		glm::mat4 modelView = view * model;
+		glm::vec3 camera = glm::vec3(glm::inverse(modelView)[3]);
+		size_t indexSize = index_type == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+		cullMeshlets(meshlet_list, projection * modelView, camera, indexSize, draw_list);
+		if (!draw_list.counts.empty()) {
+			glState().bindVertexArray(VAO);
+			glMultiDrawElements(GL_TRIANGLES, draw_list.counts.data(), index_type, draw_list.offsets.data(),
+				GLsizei(draw_list.counts.size()));
+		}
+		return draw_list.culledTriangles;
+	}
+
+	void drawSubmesh(int submesh){
+		const Submesh& range = submesh_list[submesh];
+		glState().bindVertexArray(VAO);
+		if (index_cnt > 0) {
+			size_t indexSize = index_type == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+			glDrawElements(GL_TRIANGLES, range.indexCount, index_type, (void*)(range.indexOffset * indexSize));
+		} else {
+			glDrawArrays(GL_TRIANGLES, range.indexOffset, range.indexCount);
+		}
+	}
+
+	void draw(int lod = 0){
+		const MeshLod& level = lod_levels[max(0, min(lod, lodCount() - 1))];
+		glState().bindVertexArray(VAO);
+		if (index_cnt > 0) {
+			size_t indexSize = index_type == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+			glDrawElements(GL_TRIANGLES, level.indexCount, index_type, (void*)(level.indexOffset * indexSize));
+		} else {
+			glDrawArrays(GL_TRIANGLES, 0, level.indexCount);
+		}
+	}
+
+	// Empty object, filled in later by prepare(), uploadBuffers() and
+	// createVertexArray(); see AssetLoader.
+	explicit Object(const ObjectConfig& config)
+		: config(config)
+	{
+	}
+
+	Object(const Object&) = delete;
+	Object& operator=(const Object&) = delete;
+
+	// Needs the context that drew the object (or one sharing with it) current
+	~Object()
+	{
+		if (VAO)
+			glState().deleteVertexArray(VAO);
+		if (VBO)
+			glState().deleteBuffer(VBO);
+		if (EBO)
+			glState().deleteBuffer(EBO);
+	}
+
+	// Synchronous load on the current context
+	Object(const string& filename, const ObjectConfig& config = ObjectConfig())
+		: Object(config)
+	{
+		PreparedMesh mesh;
+		if (!prepare(filename, mesh))
+			return;
+		if (!uploadBuffers(mesh.blob)) {
+			PreparedMesh rebuilt;
+			discardCache(mesh);
+			if (!prepare(filename, rebuilt) || !uploadBuffers(rebuilt.blob))
+				return;
+			mesh.report = rebuilt.report;
+		}
+		createVertexArray();
+		cout << mesh.report << endl;
 	}
 
-	Object(const string& filename)
+	// Built-in mesh from Primitives.h, e.g. Object("cube", primitiveCube()),
+	// uploaded on the current context. Nothing is read or cached: the mesh
+	// is only packed into the configured layout, and drawn as generated with
+	// a single level and no meshlets.
+	template <size_t V, size_t I>
+	Object(const string& name, const PrimitiveMesh<V, I>& primitive, const ObjectConfig& config = ObjectConfig())
+		: Object(config)
 	{
-		loadOBJ(filename);
-		set_VAO();
+		this->config.binaryCache = false;
+		positions.reserve(V * 3);
+		normals.reserve(V * 3);
+		texcoords.reserve(V * 2);
+		for (const PrimitiveVertex& vertex : primitive.vertices) {
+			positions.insert(positions.end(), vertex.position, vertex.position + 3);
+			normals.insert(normals.end(), vertex.normal, vertex.normal + 3);
+			texcoords.insert(texcoords.end(), vertex.texcoord, vertex.texcoord + 2);
+		}
+		indices.assign(primitive.indices, primitive.indices + I);
+		index_type = GL_UNSIGNED_SHORT;
+		PreparedMesh mesh;
+		pack(name, mesh);
+		uploadBuffers(mesh.blob);
+		createVertexArray();
+	}
+
+	// CPU half of loading, no GL calls: map the .meshbin cache, or parse,
+	// weld and pack the OBJ (and write the cache).
+	bool prepare(const string& filename, PreparedMesh& mesh) {
+		if (config.binaryCache && loadCache(filename, mesh)) {
+			mesh.report = filename + ": loaded from " + meshCachePath(filename) + ", "
+				+ to_string(mesh.blob.vertexBytes + mesh.blob.indexBytes) + " bytes on GPU";
+			if (mesh.blob.vertexEncodedBytes)
+				mesh.report += " from " + to_string(mesh.blob.vertexEncodedBytes + mesh.blob.indexEncodedBytes)
+					+ " compressed";
+			return true;
+		}
+
+		if (config.streamed())
+			return prepareStreamed(filename, mesh);
+
+		if (!loadOBJ(filename))
+			return false;
+		if (config.indexed)
+			buildIndexed(filename);
+		pack(filename, mesh);
+		mesh.report = filename + ": " + layoutName(config.layout) + " layout, "
+			+ to_string(mesh.blob.format.vertexSize) + " B/vertex, "
+			+ to_string(mesh.blob.vertexBytes + mesh.blob.indexBytes) + " bytes on GPU";
+		return true;
+	}
+
+	// Create and fill the vertex and index buffers. Buffer objects are shared
+	// between contexts, so this may run on AssetLoader's upload context.
+	// False, with no buffers left behind, if a compressed cache does not
+	// decode; see discardCache().
+	bool uploadBuffers(const MeshBlob& blob){
+		glGenBuffers(1, &VBO);
+		glState().bindBuffer(GL_ARRAY_BUFFER, VBO);
+		if (blob.vertexEncodedBytes) {
+			size_t stride = blob.format.vertexSize;
+			if (!decodeIntoBuffer(blob.vertexBytes, [&](void* dst) {
+				return decodeVertexBuffer(dst, blob.vertexCount, stride, blob.vertexData, blob.vertexEncodedBytes);
+			})) {
+				cerr << "Corrupt compressed vertices in mesh cache" << endl;
+				return discardBuffers();
+			}
+		} else {
+			glBufferData(GL_ARRAY_BUFFER, blob.vertexBytes, blob.vertexData, GL_STATIC_DRAW);
+		}
+
+		// Filled through GL_ARRAY_BUFFER as well: the element binding is VAO
+		// state and there is no VAO yet.
+		if (blob.indexCount > 0) {
+			glGenBuffers(1, &EBO);
+			glState().bindBuffer(GL_ARRAY_BUFFER, EBO);
+			if (blob.indexEncodedBytes) {
+				size_t indexSize = blob.indexBytes / blob.indexCount;
+				if (!decodeIntoBuffer(blob.indexBytes, [&](void* dst) {
+					return decodeIndexBuffer(dst, blob.indexCount, indexSize, blob.indexData, blob.indexEncodedBytes);
+				})) {
+					cerr << "Corrupt compressed indices in mesh cache" << endl;
+					return discardBuffers();
+				}
+			} else {
+				glBufferData(GL_ARRAY_BUFFER, blob.indexBytes, blob.indexData, GL_STATIC_DRAW);
+			}
+		}
+		glState().bindBuffer(GL_ARRAY_BUFFER, 0);
+
+		attributes = blob.format.attributes;
+		dequantScale = blob.format.dequantScale;
+		dequantOffset = blob.format.dequantOffset;
+		vertex_cnt = blob.vertexCount;
+		index_cnt = blob.indexCount;
+		index_type = blob.indexType;
+		gpu_bytes = blob.vertexBytes + blob.indexBytes;
+		vertex_size = blob.format.vertexSize;
+		bounds = blob.bounds;
+		lod_levels = blob.lods;
+		meshlet_list = blob.meshlets;
+		if (lod_levels.empty())
+			lod_levels.push_back({ 0, static_cast<uint32_t>(index_cnt > 0 ? index_cnt : vertex_cnt), 0.0f, 0 });
+		submesh_list = blob.submeshes;
+		material_list = blob.materials;
+		if (submesh_list.empty())
+			submesh_list.push_back({ 0, lod_levels[0].indexCount, -1, 0 });
+		return true;
+	}
+
+	// Delete the cache `mesh` was mapped from, once uploadBuffers() has found
+	// it corrupt, so that prepare() parses the OBJ and writes a new one.
+	static void discardCache(PreparedMesh& mesh){
+		string path = mesh.cacheFile.path();
+		mesh.cacheFile.close();
+		mesh.blob = MeshBlob();
+		if (!path.empty() && remove(path.c_str()) == 0)
+			cerr << "Removed corrupt mesh cache " << path << ", rebuilding it" << endl;
+	}
+
+	// VAOs are not shared between contexts, so this runs on the context that
+	// draws, once the buffers from uploadBuffers() are complete.
+	void createVertexArray(){
+		unsigned int vao;
+		glGenVertexArrays(1, &vao);
+		glState().bindVertexArray(vao);
+
+		// Element buffer binding is recorded in the VAO
+		if (EBO)
+			glState().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+
+		// All attributes live in one buffer, described by the packed format
+		glState().bindBuffer(GL_ARRAY_BUFFER, VBO);
+		for (const VertexAttribute& attr : attributes) {
+			glVertexAttribPointer(attr.location, attr.size, attr.type, attr.normalized, attr.stride, (void*)attr.offset);
+			glEnableVertexAttribArray(attr.location);
+		}
+
+		glState().bindVertexArray(0);
+		glState().bindBuffer(GL_ARRAY_BUFFER, 0);
+		VAO = vao;
+	}
+
+	// Trade everything that is drawn, GL objects included, with `other`. A
+	// reload builds the new mesh in a separate Object and swaps it into the
+	// one every handle points at; the old buffers leave with `other`.
+	void swapContents(Object& other){
+		std::swap(faceType, other.faceType);
+		std::swap(dequantScale, other.dequantScale);
+		std::swap(dequantOffset, other.dequantOffset);
+		std::swap(VAO, other.VAO);
+		std::swap(VBO, other.VBO);
+		std::swap(EBO, other.EBO);
+		attributes.swap(other.attributes);
+		std::swap(vertex_cnt, other.vertex_cnt);
+		std::swap(index_cnt, other.index_cnt);
+		std::swap(index_type, other.index_type);
+		std::swap(gpu_bytes, other.gpu_bytes);
+		std::swap(vertex_size, other.vertex_size);
+		std::swap(bounds, other.bounds);
+		lod_levels.swap(other.lod_levels);
+		meshlet_list.swap(other.meshlet_list);
+		submesh_list.swap(other.submesh_list);
+		material_list.swap(other.material_list);
 	}
 
 private:
-	unsigned int VAO;
-	int vertex_cnt;
+	ObjectConfig config;
+	unsigned int VAO = 0;
+	unsigned int VBO = 0;
+	unsigned int EBO = 0;
+	vector<VertexAttribute> attributes;
+	int vertex_cnt = 0;
+	int index_cnt = 0;
+	GLenum index_type = GL_UNSIGNED_INT;
+	size_t gpu_bytes = 0;
+	unsigned int vertex_size = 0;
+	glm::vec4 bounds = glm::vec4(0.0f);
+	vector<MeshLod> lod_levels;
+	vector<Meshlet> meshlet_list;
+	MeshletDrawList draw_list;
+	vector<Submesh> submesh_list;
+	vector<Material> material_list;
+
+	// Weld, then optionally reorder, split into meshlets and build the LOD
+	// chain (meshlets first, they reorder level 0). Welding keeps the corner
+	// order, so submesh ranges stay valid; meshlets and LODs would mix
+	// materials and are skipped for meshes with several submeshes.
+	void buildIndexed(const string& filename) {
+		MeshData mesh;
+		mesh.positions.swap(positions);
+		mesh.normals.swap(normals);
+		mesh.texcoords.swap(texcoords);
+		size_t corners = mesh.vertexCount();
+
+		weldMesh(mesh);
+		reportWeldSavings(filename, corners, mesh);
+		if (config.optimize)
+			optimizeMesh(filename, mesh, submesh_list);
+		bool split = submesh_list.size() > 1;
+		if (split && (config.meshlets || config.lods))
+			cout << filename << ": " << submesh_list.size() << " submeshes, no meshlets or LODs" << endl;
+		if (config.meshlets && !split) {
+			meshlet_list = buildMeshlets(mesh.indices, mesh.positions);
+			reportMeshlets(filename, meshlet_list);
+		}
+		if (config.lods && !split)
+			lod_levels = buildLodChain(filename, mesh, config.optimize);
 
-	void loadOBJ(const string& filename) {
+		index_type = mesh.indexType();
+		positions.swap(mesh.positions);
+		normals.swap(mesh.normals);
+		texcoords.swap(mesh.texcoords);
+		indices.swap(mesh.indices);
+	}
+
+public:
+	// Parse the OBJ with tinyobj into per-corner positions, normals and
+	// texcoords, three corners per triangle. Triangles are grouped by
+	// material into submeshes; the materials come from the .mtl next to the
+	// OBJ. CPU only; mesh_bench times it.
+	bool loadOBJ(const string& filename) {
 		vector<tinyobj::shape_t> shapes;
 		vector<tinyobj::material_t> materials;
 		string err;
+		size_t slash = filename.find_last_of("/\\");
+		string basePath = slash == string::npos ? string() : filename.substr(0, slash + 1);
 
-		bool ret = tinyobj::LoadObj(shapes, materials, err, filename.c_str());
+		bool ret = config.parallelParse
+			? tinyobj::LoadObjParallel(shapes, materials, err, filename.c_str(), basePath.c_str())
+			: tinyobj::LoadObj(shapes, materials, err, filename.c_str(), basePath.c_str());
 
 		if (!err.empty()) {
 			cerr << "Error loading OBJ: " << err << endl;
@@ -49,184 +448,209 @@ private:
 
 		if (!ret) {
 			cerr << "Failed to load OBJ file: " << filename << endl;
-			return;
+			return false;
 		}
 
+		// Material of every triangle emitted below
+		vector<int> triangleMaterials;
+
 		// Process all shapes
 		for (const auto& shape : shapes) {
 			const tinyobj::mesh_t& mesh = shape.mesh;
-			
-			// Check if we have quads by examining face vertex counts
-			for (size_t i = 0; i < mesh.num_vertices.size(); i++) {
-				if (mesh.num_vertices[i] == 4) {
-					faceType = FACETYPE::QUAD;
-					break;
-				}
-			}
 
-			// Process faces
+			auto emitCorner = [&](unsigned int idx) {
+				// Positions
+				if (idx * 3 + 2 < mesh.positions.size())
+					positions.insert(positions.end(), &mesh.positions[idx * 3], &mesh.positions[idx * 3] + 3);
+				else
+					positions.insert(positions.end(), { 0.0f, 0.0f, 0.0f });
+
+				// Texture coordinates
+				if (idx * 2 + 1 < mesh.texcoords.size())
+					texcoords.insert(texcoords.end(), &mesh.texcoords[idx * 2], &mesh.texcoords[idx * 2] + 2);
+				else
+					texcoords.insert(texcoords.end(), { 0.0f, 0.0f });
+
+				// Normals
+				if (idx * 3 + 2 < mesh.normals.size())
+					normals.insert(normals.end(), &mesh.normals[idx * 3], &mesh.normals[idx * 3] + 3);
+				else
+					normals.insert(normals.end(), { 0.0f, 1.0f, 0.0f });
+			};
+
+			// Process faces; quads become triangles 0, 1, 2 and 0, 2, 3
 			size_t index_offset = 0;
 			for (size_t f = 0; f < mesh.num_vertices.size(); f++) {
 				int fv = mesh.num_vertices[f];
-				
-				if (fv == 3) {
-					// Triangle
-					for (size_t v = 0; v < 3; v++) {
-						unsigned int idx = mesh.indices[index_offset + v];
-						
-						// Positions
-						if (idx * 3 + 2 < mesh.positions.size()) {
-							positions.push_back(mesh.positions[idx * 3 + 0]);
-							positions.push_back(mesh.positions[idx * 3 + 1]);
-							positions.push_back(mesh.positions[idx * 3 + 2]);
-						} else {
-							positions.push_back(0.0f);
-							positions.push_back(0.0f);
-							positions.push_back(0.0f);
-						}
-
-						// Texture coordinates
-						if (!mesh.texcoords.empty() && idx * 2 + 1 < mesh.texcoords.size()) {
-							texcoords.push_back(mesh.texcoords[idx * 2 + 0]);
-							texcoords.push_back(mesh.texcoords[idx * 2 + 1]);
-						} else {
-							texcoords.push_back(0.0f);
-							texcoords.push_back(0.0f);
-						}
-
-						// Normals
-						if (!mesh.normals.empty() && idx * 3 + 2 < mesh.normals.size()) {
-							normals.push_back(mesh.normals[idx * 3 + 0]);
-							normals.push_back(mesh.normals[idx * 3 + 1]);
-							normals.push_back(mesh.normals[idx * 3 + 2]);
-						} else {
-							normals.push_back(0.0f);
-							normals.push_back(1.0f);
-							normals.push_back(0.0f);
-						}
-					}
-				} else if (fv == 4) {
-					// Quad - convert to two triangles
-					vector<unsigned int> quad_indices;
-					for (size_t v = 0; v < 4; v++) {
-						quad_indices.push_back(mesh.indices[index_offset + v]);
-					}
-
-					// First triangle: 0, 1, 2
-					for (int i : {0, 1, 2}) {
-						unsigned int idx = quad_indices[i];
-						
-						// Positions
-						if (idx * 3 + 2 < mesh.positions.size()) {
-							positions.push_back(mesh.positions[idx * 3 + 0]);
-							positions.push_back(mesh.positions[idx * 3 + 1]);
-							positions.push_back(mesh.positions[idx * 3 + 2]);
-						} else {
-							positions.push_back(0.0f);
-							positions.push_back(0.0f);
-							positions.push_back(0.0f);
-						}
-
-						// Texture coordinates
-						if (!mesh.texcoords.empty() && idx * 2 + 1 < mesh.texcoords.size()) {
-							texcoords.push_back(mesh.texcoords[idx * 2 + 0]);
-							texcoords.push_back(mesh.texcoords[idx * 2 + 1]);
-						} else {
-							texcoords.push_back(0.0f);
-							texcoords.push_back(0.0f);
-						}
-
-						// Normals
-						if (!mesh.normals.empty() && idx * 3 + 2 < mesh.normals.size()) {
-							normals.push_back(mesh.normals[idx * 3 + 0]);
-							normals.push_back(mesh.normals[idx * 3 + 1]);
-							normals.push_back(mesh.normals[idx * 3 + 2]);
-						} else {
-							normals.push_back(0.0f);
-							normals.push_back(1.0f);
-							normals.push_back(0.0f);
-						}
-					}
-
-					// Second triangle: 0, 2, 3
-					for (int i : {0, 2, 3}) {
-						unsigned int idx = quad_indices[i];
-						
-						// Positions
-						if (idx * 3 + 2 < mesh.positions.size()) {
-							positions.push_back(mesh.positions[idx * 3 + 0]);
-							positions.push_back(mesh.positions[idx * 3 + 1]);
-							positions.push_back(mesh.positions[idx * 3 + 2]);
-						} else {
-							positions.push_back(0.0f);
-							positions.push_back(0.0f);
-							positions.push_back(0.0f);
-						}
-
-						// Texture coordinates
-						if (!mesh.texcoords.empty() && idx * 2 + 1 < mesh.texcoords.size()) {
-							texcoords.push_back(mesh.texcoords[idx * 2 + 0]);
-							texcoords.push_back(mesh.texcoords[idx * 2 + 1]);
-						} else {
-							texcoords.push_back(0.0f);
-							texcoords.push_back(0.0f);
-						}
-
-						// Normals
-						if (!mesh.normals.empty() && idx * 3 + 2 < mesh.normals.size()) {
-							normals.push_back(mesh.normals[idx * 3 + 0]);
-							normals.push_back(mesh.normals[idx * 3 + 1]);
-							normals.push_back(mesh.normals[idx * 3 + 2]);
-						} else {
-							normals.push_back(0.0f);
-							normals.push_back(1.0f);
-							normals.push_back(0.0f);
-						}
-					}
+				int material = f < mesh.material_ids.size() ? mesh.material_ids[f] : -1;
+				if (material >= int(materials.size()))
+					material = -1;
+
+				if (fv == 3 || fv == 4) {
+					for (int v : { 0, 1, 2 })
+						emitCorner(mesh.indices[index_offset + v]);
+					triangleMaterials.push_back(material);
 				}
-				
+				if (fv == 4) {
+					faceType = FACETYPE::QUAD;
+					for (int v : { 0, 2, 3 })
+						emitCorner(mesh.indices[index_offset + v]);
+					triangleMaterials.push_back(material);
+				}
+
 				index_offset += fv;
 			}
 		}
+
+		groupByMaterial(triangleMaterials, materials);
+		return true;
 	}
 
-	void set_VAO(){
-		unsigned int VBO[3];
-		glGenVertexArrays(1, &VAO);
-		glBindVertexArray(VAO);
-		glGenBuffers(3, VBO);
+private:
+	// Stream the OBJ into a .meshbin and map that. Without binaryCache the
+	// file is only a staging area and is removed once mapped.
+	bool prepareStreamed(const string& filename, PreparedMesh& mesh) {
+		string target = meshCachePath(filename) + (config.binaryCache ? "" : ".stream");
+		ObjStreamStats stats;
+		if (!streamObjToMeshFile(filename, target, config.layout, config.streamBudget, config.cacheKey(), stats))
+			return false;
+		bool mapped = mesh.cacheFile.open(target) && readMeshFile(mesh.cacheFile, filename, config.cacheKey(), mesh.blob);
+		if (!config.binaryCache)
+			remove(target.c_str());
+		if (!mapped)
+			return false;
+
+		mesh.report = filename + ": streamed " + to_string(stats.faces) + " faces in " + to_string(stats.batches)
+			+ " batches, " + to_string(stats.vertices) + " vertices (" + to_string(stats.weldResets)
+			+ " weld resets), working set " + to_string(stats.workingBytes >> 10) + " KB + "
+			+ to_string(stats.sourceBytes >> 10) + " KB of OBJ values spilled, "
+			+ to_string(mesh.blob.vertexBytes + mesh.blob.indexBytes) + " bytes on GPU";
+		return true;
+	}
 
-		// Positions
-		if (!positions.empty()) {
-			glBindBuffer(GL_ARRAY_BUFFER, VBO[0]);
-			glBufferData(GL_ARRAY_BUFFER, sizeof(GL_FLOAT) * positions.size(), positions.data(), GL_STATIC_DRAW);
-			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GL_FLOAT), (void*)0);
-			glEnableVertexAttribArray(0);
+	// Stable sort the triangles by material and record the runs as submeshes
+	void groupByMaterial(const vector<int>& triangleMaterials, const vector<tinyobj::material_t>& materials) {
+		material_list.clear();
+		for (const tinyobj::material_t& material : materials)
+			material_list.push_back(objMaterial(material));
+
+		size_t triangleCount = triangleMaterials.size();
+		vector<unsigned int> order(triangleCount);
+		iota(order.begin(), order.end(), 0u);
+		if (!is_sorted(triangleMaterials.begin(), triangleMaterials.end())) {
+			stable_sort(order.begin(), order.end(),
+				[&](unsigned int a, unsigned int b) { return triangleMaterials[a] < triangleMaterials[b]; });
+			auto permute = [&](vector<float>& values, size_t width) {
+				vector<float> sorted(values.size());
+				for (size_t i = 0; i < triangleCount; i++)
+					copy_n(&values[order[i] * width * 3], width * 3, &sorted[i * width * 3]);
+				values.swap(sorted);
+			};
+			permute(positions, 3);
+			permute(normals, 3);
+			permute(texcoords, 2);
 		}
 
-		// Normals
-		if (!normals.empty()) {
-			glBindBuffer(GL_ARRAY_BUFFER, VBO[1]);
-			glBufferData(GL_ARRAY_BUFFER, sizeof(GL_FLOAT) * normals.size(), normals.data(), GL_STATIC_DRAW);
-			glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GL_FLOAT), (void*)0);
-			glEnableVertexAttribArray(1);
+		submesh_list.clear();
+		for (size_t i = 0; i < triangleCount; i++) {
+			int material = triangleMaterials[order[i]];
+			if (submesh_list.empty() || submesh_list.back().material != material)
+				submesh_list.push_back({ static_cast<uint32_t>(i * 3), 0, material, 0 });
+			submesh_list.back().indexCount += 3;
 		}
+	}
 
-		// Texture coordinates
-		if (!texcoords.empty()) {
-			glBindBuffer(GL_ARRAY_BUFFER, VBO[2]);
-			glBufferData(GL_ARRAY_BUFFER, sizeof(GL_FLOAT) * texcoords.size(), texcoords.data(), GL_STATIC_DRAW);
-			glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GL_FLOAT), (void*)0);
-			glEnableVertexAttribArray(2);
+	// Allocate `bytes` for the buffer bound to GL_ARRAY_BUFFER and let
+	// `decode(dst)` write them into its mapping, without a staging copy. If
+	// the driver cannot map, or loses the mapping, decode on the CPU instead.
+	template <class Decode>
+	static bool decodeIntoBuffer(size_t bytes, Decode&& decode) {
+		glBufferData(GL_ARRAY_BUFFER, bytes, nullptr, GL_STATIC_DRAW);
+		void* mapped = glMapBufferRange(GL_ARRAY_BUFFER, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+		if (mapped) {
+			bool decoded = decode(mapped);
+			if (glUnmapBuffer(GL_ARRAY_BUFFER) == GL_TRUE || !decoded)
+				return decoded;
 		}
+		vector<unsigned char> staging(bytes);
+		if (!decode(staging.data()))
+			return false;
+		glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, staging.data());
+		return true;
+	}
 
-		glBindVertexArray(0);
+	// uploadBuffers() failing halfway
+	bool discardBuffers() {
+		glState().bindBuffer(GL_ARRAY_BUFFER, 0);
+		if (VBO)
+			glState().deleteBuffer(VBO);
+		if (EBO)
+			glState().deleteBuffer(EBO);
+		VBO = EBO = 0;
+		return false;
+	}
 
-		vertex_cnt = positions.size() / 3;
-		
-		// Clear vectors to save memory after uploading to GPU
-		positions.clear();
-		texcoords.clear();
-		normals.clear();
+	bool loadCache(const string& filename, PreparedMesh& mesh) {
+		if (!mesh.cacheFile.open(meshCachePath(filename)))
+			return false;
+		return readMeshFile(mesh.cacheFile, filename, config.cacheKey(), mesh.blob);
 	}
-};
+
+	void pack(const string& filename, PreparedMesh& out){
+		MeshData mesh;
+		mesh.positions.swap(positions);
+		mesh.normals.swap(normals);
+		mesh.texcoords.swap(texcoords);
+		out.blob.bounds = computeBoundingSphere(mesh.positions);
+		out.blob.lods.swap(lod_levels);
+		out.blob.meshlets.swap(meshlet_list);
+		out.blob.submeshes.swap(submesh_list);
+		out.blob.materials.swap(material_list);
+		PackedVertices packed = packVertices(mesh, config.layout);
+		out.vertexStorage.swap(packed.bytes);
+
+		MeshBlob& blob = out.blob;
+		blob.format = packed.format;
+		blob.vertexCount = mesh.vertexCount();
+		blob.vertexData = out.vertexStorage.data();
+		blob.vertexBytes = out.vertexStorage.size();
+		blob.indexCount = indices.size();
+		blob.indexType = index_type;
+
+		if (index_type == GL_UNSIGNED_SHORT) {
+			blob.indexBytes = sizeof(unsigned short) * indices.size();
+			out.indexStorage.resize(blob.indexBytes);
+			unsigned short* dst = reinterpret_cast<unsigned short*>(out.indexStorage.data());
+			for (size_t i = 0; i < indices.size(); i++)
+				dst[i] = static_cast<unsigned short>(indices[i]);
+		} else {
+			blob.indexBytes = sizeof(unsigned int) * indices.size();
+			out.indexStorage.resize(blob.indexBytes);
+			memcpy(out.indexStorage.data(), indices.data(), blob.indexBytes);
+		}
+		blob.indexData = out.indexStorage.data();
+
+		if (config.binaryCache) {
+			// The upload below still takes the raw bytes; only the file is compressed
+			MeshBlob cached = blob;
+			vector<unsigned char> encodedVertices, encodedIndices;
+			if (config.compressCache && blob.format.vertexSize <= MESH_CODEC_MAX_STRIDE) {
+				encodedVertices = encodeVertexBuffer(blob.vertexData, blob.vertexCount, blob.format.vertexSize);
+				cached.vertexData = encodedVertices.data();
+				cached.vertexEncodedBytes = encodedVertices.size();
+				if (blob.indexCount > 0) {
+					encodedIndices = encodeIndexBuffer(blob.indexData, blob.indexCount, blob.indexBytes / blob.indexCount);
+					cached.indexData = encodedIndices.data();
+					cached.indexEncodedBytes = encodedIndices.size();
+				}
+			}
+			SourceStamp stamp;
+			if (!statSource(filename, stamp)
+				|| !writeMeshFile(meshCachePath(filename), cached, stamp, hashFile(filename), config.cacheKey()))
+				cerr << "Failed to write mesh cache: " << meshCachePath(filename) << endl;
+		}
+
+		// Clear vectors to save memory; the packed copy is all the GPU needs
+		indices.clear();
+	}
+};
\ No newline at end of file
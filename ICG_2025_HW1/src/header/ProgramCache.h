@@ -0,0 +1,161 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <fstream>
+#include <filesystem>
+#include <glad/glad.h>
+
+#include "GLState.h"
+
+using namespace std;
+
+// Linked shader programs saved through glGetProgramBinary, so later starts
+// skip compiling and linking.
+//
+// One file per program, next to its first stage and named after all of
+// them, e.g. shaders/easy.vert+easy.frag.progbin: a ProgramCacheHeader and
+// the driver's binary. Variants with defines add a name before the
+// extension. The key covers the source of every stage as handed to the
+// compiler, includes and defines included, plus GL_RENDERER and GL_VERSION,
+// so an edit, a driver update or a different GPU all miss. A driver may
+// still refuse a binary it wrote earlier; loadProgramBinary() then returns 0
+// and the caller compiles from source and saves a fresh one.
+
+const uint32_t PROGRAM_CACHE_VERSION = 1;
+const char PROGRAM_CACHE_MAGIC[8] = { 'I', 'C', 'G', 'P', 'R', 'O', 'G', '\0' };
+const char* const PROGRAM_CACHE_EXTENSION = ".progbin";
+
+struct ProgramCacheHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t binaryFormat; // from glGetProgramBinary
+	uint64_t key;          // programCacheKey()
+	uint64_t binarySize;
+};
+
+// FNV-1a, as hashBytes() in MeshFile.h; kept separate so Shader.h does not
+// pull in the mesh loaders
+inline uint64_t programCacheHash(const void* data, size_t size, uint64_t h = 1469598103934665603ull)
+{
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	for (size_t i = 0; i < size; i++) {
+		h ^= bytes[i];
+		h *= 1099511628211ull;
+	}
+	return h;
+}
+
+// Needs GL 4.1 or GL_ARB_get_program_binary, and at least one format
+inline bool programBinariesSupported()
+{
+	if (!glGetProgramBinary || !glProgramBinary)
+		return false;
+	GLint formats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	return formats > 0;
+}
+
+// Hash of the stage sources and the driver on the current context
+inline uint64_t programCacheKey(const vector<string>& sources)
+{
+	uint64_t key = programCacheHash(&PROGRAM_CACHE_VERSION, sizeof(PROGRAM_CACHE_VERSION));
+	for (const string& source : sources) {
+		uint64_t length = source.size();
+		key = programCacheHash(&length, sizeof(length), key);
+		key = programCacheHash(source.data(), source.size(), key);
+	}
+	for (GLenum name : { GL_RENDERER, GL_VERSION }) {
+		const char* value = reinterpret_cast<const char*>(glGetString(name));
+		if (value)
+			key = programCacheHash(value, strlen(value) + 1, key);
+	}
+	return key;
+}
+
+// `variant` tells apart programs built from the same files, e.g. with
+// different defines
+inline string programCachePath(const vector<string>& stagePaths, const string& variant = string())
+{
+	string name;
+	for (const string& path : stagePaths)
+		name += (name.empty() ? "" : "+") + filesystem::path(path).filename().string();
+	if (!variant.empty())
+		name += "." + variant;
+	return (filesystem::path(stagePaths.front()).parent_path() / (name + PROGRAM_CACHE_EXTENSION)).string();
+}
+
+// A linked program from `cachePath` if the file was saved under `key` and
+// the driver takes the binary; 0 otherwise
+inline unsigned int loadProgramBinary(const string& cachePath, uint64_t key)
+{
+	ifstream fs(cachePath, ios::binary | ios::ate);
+	if (!fs.is_open())
+		return 0;
+	size_t fileSize = size_t(fs.tellg());
+	ProgramCacheHeader header;
+	if (fileSize < sizeof(header))
+		return 0;
+	fs.seekg(0);
+	fs.read(reinterpret_cast<char*>(&header), sizeof(header));
+	if (!fs || memcmp(header.magic, PROGRAM_CACHE_MAGIC, sizeof(header.magic)) != 0
+		|| header.version != PROGRAM_CACHE_VERSION || header.key != key
+		|| header.binarySize != fileSize - sizeof(header))
+		return 0;
+	vector<char> binary(header.binarySize);
+	fs.read(binary.data(), binary.size());
+	if (!fs)
+		return 0;
+
+	unsigned int program = glCreateProgram();
+	glProgramBinary(program, header.binaryFormat, binary.data(), GLsizei(binary.size()));
+	GLint linked = 0;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	if (!linked) {
+		glState().deleteProgram(program);
+		return 0;
+	}
+	return program;
+}
+
+// Save `program`, linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT set, under
+// `key`. Written under a temporary name and renamed, like the mesh cache.
+inline bool saveProgramBinary(const string& cachePath, uint64_t key, unsigned int program)
+{
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+		return false;
+	vector<char> binary(length);
+	GLsizei written = 0;
+	GLenum format = 0;
+	glGetProgramBinary(program, length, &written, &format, binary.data());
+	if (written <= 0)
+		return false;
+
+	ProgramCacheHeader header;
+	memcpy(header.magic, PROGRAM_CACHE_MAGIC, sizeof(header.magic));
+	header.version = PROGRAM_CACHE_VERSION;
+	header.binaryFormat = format;
+	header.key = key;
+	header.binarySize = uint64_t(written);
+
+	string tmpPath = cachePath + ".tmp";
+	ofstream fs(tmpPath, ios::binary | ios::trunc);
+	if (!fs.is_open())
+		return false;
+	fs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	fs.write(binary.data(), written);
+	fs.close();
+	if (!fs) {
+		remove(tmpPath.c_str());
+		return false;
+	}
+
+	error_code ec;
+	filesystem::rename(tmpPath, cachePath, ec);
+	return !ec;
+}
@@ -1,3 +1,4 @@
+#pragma once
 /*  Usage:
 
     Shader ourShader("path/to/shaders/shader.vs", "path/to/shaders/shader.fs");
@@ -15,53 +16,487 @@
 #include <iostream>
 #include <stdexcept>
 #include <vector>
+#include <chrono>
+#include <cstdio>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <unordered_set>
 
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
+
+#include "ProgramCache.h"
+#include "ShaderPreprocessor.h"
+#include "FrameUniforms.h"
+#include "GLState.h"
 using namespace std;
+
+// 64-bit FNV-1a of a uniform name
+constexpr uint64_t uniform_name_hash(const char* name, size_t length){
+    uint64_t hash = 1469598103934665603ull;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= static_cast<unsigned char>(name[i]);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// Name argument of the uniform functions. String literals are hashed by the
+// compiler, so a lookup builds no string and asks the driver nothing. The
+// text is only read to report a problem.
+struct UniformName{
+    uint64_t hash;
+    const char* text;
+    size_t length;
+
+    template <size_t N>
+    consteval UniformName(const char (&name)[N]) : hash(uniform_name_hash(name, N - 1)), text(name), length(N - 1){}
+    UniformName(const string &name) : hash(uniform_name_hash(name.data(), name.size())), text(name.data()), length(name.size()){}
+};
+
+// Debug builds check every uniform write and block binding against what
+// the linked program declares, and report mismatches on cerr
+#ifndef SHADER_VALIDATION
+#ifdef NDEBUG
+#define SHADER_VALIDATION 0
+#else
+#define SHADER_VALIDATION 1
+#endif
+#endif
+
+// GL type a C++ value is uploaded as
+template <class T> struct uniform_type;
+template <> struct uniform_type<bool>{ static constexpr GLenum value = GL_BOOL; };
+template <> struct uniform_type<int>{ static constexpr GLenum value = GL_INT; };
+template <> struct uniform_type<float>{ static constexpr GLenum value = GL_FLOAT; };
+template <> struct uniform_type<glm::vec3>{ static constexpr GLenum value = GL_FLOAT_VEC3; };
+template <> struct uniform_type<glm::vec4>{ static constexpr GLenum value = GL_FLOAT_VEC4; };
+template <> struct uniform_type<glm::mat4>{ static constexpr GLenum value = GL_FLOAT_MAT4; };
+
+inline bool uniform_type_is_sampler(GLenum type){
+    switch (type) {
+    case GL_SAMPLER_1D: case GL_SAMPLER_2D: case GL_SAMPLER_3D: case GL_SAMPLER_CUBE:
+    case GL_SAMPLER_2D_SHADOW: case GL_SAMPLER_2D_ARRAY: case GL_SAMPLER_BUFFER:
+    case GL_INT_SAMPLER_2D: case GL_UNSIGNED_INT_SAMPLER_2D:
+        return true;
+    }
+    return false;
+}
+
+// Whether a value uploaded as `written` may go to a uniform declared as
+// `declared`: glUniform1i also sets bools and samplers, glUniform1f bools
+inline bool uniform_type_accepts(GLenum declared, GLenum written){
+    if (declared == written)
+        return true;
+    if (written == GL_INT || written == GL_BOOL)
+        return declared == GL_INT || declared == GL_BOOL || uniform_type_is_sampler(declared);
+    return written == GL_FLOAT && declared == GL_BOOL;
+}
+
+inline string uniform_type_name(GLenum type){
+    switch (type) {
+    case GL_BOOL: return "bool";
+    case GL_INT: return "int";
+    case GL_FLOAT: return "float";
+    case GL_FLOAT_VEC2: return "vec2";
+    case GL_FLOAT_VEC3: return "vec3";
+    case GL_FLOAT_VEC4: return "vec4";
+    case GL_FLOAT_MAT3: return "mat3";
+    case GL_FLOAT_MAT4: return "mat4";
+    case GL_SAMPLER_2D: return "sampler2D";
+    }
+    char name[16];
+    snprintf(name, sizeof(name), "0x%04x", type);
+    return name;
+}
+
+// What a linked program uses, queried once per link
+struct ShaderReflection{
+    // Uniforms of the default block; arrays appear once, as "name[0]"
+    struct Uniform{
+        string name;
+        int location;
+        GLenum type;
+        int size; // array length, 1 otherwise
+    };
+    struct Block{
+        string name;
+        unsigned int binding;
+        int size; // GL_UNIFORM_BLOCK_DATA_SIZE
+    };
+    struct Attribute{
+        string name;
+        int location;
+        GLenum type;
+    };
+
+    vector<Uniform> uniforms;
+    vector<Block> blocks;
+    vector<Attribute> attributes;
+
+    const Block* find_block(const string &name) const{
+        for (const Block& block : blocks) {
+            if (block.name == name)
+                return &block;
+        }
+        return nullptr;
+    }
+};
+
+template <class T> class UniformHandle;
+
 class Shader{
 public:
     // Shader(const string &vertexPath, const string &fragmentPath);
-    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr){
-        // 1. retrieve the vertex/fragment source code from filePath
-        std::string vertexCode;
-        std::string fragmentCode;
-        std::string geometryCode;
-        std::ifstream vShaderFile;
-        std::ifstream fShaderFile;
-        std::ifstream gShaderFile;
-        // ensure ifstream objects can throw exceptions:
-        vShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        fShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        gShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        try 
-        {
-            // open files
-            vShaderFile.open(vertexPath);
-            fShaderFile.open(fragmentPath);
-            std::stringstream vShaderStream, fShaderStream;
-            // read file's buffer contents into streams
-            vShaderStream << vShaderFile.rdbuf();
-            fShaderStream << fShaderFile.rdbuf();		
-            // close file handlers
-            vShaderFile.close();
-            fShaderFile.close();
-            // convert stream into string
-            vertexCode = vShaderStream.str();
-            fragmentCode = fShaderStream.str();			
-            // if geometry shader path is present, also load a geometry shader
-            if(geometryPath != nullptr)
-            {
-                gShaderFile.open(geometryPath);
-                std::stringstream gShaderStream;
-                gShaderStream << gShaderFile.rdbuf();
-                gShaderFile.close();
-                geometryCode = gShaderStream.str();
+    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
+        : vertex_path(vertexPath), fragment_path(fragmentPath), geometry_path(geometryPath ? geometryPath : ""){
+        ID = build_program(nullptr);
+        reflect();
+    }
+
+    // A variant of a vertex/fragment pair with `defines` injected (see
+    // ShaderPreprocessor.h). With `build` false, ID stays 0 until a program
+    // from compile_program() is handed to replace_program(), e.g. compiled in
+    // the background; handles and block bindings made meanwhile apply then.
+    Shader(const string &vertexPath, const string &fragmentPath, const ShaderDefines &defines, bool build = true)
+        : vertex_path(vertexPath), fragment_path(fragmentPath), defines(defines){
+        ID = build ? build_program(nullptr) : 0;
+        reflect();
+    }
+
+    Shader();
+    unsigned int ID;
+    // Linked and ready to draw with
+    bool ready() const{
+        return this->ID != 0;
+    }
+    // activate the shader
+    void use(){ 
+        glState().useProgram(this->ID); 
+    }
+    // utility uniform functions; locations come from the table built when
+    // the program was linked, and debug builds check the name and type
+    void set_uniform(UniformName name, bool value) const{
+        write(name, value);
+    }
+
+    void set_uniform(UniformName name, int value) const{
+        write(name, value);
+    }
+
+    void set_uniform(UniformName name, float value) const{
+        write(name, value);
+    }
+
+    void set_uniform(UniformName name, const glm::vec3 &value) const{
+        write(name, value);
+    }
+
+    void set_uniform(UniformName name, const glm::vec4 &value) const{
+        write(name, value);
+    }
+
+    void set_uniform(UniformName name, const glm::mat4 &value) const{
+        write(name, value);
+    }
+
+    // Location in the current program, -1 if it has no such uniform
+    int location(UniformName name) const{
+        return find_location(name.hash);
+    }
+
+    // Active uniforms, uniform blocks and vertex inputs of the current program
+    const ShaderReflection &reflection() const{
+        return reflected;
+    }
+
+    // Handle for a uniform written every frame or every draw: a slot in this
+    // shader's binding table, so set() needs no name lookup, and the
+    // location follows replace_program(). Debug builds check T against the
+    // declared type on every link.
+    template <class T>
+    UniformHandle<T> uniform(UniformName name){
+        handle_slots.push_back({ name.hash, location(name), uniform_type<T>::value, string(name.text, name.length) });
+#if SHADER_VALIDATION
+        check_slot(handle_slots.back());
+#endif
+        return UniformHandle<T>(this, handle_slots.size() - 1);
+    }
+
+    // Attach a uniform block to a buffer binding point; GLSL 330 has no
+    // layout(binding) for it. Blocks the program lacks are ignored. Kept
+    // across reloads. The Frame block is always bound at FRAME_BINDING.
+    // Debug builds compare a non-zero `size`, that of the C++ struct, with
+    // the block's data size on every link.
+    void bind_uniform_block(const string &name, unsigned int binding, size_t size = 0){
+        block_bindings.push_back({ name, binding, size });
+        if (ready())
+            apply_block_binding(this->ID, name, binding);
+        for (ShaderReflection::Block& block : reflected.blocks) {
+            if (block.name == name)
+                block.binding = binding;
+        }
+#if SHADER_VALIDATION
+        check_block(block_bindings.back());
+#endif
+    }
+
+    // Stage files; the geometry path is empty if unused
+    vector<string> stages() const{
+        vector<string> paths = { vertex_path, fragment_path };
+        if (!geometry_path.empty())
+            paths.push_back(geometry_path);
+        return paths;
+    }
+
+    // Source files, for hot reload: the stages and every file they include
+    // as of now
+    vector<string> sources() const{
+        vector<string> paths = stages();
+        for (const string& stage : stages()) {
+            PreprocessedShader source = preprocessShader(stage, defines);
+            for (const string& file : source.files) {
+                if (find(paths.begin(), paths.end(), file) == paths.end())
+                    paths.push_back(file);
             }
         }
-        catch (std::ifstream::failure& e)
-        {
-            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << std::endl;
+        return paths;
+    }
+
+    const ShaderDefines &variant_defines() const{
+        return defines;
+    }
+
+    // Build a fresh program from the current sources without touching ID,
+    // on any context sharing objects with the one that draws. Returns 0 and
+    // deletes the attempt if a stage fails, so a broken edit keeps the
+    // running program.
+    unsigned int compile_program() const{
+        bool ok = false;
+        unsigned int program = build_program(&ok);
+        if (!ok) {
+            glState().deleteProgram(program);
+            return 0;
+        }
+        return program;
+    }
+
+    // Switch to a program from compile_program(), on the drawing context
+    // between frames
+    void replace_program(unsigned int program){
+        glState().deleteProgram(this->ID);
+        this->ID = program;
+        reflect();
+    }
+    
+private:
+    template <class T> friend class UniformHandle;
+
+    // Binding table entry behind a UniformHandle; set() only reads location
+    struct HandleSlot{
+        uint64_t hash;
+        int location;
+        GLenum type;         // what the handle uploads
+        string name;         // for reports
+        mutable bool flagged = false; // dropped write reported since the last link
+    };
+
+    struct BlockBinding{
+        string name;
+        unsigned int binding;
+        size_t size; // of the C++ struct; 0 if unchecked
+    };
+
+    string vertex_path;
+    string fragment_path;
+    string geometry_path;
+    ShaderDefines defines;
+    vector<BlockBinding> block_bindings = { { "Frame", FRAME_BINDING, sizeof(FrameUniforms) } };
+    ShaderReflection reflected;
+    unordered_map<uint64_t, size_t> uniform_index; // name hash -> reflected.uniforms
+    vector<HandleSlot> handle_slots;              // one per UniformHandle handed out
+    mutable unordered_set<uint64_t> flagged_names; // set_uniform() problems reported since the last link
+
+    const ShaderReflection::Uniform* find_uniform(uint64_t hash) const{
+        auto it = uniform_index.find(hash);
+        return it == uniform_index.end() ? nullptr : &reflected.uniforms[it->second];
+    }
+
+    int find_location(uint64_t hash) const{
+        const ShaderReflection::Uniform* uniform = find_uniform(hash);
+        return uniform ? uniform->location : -1;
+    }
+
+    // Query the active uniforms, uniform blocks and attributes of ID once,
+    // after linking, and point the handle slots at the new locations. Arrays
+    // are also found without their "[0]"; block members have no location.
+    void reflect(){
+        reflected = ShaderReflection();
+        uniform_index.clear();
+        flagged_names.clear();
+        for (HandleSlot& slot : handle_slots) {
+            slot.location = -1;
+            slot.flagged = false;
+        }
+        if (!ready())
+            return;
+
+        int count = 0, maxLength = 0;
+        glGetProgramiv(this->ID, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(this->ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        vector<char> name(maxLength + 1);
+        for (int i = 0; i < count; i++) {
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveUniform(this->ID, i, GLsizei(name.size()), &length, &size, &type, name.data());
+            int location = glGetUniformLocation(this->ID, name.data());
+            if (location < 0)
+                continue;
+            uniform_index[uniform_name_hash(name.data(), length)] = reflected.uniforms.size();
+            if (length > 3 && strncmp(name.data() + length - 3, "[0]", 3) == 0)
+                uniform_index[uniform_name_hash(name.data(), length - 3)] = reflected.uniforms.size();
+            reflected.uniforms.push_back({ string(name.data(), length), location, type, size });
+        }
+
+        glGetProgramiv(this->ID, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+        glGetProgramiv(this->ID, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &maxLength);
+        name.assign(maxLength + 1, '\0');
+        for (int i = 0; i < count; i++) {
+            GLsizei length = 0;
+            GLint binding = 0, size = 0;
+            glGetActiveUniformBlockName(this->ID, i, GLsizei(name.size()), &length, name.data());
+            glGetActiveUniformBlockiv(this->ID, i, GL_UNIFORM_BLOCK_BINDING, &binding);
+            glGetActiveUniformBlockiv(this->ID, i, GL_UNIFORM_BLOCK_DATA_SIZE, &size);
+            reflected.blocks.push_back({ string(name.data(), length), unsigned(binding), size });
+        }
+
+        glGetProgramiv(this->ID, GL_ACTIVE_ATTRIBUTES, &count);
+        glGetProgramiv(this->ID, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &maxLength);
+        name.assign(maxLength + 1, '\0');
+        for (int i = 0; i < count; i++) {
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveAttrib(this->ID, i, GLsizei(name.size()), &length, &size, &type, name.data());
+            int location = glGetAttribLocation(this->ID, name.data());
+            if (location >= 0)
+                reflected.attributes.push_back({ string(name.data(), length), location, type });
+        }
+
+        for (HandleSlot& slot : handle_slots) {
+            slot.location = find_location(slot.hash);
+#if SHADER_VALIDATION
+            check_slot(slot);
+#endif
+        }
+#if SHADER_VALIDATION
+        for (const BlockBinding& block : block_bindings)
+            check_block(block);
+#endif
+    }
+
+    // How reports name this shader
+    string label() const{
+        string text = vertex_path + ", " + fragment_path;
+        if (!defines.empty())
+            text += " (" + variant_name() + ")";
+        return text;
+    }
+
+    // Type mismatch between a handle and the uniform it writes; a handle to
+    // a uniform the program lacks is reported on its first write instead
+    void check_slot(const HandleSlot &slot) const{
+        const ShaderReflection::Uniform* uniform = find_uniform(slot.hash);
+        if (uniform && !uniform_type_accepts(uniform->type, slot.type))
+            std::cerr << "Shader " << label() << ": uniform " << slot.name << " is " << uniform_type_name(uniform->type)
+                << " but its handle writes " << uniform_type_name(slot.type) << std::endl;
+    }
+
+    void check_block(const BlockBinding &block) const{
+        const ShaderReflection::Block* reflectedBlock = reflected.find_block(block.name);
+        if (block.size && reflectedBlock && size_t(reflectedBlock->size) != block.size)
+            std::cerr << "Shader " << label() << ": uniform block " << block.name << " is " << reflectedBlock->size
+                << " bytes but its C++ struct is " << block.size << std::endl;
+    }
+
+    // A write through a handle whose uniform the program lacks, reported once
+    // per link
+    void flag_dropped_write(const HandleSlot &slot) const{
+        if (slot.flagged || !ready())
+            return;
+        slot.flagged = true;
+        std::cerr << "Shader " << label() << ": write to " << slot.name
+            << ", which is not an active uniform (misspelled or optimized out)" << std::endl;
+    }
+
+    template <class T>
+    void write(UniformName name, const T &value) const{
+        const ShaderReflection::Uniform* uniform = find_uniform(name.hash);
+#if SHADER_VALIDATION
+        if (ready() && (!uniform || !uniform_type_accepts(uniform->type, uniform_type<T>::value))
+            && flagged_names.insert(name.hash).second) {
+            std::cerr << "Shader " << label() << ": set_uniform(" << string(name.text, name.length) << ", "
+                << uniform_type_name(uniform_type<T>::value) << ") ";
+            if (uniform)
+                std::cerr << "on a " << uniform_type_name(uniform->type) << std::endl;
+            else
+                std::cerr << "on no active uniform (misspelled or optimized out)" << std::endl;
+        }
+#endif
+        upload(uniform ? uniform->location : -1, value);
+    }
+
+    // Through the state shadow, which drops writes of the value the
+    // uniform already holds
+    template <class T>
+    static void upload(int location, const T &value){
+        glState().uniform(location, value);
+    }
+
+    // Read, compile and link the sources into a new program on the current
+    // context, or load the binary an earlier run saved for the same sources
+    // (ProgramCache.h). `ok` reports whether every stage compiled and linked.
+    unsigned int build_program(bool* ok) const{
+        auto start = chrono::steady_clock::now();
+        auto elapsed = [&] {
+            return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        };
+        const char* geometryPath = geometry_path.empty() ? nullptr : geometry_path.c_str();
+        bool success = true;
+        // 1. read the sources, with includes resolved and the defines injected
+        PreprocessedShader vertexSource = preprocessShader(vertex_path, defines);
+        PreprocessedShader fragmentSource = preprocessShader(fragment_path, defines);
+        PreprocessedShader geometrySource;
+        if (geometryPath != nullptr)
+            geometrySource = preprocessShader(geometry_path, defines);
+        for (const PreprocessedShader* source : { &vertexSource, &fragmentSource, &geometrySource }) {
+            if (!*source) {
+                std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << source->error << std::endl;
+                success = false;
+            }
+        }
+        const std::string& vertexCode = vertexSource.code;
+        const std::string& fragmentCode = fragmentSource.code;
+        const std::string& geometryCode = geometrySource.code;
+        // Same sources and driver as a previous run: skip the compiler
+        bool cacheable = success && programBinariesSupported();
+        string cachePath;
+        uint64_t cacheKey = 0;
+        if (cacheable) {
+            cachePath = programCachePath(stages(), variant_name());
+            cacheKey = programCacheKey({ vertexCode, fragmentCode, geometryCode });
+            unsigned int program = loadProgramBinary(cachePath, cacheKey);
+            if (program) {
+                for (const BlockBinding& block : block_bindings)
+                    apply_block_binding(program, block.name, block.binding);
+                std::cout << cachePath << ": program binary loaded in " << elapsed() << " ms" << std::endl;
+                if (ok)
+                    *ok = true;
+                return program;
+            }
         }
         const char* vShaderCode = vertexCode.c_str();
         const char * fShaderCode = fragmentCode.c_str();
@@ -71,12 +506,12 @@ public:
         vertex = glCreateShader(GL_VERTEX_SHADER);
         glShaderSource(vertex, 1, &vShaderCode, NULL);
         glCompileShader(vertex);
-        checkCompileErrors(vertex, "VERTEX");
+        success &= checkCompileErrors(vertex, "VERTEX", vertexSource.files);
         // fragment Shader
         fragment = glCreateShader(GL_FRAGMENT_SHADER);
         glShaderSource(fragment, 1, &fShaderCode, NULL);
         glCompileShader(fragment);
-        checkCompileErrors(fragment, "FRAGMENT");
+        success &= checkCompileErrors(fragment, "FRAGMENT", fragmentSource.files);
         // if geometry shader is given, compile geometry shader
         unsigned int geometry;
         if(geometryPath != nullptr)
@@ -85,58 +520,56 @@ public:
             geometry = glCreateShader(GL_GEOMETRY_SHADER);
             glShaderSource(geometry, 1, &gShaderCode, NULL);
             glCompileShader(geometry);
-            checkCompileErrors(geometry, "GEOMETRY");
+            success &= checkCompileErrors(geometry, "GEOMETRY", geometrySource.files);
         }
         // shader Program
-        ID = glCreateProgram();
-        glAttachShader(ID, vertex);
-        glAttachShader(ID, fragment);
+        unsigned int program = glCreateProgram();
+        glAttachShader(program, vertex);
+        glAttachShader(program, fragment);
         if(geometryPath != nullptr)
-            glAttachShader(ID, geometry);
-        glLinkProgram(ID);
-        checkCompileErrors(ID, "PROGRAM");
+            glAttachShader(program, geometry);
+        if (cacheable)
+            glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glLinkProgram(program);
+        success &= checkCompileErrors(program, "PROGRAM");
+        if (success) {
+            std::cout << vertex_path << ", " << fragment_path << (defines.empty() ? "" : " (" + variant_name() + ")")
+                << ": compiled and linked in " << elapsed() << " ms" << std::endl;
+            if (cacheable && !saveProgramBinary(cachePath, cacheKey, program))
+                std::cerr << "Failed to write program cache: " << cachePath << std::endl;
+        }
         // delete the shaders as they're linked into our program now and no longer necessary
         glDeleteShader(vertex);
         glDeleteShader(fragment);
         if(geometryPath != nullptr)
             glDeleteShader(geometry);
-
-    }
-
-    Shader();
-    unsigned int ID;
-    // activate the shader
-    void use(){ 
-        glUseProgram(this->ID); 
-    }
-    // utility uniform functions
-    void set_uniform(const string &name, bool value) const{
-        glUniform1i(glGetUniformLocation(this->ID, name.c_str()), (int)value);
-    }
-
-    void set_uniform(const string &name, int value) const{
-        glUniform1i(glGetUniformLocation(this->ID, name.c_str()), value);
+        // uniform block bindings are program state; carry them over
+        for (const BlockBinding& block : block_bindings)
+            apply_block_binding(program, block.name, block.binding);
+        if (ok)
+            *ok = success;
+        return program;
     }
 
-    void set_uniform(const string &name, float value) const{
-        glUniform1f(glGetUniformLocation(this->ID, name.c_str()), value);
+    static void apply_block_binding(unsigned int program, const string &name, unsigned int binding){
+        unsigned int index = glGetUniformBlockIndex(program, name.c_str());
+        if (index != GL_INVALID_INDEX)
+            glUniformBlockBinding(program, index, binding);
     }
 
-    void set_uniform(const string &name, glm::vec3 value) const{
-        glUniform3fv(glGetUniformLocation(this->ID, name.c_str()), 1, glm::value_ptr(value));
-    }
-
-    void set_uniform(const string &name, glm::vec4 value) const{
-        glUniform4fv(glGetUniformLocation(this->ID, name.c_str()), 1, glm::value_ptr(value));
+    void init(string vertFilePath, string fragFilePath);
+    // Names the define set in file names; empty without defines
+    string variant_name() const{
+        if (defines.empty())
+            return string();
+        string key = shaderDefinesKey(defines);
+        char name[17];
+        snprintf(name, sizeof(name), "%016llx", (unsigned long long)programCacheHash(key.data(), key.size()));
+        return name;
     }
 
-    void set_uniform(const string &name, glm::mat4 value) const{
-        glUniformMatrix4fv(glGetUniformLocation(this->ID, name.c_str()), 1, GL_FALSE, glm::value_ptr(value));
-    }
-    
-private:
-    void init(string vertFilePath, string fragFilePath);
-    void checkCompileErrors(unsigned int shader, std::string type)
+    // `files` names the source string numbers in a compiler message
+    bool checkCompileErrors(unsigned int shader, std::string type, const vector<string> &files = {}) const
     {
         int success;
         char infoLog[1024];
@@ -146,7 +579,10 @@ private:
             if (!success)
             {
                 glGetShaderInfoLog(shader, 1024, NULL, infoLog);
-                std::cout << "ERROR::SHADER_COMPILATION_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
+                std::cout << "ERROR::SHADER_COMPILATION_ERROR of type: " << type << "\n" << infoLog;
+                for (size_t i = 0; i < files.size() && files.size() > 1; i++)
+                    std::cout << "source " << i << ": " << files[i] << "\n";
+                std::cout << "\n -- --------------------------------------------------- -- " << std::endl;
             }
         }
         else
@@ -158,5 +594,34 @@ private:
                 std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
             }
         }
+        return success != 0;
     }
+};
+
+// A slot in one Shader's binding table, resolved when the handle was made
+// and on every relink. set() writes to the program in use, which must be
+// that shader's; a default constructed handle ignores it.
+template <class T>
+class UniformHandle{
+public:
+    UniformHandle() = default;
+
+    void set(const T &value) const{
+        if (!shader)
+            return;
+        const Shader::HandleSlot& entry = shader->handle_slots[slot];
+#if SHADER_VALIDATION
+        if (entry.location < 0)
+            shader->flag_dropped_write(entry);
+#endif
+        Shader::upload(entry.location, value);
+    }
+
+private:
+    friend class Shader;
+
+    const Shader* shader = nullptr;
+    size_t slot = 0;
+
+    UniformHandle(const Shader* shader, size_t slot) : shader(shader), slot(slot){}
 };
\ No newline at end of file
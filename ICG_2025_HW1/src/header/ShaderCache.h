@@ -0,0 +1,106 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <iostream>
+#include <functional>
+#include <unordered_map>
+
+#include "Shader.h"
+#include "AssetLoader.h"
+
+using namespace std;
+
+// Shader permutations: one program per (vertex file, fragment file, define
+// set), shared by every draw site asking for the same combination. Define
+// sets compare by content, so {A, B} and {B, A} get the same program.
+//
+// A permutation is compiled the first time it is asked for, not before.
+// With an AssetLoader that happens on its upload thread and the Shader turns
+// ready() in a later AssetLoader::update(); draw sites keep using what they
+// had until then. The program binary cache (ProgramCache.h) keeps each
+// permutation's binary apart, so later runs load them all warm.
+//
+// Destroy it after the AssetLoader, which may still hold compiles for its
+// Shaders, and with the drawing context current.
+class ShaderCache
+{
+public:
+	// `setup` runs on every new Shader before it is compiled, e.g. to bind its
+	// uniform blocks or hand it to HotReload. Without `loader` permutations
+	// compile on the spot, on the current context.
+	explicit ShaderCache(AssetLoader* loader = nullptr, function<void(Shader&)> setup = nullptr)
+		: loader(loader), setup(move(setup))
+	{
+	}
+
+	ShaderCache(const ShaderCache&) = delete;
+	ShaderCache& operator=(const ShaderCache&) = delete;
+
+	// The permutation of `vertexPath` and `fragmentPath` with `defines`. A new
+	// one compiles in the background unless `wait`; one that fails to compile
+	// stays not ready() until hot reload fixes its source.
+	Shader& get(const string& vertexPath, const string& fragmentPath, const ShaderDefines& defines = {},
+		bool wait = false)
+	{
+		ShaderDefines canonical = canonicalShaderDefines(defines);
+		string key = vertexPath + "\n" + fragmentPath + "\n" + shaderDefinesKey(canonical);
+		auto it = shaders.find(key);
+		if (it != shaders.end()) {
+			hits++;
+			return *it->second;
+		}
+
+		Shader& shader = *shaders.emplace(key, make_unique<Shader>(vertexPath, fragmentPath, canonical, false))
+			.first->second;
+		if (setup)
+			setup(shader);
+		if (!loader || wait) {
+			unsigned int program = shader.compile_program();
+			if (program)
+				shader.replace_program(program);
+			else
+				cerr << "ShaderCache: " << describe(shader) << " does not compile" << endl;
+			return shader;
+		}
+
+		shared_ptr<unsigned int> program = make_shared<unsigned int>(0);
+		pending++;
+		loader->schedule(
+			[&shader, program] {
+				*program = shader.compile_program();
+				return *program != 0;
+			},
+			[this, &shader, program](bool ok) {
+				pending--;
+				if (ok)
+					shader.replace_program(*program);
+				else
+					cerr << "ShaderCache: " << describe(shader) << " does not compile" << endl;
+			});
+		return shader;
+	}
+
+	// Permutations made so far, compiled or not
+	size_t size() const { return shaders.size(); }
+	// Still compiling in the background
+	size_t pendingCount() const { return pending; }
+	// get() calls answered with an existing permutation
+	size_t hitCount() const { return hits; }
+
+private:
+	AssetLoader* loader;
+	function<void(Shader&)> setup;
+	unordered_map<string, unique_ptr<Shader>> shaders; // by get() key; Shaders never move
+	size_t pending = 0;
+	size_t hits = 0;
+
+	static string describe(const Shader& shader)
+	{
+		string text;
+		for (const string& stage : shader.stages())
+			text += (text.empty() ? "" : " + ") + stage;
+		for (const auto& define : shader.variant_defines())
+			text += " -D" + define.first + (define.second.empty() ? "" : "=" + define.second);
+		return text;
+	}
+};
@@ -0,0 +1,153 @@
+#pragma once
+#include <map>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <utility>
+#include <algorithm>
+#include <filesystem>
+
+using namespace std;
+
+// GLSL front end for Shader: resolves #include and injects #defines, so one
+// .vert/.frag pair covers its variants instead of a copy per variant.
+//
+//     #include "frame.glsl"
+//
+// is replaced by that file, looked up next to the file including it, and
+// expanded recursively; an include cycle is an error. Includes are expanded
+// whatever #if they sit in, so guard a file that is included twice with
+// #ifndef. The defines go right after #version. #line directives keep
+// compiler messages pointing at the right line, with each file as its own
+// source string number (PreprocessedShader::files).
+
+// (name, value) pairs; the value may be empty
+using ShaderDefines = vector<pair<string, string>>;
+
+struct PreprocessedShader
+{
+	string code;
+	vector<string> files; // by source string number; 0 is the stage itself
+	string error;         // empty on success
+
+	explicit operator bool() const { return error.empty(); }
+};
+
+// `defines` sorted by name, the last value winning if a name repeats, so
+// equal sets compare equal whatever order they were listed in
+inline ShaderDefines canonicalShaderDefines(const ShaderDefines& defines)
+{
+	map<string, string> sorted;
+	for (const auto& define : defines)
+		sorted[define.first] = define.second;
+	return ShaderDefines(sorted.begin(), sorted.end());
+}
+
+// Text of a define set, one NAME=VALUE line each in canonical order
+inline string shaderDefinesKey(const ShaderDefines& defines)
+{
+	string key;
+	for (const auto& define : canonicalShaderDefines(defines))
+		key += define.first + "=" + define.second + "\n";
+	return key;
+}
+
+namespace shader_preprocessor
+{
+	// The directive `line` starts with, e.g. "include", and the rest of the
+	// line after it; empty if it is not a directive
+	inline string directive(const string& line, string& rest)
+	{
+		size_t start = line.find_first_not_of(" \t");
+		if (start == string::npos || line[start] != '#')
+			return string();
+		size_t name = line.find_first_not_of(" \t", start + 1);
+		if (name == string::npos)
+			return string();
+		size_t end = line.find_first_of(" \t\r\"<", name);
+		rest = end == string::npos ? string() : line.substr(end);
+		return line.substr(name, end == string::npos ? string::npos : end - name);
+	}
+
+	inline int sourceNumber(PreprocessedShader& out, const string& path)
+	{
+		auto it = find(out.files.begin(), out.files.end(), path);
+		if (it != out.files.end())
+			return int(it - out.files.begin());
+		out.files.push_back(path);
+		return int(out.files.size() - 1);
+	}
+
+	// Append `path` to out.code with its includes expanded. `stack` holds the
+	// files being expanded, to catch cycles; `defines` is only given for the
+	// stage file.
+	inline bool expand(const string& path, PreprocessedShader& out, vector<string>& stack,
+		const ShaderDefines* defines)
+	{
+		if (find(stack.begin(), stack.end(), path) != stack.end()) {
+			out.error = path + " includes itself through " + stack.back();
+			return false;
+		}
+		ifstream file(path);
+		if (!file.is_open()) {
+			out.error = stack.empty() ? "cannot open " + path : "cannot open " + path + ", included from " + stack.back();
+			return false;
+		}
+		stack.push_back(path);
+		int source = sourceNumber(out, path);
+		string line;
+		int number = 0;
+		bool injected = defines == nullptr;
+		while (getline(file, line)) {
+			number++;
+			string rest;
+			string name = directive(line, rest);
+			if (name == "version") {
+				if (!defines) {
+					out.error = path + ":" + to_string(number) + ": #version in an included file";
+					return false;
+				}
+				out.code += line + "\n";
+				for (const auto& define : *defines)
+					out.code += "#define " + define.first + " " + define.second + "\n";
+				out.code += "#line " + to_string(number + 1) + " " + to_string(source) + "\n";
+				injected = true;
+				continue;
+			}
+			if (name == "include") {
+				size_t open = rest.find_first_of("\"<");
+				size_t close = open == string::npos ? open : rest.find_first_of("\">", open + 1);
+				if (close == string::npos) {
+					out.error = path + ":" + to_string(number) + ": malformed #include";
+					return false;
+				}
+				string included = (filesystem::path(path).parent_path() / rest.substr(open + 1, close - open - 1))
+					.lexically_normal().string();
+				out.code += "#line 1 " + to_string(sourceNumber(out, included)) + "\n";
+				if (!expand(included, out, stack, nullptr))
+					return false;
+				out.code += "#line " + to_string(number + 1) + " " + to_string(source) + "\n";
+				continue;
+			}
+			out.code += line + "\n";
+		}
+		if (!injected) {
+			// No #version, so the compiler assumes 1.10: the defines go first
+			string prefix;
+			for (const auto& define : *defines)
+				prefix += "#define " + define.first + " " + define.second + "\n";
+			out.code = prefix + "#line 1 " + to_string(source) + "\n" + out.code;
+		}
+		stack.pop_back();
+		return true;
+	}
+} // namespace shader_preprocessor
+
+// The stage at `path` ready for glShaderSource, or the reason it is not
+inline PreprocessedShader preprocessShader(const string& path, const ShaderDefines& defines = {})
+{
+	PreprocessedShader out;
+	vector<string> stack;
+	shader_preprocessor::expand(path, out, stack, &defines);
+	return out;
+}
@@ -0,0 +1,226 @@
+#pragma once
+#include <deque>
+#include <vector>
+#include <cstring>
+#include <cstddef>
+#include <iostream>
+#include <glad/glad.h>
+
+#include "GLState.h"
+
+using namespace std;
+
+// Ring buffer for data written every frame, e.g. per-draw transforms.
+//
+// The buffer holds FRAMES_IN_FLIGHT frames worth of bytes, so the CPU can
+// fill one frame while the GPU still reads the two before it. allocate()
+// hands out aligned ranges at the head of the ring; endFrame() puts a fence
+// behind the frame's draws, and the space comes back once that fence has
+// signalled. Only when the GPU is a whole ring behind does allocate() wait,
+// and a frame that outgrows the ring moves to a bigger one.
+//
+// With GL_ARB_buffer_storage (core in 4.4) the buffer is mapped once,
+// persistent and coherent, and allocations point straight into it. Without
+// it each allocation maps its own range unsynchronized, which the fences
+// make safe, and flush() unmaps it again. Either way: fill an allocation
+// before asking for the next one, and call flush() before drawing with it.
+class StreamBuffer
+{
+public:
+	static const int FRAMES_IN_FLIGHT = 3;
+
+	struct Allocation
+	{
+		void* data = nullptr;
+		unsigned int buffer = 0;
+		GLintptr offset = 0;
+		GLsizeiptr size = 0;
+
+		explicit operator bool() const { return data != nullptr; }
+	};
+
+	// Room for `frameBytes` per frame; needs a current context
+	explicit StreamBuffer(size_t frameBytes)
+	{
+		persistent = glBufferStorage && (GLAD_GL_VERSION_4_4 || GLAD_GL_ARB_buffer_storage);
+		create(max<size_t>(frameBytes, 256) * FRAMES_IN_FLIGHT);
+	}
+
+	StreamBuffer(const StreamBuffer&) = delete;
+	StreamBuffer& operator=(const StreamBuffer&) = delete;
+
+	// Needs the context that drew with the buffer current
+	~StreamBuffer()
+	{
+		flush();
+		for (const Frame& frame : in_flight)
+			glDeleteSync(frame.fence);
+		for (unsigned int old : retired)
+			glState().deleteBuffer(old);
+		glState().deleteBuffer(buffer);
+	}
+
+	// `bytes` at a multiple of `alignment` from the start of the buffer. Empty
+	// only if the driver refuses to map.
+	Allocation allocate(size_t bytes, size_t alignment = 16)
+	{
+		flush();
+		if (bytes == 0)
+			return {};
+		if (bytes + alignment > capacity / FRAMES_IN_FLIGHT)
+			grow(bytes + alignment);
+
+		size_t offset = (head + alignment - 1) / alignment * alignment;
+		size_t skipped = offset - head;
+		if (offset + bytes > capacity) {
+			skipped = capacity - head;
+			offset = 0;
+		}
+		// Wait for the GPU only if it still reads the space we need
+		while (used + skipped + bytes > capacity) {
+			if (in_flight.empty()) {
+				grow(used + skipped + bytes);
+				return allocate(bytes, alignment);
+			}
+			retire(true);
+		}
+		head = offset + bytes;
+		used += skipped + bytes;
+		frame_bytes += skipped + bytes;
+
+		Allocation allocation;
+		allocation.buffer = buffer;
+		allocation.offset = GLintptr(offset);
+		allocation.size = GLsizeiptr(bytes);
+		if (persistent) {
+			allocation.data = mapped + offset;
+		} else {
+			glState().bindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+			allocation.data = glMapBufferRange(GL_COPY_WRITE_BUFFER, offset, bytes,
+				GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+			glState().bindBuffer(GL_COPY_WRITE_BUFFER, 0);
+			range_mapped = allocation.data != nullptr;
+		}
+		return allocation;
+	}
+
+	// Copy `bytes` from `src` into a new allocation
+	Allocation upload(const void* src, size_t bytes, size_t alignment = 16)
+	{
+		Allocation allocation = allocate(bytes, alignment);
+		if (allocation)
+			memcpy(allocation.data, src, bytes);
+		return allocation;
+	}
+
+	// Make the last allocation visible to draws issued from now on. Nothing
+	// to do for a coherent persistent mapping.
+	void flush()
+	{
+		if (!range_mapped)
+			return;
+		glState().bindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+		glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+		glState().bindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		range_mapped = false;
+	}
+
+	// After the last draw that reads this frame's allocations
+	void endFrame()
+	{
+		flush();
+		if (frame_bytes > 0) {
+			in_flight.push_back({ glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), frame_bytes });
+			frame_bytes = 0;
+		}
+		// Draws from replaced buffers are queued by now; GL frees them once done
+		for (unsigned int old : retired)
+			glState().deleteBuffer(old);
+		retired.clear();
+		while (!in_flight.empty() && retire(false))
+			;
+	}
+
+	bool persistentlyMapped() const { return persistent; }
+	size_t size() const { return capacity; }
+	// Times allocate() had to wait for the GPU, and had to move to a bigger ring
+	size_t stallCount() const { return stalls; }
+	size_t growCount() const { return grows; }
+
+private:
+	struct Frame
+	{
+		GLsync fence;
+		size_t bytes; // ring space the frame took, alignment padding included
+	};
+
+	unsigned int buffer = 0;
+	unsigned char* mapped = nullptr; // persistent mapping
+	bool persistent = false;
+	bool range_mapped = false;       // unsynchronized mapping not flushed yet
+	size_t capacity = 0;
+	size_t head = 0;                 // where the next allocation goes
+	size_t used = 0;                 // bytes behind head the GPU may still read
+	size_t frame_bytes = 0;          // part of `used` allocated this frame
+	deque<Frame> in_flight;
+	vector<unsigned int> retired;    // outgrown buffers this frame still draws from
+	size_t stalls = 0;
+	size_t grows = 0;
+
+	void create(size_t bytes)
+	{
+		capacity = bytes;
+		glGenBuffers(1, &buffer);
+		glState().bindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+		if (persistent) {
+			GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			glBufferStorage(GL_COPY_WRITE_BUFFER, capacity, nullptr, flags);
+			mapped = static_cast<unsigned char*>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, capacity, flags));
+			if (!mapped) {
+				cerr << "StreamBuffer: persistent mapping failed, mapping per allocation instead" << endl;
+				persistent = false;
+				glState().bindBuffer(GL_COPY_WRITE_BUFFER, 0);
+				glState().deleteBuffer(buffer);
+				create(bytes);
+				return;
+			}
+		} else {
+			glBufferData(GL_COPY_WRITE_BUFFER, capacity, nullptr, GL_STREAM_DRAW);
+		}
+		glState().bindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+
+	// Move to a ring with room for `bytes` in each frame. Allocations made
+	// this frame stay valid; the old buffer lives until endFrame().
+	void grow(size_t bytes)
+	{
+		for (const Frame& frame : in_flight)
+			glDeleteSync(frame.fence);
+		in_flight.clear();
+		retired.push_back(buffer);
+		mapped = nullptr;
+		head = used = frame_bytes = 0;
+		create(max(capacity * 2, bytes * FRAMES_IN_FLIGHT));
+		grows++;
+	}
+
+	// Give back the oldest frame's space if the GPU is done with it, waiting
+	// for that if `wait`. False if it is still in use.
+	bool retire(bool wait)
+	{
+		const Frame& frame = in_flight.front();
+		GLenum status = glClientWaitSync(frame.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+		if (status == GL_TIMEOUT_EXPIRED) {
+			if (!wait)
+				return false;
+			stalls++;
+			do {
+				status = glClientWaitSync(frame.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+			} while (status == GL_TIMEOUT_EXPIRED);
+		}
+		glDeleteSync(frame.fence);
+		used -= frame.bytes;
+		in_flight.pop_front();
+		return true;
+	}
+};
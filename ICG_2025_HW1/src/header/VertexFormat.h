@@ -0,0 +1,211 @@
+#pragma once
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+#include <glad/glad.h>
+
+#include "MeshData.h"
+
+using namespace std;
+
+enum class VERTEXLAYOUT
+{
+	SEPARATE,    // float32 positions, normals and texcoords in three streams (32 B)
+	INTERLEAVED, // the same float32 attributes in one stream (32 B)
+	PACKED,      // float32 position, 2_10_10_10 normal, 16-bit uv (20 B)
+	QUANTIZED    // unorm16 position inside the AABB, 2_10_10_10 normal, 16-bit uv (16 B)
+};
+
+struct VertexAttribute
+{
+	unsigned int location;
+	int size;
+	GLenum type;
+	GLboolean normalized;
+	unsigned int stride;
+	size_t offset;
+};
+
+// Everything set_VAO needs to describe one vertex buffer to GL.
+struct VertexFormat
+{
+	VERTEXLAYOUT layout = VERTEXLAYOUT::SEPARATE;
+	unsigned int vertexSize = 0; // bytes per vertex summed over all streams
+	vector<VertexAttribute> attributes;
+
+	// easy.vert rebuilds the position as aPos * dequantScale + dequantOffset
+	glm::vec3 dequantScale = glm::vec3(1.0f);
+	glm::vec3 dequantOffset = glm::vec3(0.0f);
+};
+
+struct PackedVertices
+{
+	VertexFormat format;
+	vector<unsigned char> bytes;
+};
+
+inline const char* layoutName(VERTEXLAYOUT layout)
+{
+	switch (layout) {
+	case VERTEXLAYOUT::SEPARATE: return "separate";
+	case VERTEXLAYOUT::INTERLEAVED: return "interleaved";
+	case VERTEXLAYOUT::PACKED: return "packed";
+	case VERTEXLAYOUT::QUANTIZED: return "quantized";
+	}
+	return "unknown";
+}
+
+// Bytes one vertex's `attribute` takes in its buffer; 0 for a type the
+// layouts above never use
+inline size_t attributeBytes(const VertexAttribute& attribute)
+{
+	switch (attribute.type) {
+	case GL_FLOAT: return size_t(attribute.size) * 4;
+	case GL_HALF_FLOAT:
+	case GL_UNSIGNED_SHORT: return size_t(attribute.size) * 2;
+	case GL_INT_2_10_10_10_REV: return attribute.size == 4 ? 4 : 0;
+	}
+	return 0;
+}
+
+template <typename T>
+inline void writeBytes(unsigned char* dst, const T& value)
+{
+	memcpy(dst, &value, sizeof(T));
+}
+
+// Attribute description for an interleaved layout (anything but SEPARATE,
+// whose offsets depend on the vertex count). Everything that depends on the
+// data is passed in, so a mesh can be packed in pieces with one format.
+inline VertexFormat interleavedFormat(VERTEXLAYOUT layout, bool uvInUnitRange,
+	const glm::vec3& minPos, const glm::vec3& maxPos)
+{
+	VertexFormat format;
+	format.layout = layout;
+
+	if (layout == VERTEXLAYOUT::INTERLEAVED || layout == VERTEXLAYOUT::SEPARATE) {
+		format.layout = VERTEXLAYOUT::INTERLEAVED;
+		format.vertexSize = 32;
+		format.attributes = {
+			{ 0, 3, GL_FLOAT, GL_FALSE, 32, 0 },
+			{ 1, 3, GL_FLOAT, GL_FALSE, 32, 12 },
+			{ 2, 2, GL_FLOAT, GL_FALSE, 32, 24 },
+		};
+		return format;
+	}
+
+	// unorm16 keeps more precision when every uv lies in [0, 1], otherwise
+	// fall back to half floats so tiling coordinates survive.
+	GLenum uvType = uvInUnitRange ? GL_UNSIGNED_SHORT : GL_HALF_FLOAT;
+	GLboolean uvNormalized = uvInUnitRange ? GL_TRUE : GL_FALSE;
+
+	bool quantized = layout == VERTEXLAYOUT::QUANTIZED;
+	unsigned int posSize = quantized ? 8 : 12;
+	unsigned int stride = posSize + 4 + 4;
+	format.vertexSize = stride;
+	format.attributes = {
+		quantized ? VertexAttribute{ 0, 3, GL_UNSIGNED_SHORT, GL_TRUE, stride, 0 }
+		          : VertexAttribute{ 0, 3, GL_FLOAT, GL_FALSE, stride, 0 },
+		{ 1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, posSize },
+		{ 2, 2, uvType, uvNormalized, stride, posSize + 4 },
+	};
+	if (quantized) {
+		format.dequantScale = maxPos - minPos;
+		format.dequantOffset = minPos;
+	}
+	return format;
+}
+
+// Write one vertex in `format` (from interleavedFormat()) to `dst`
+inline void packVertex(const VertexFormat& format, const float* position, const float* normal,
+	const float* texcoord, unsigned char* dst)
+{
+	if (format.layout == VERTEXLAYOUT::INTERLEAVED) {
+		memcpy(dst, position, 12);
+		memcpy(dst + 12, normal, 12);
+		memcpy(dst + 24, texcoord, 8);
+		return;
+	}
+
+	bool quantized = format.layout == VERTEXLAYOUT::QUANTIZED;
+	unsigned int posSize = quantized ? 8 : 12;
+	if (quantized) {
+		const glm::vec3& minPos = format.dequantOffset;
+		const glm::vec3& extent = format.dequantScale;
+		glm::vec3 t(0.0f);
+		for (int k = 0; k < 3; k++)
+			t[k] = extent[k] > 0.0f ? (position[k] - minPos[k]) / extent[k] : 0.0f;
+		uint16_t q[4] = { glm::packUnorm1x16(t.x), glm::packUnorm1x16(t.y), glm::packUnorm1x16(t.z), 0 };
+		memcpy(dst, q, sizeof(q));
+	} else {
+		memcpy(dst, position, 12);
+	}
+
+	glm::vec3 n(normal[0], normal[1], normal[2]);
+	writeBytes(dst + posSize, glm::packSnorm3x10_1x2(glm::vec4(n, 0.0f)));
+
+	uint16_t uv[2];
+	if (format.attributes[2].type == GL_UNSIGNED_SHORT) {
+		uv[0] = glm::packUnorm1x16(texcoord[0]);
+		uv[1] = glm::packUnorm1x16(texcoord[1]);
+	} else {
+		uv[0] = glm::packHalf1x16(texcoord[0]);
+		uv[1] = glm::packHalf1x16(texcoord[1]);
+	}
+	memcpy(dst + posSize + 4, uv, sizeof(uv));
+}
+
+inline PackedVertices packVertices(const MeshData& mesh, VERTEXLAYOUT layout)
+{
+	PackedVertices out;
+	VertexFormat& format = out.format;
+	size_t count = mesh.vertexCount();
+
+	if (layout == VERTEXLAYOUT::SEPARATE) {
+		// Keep the three float streams back to back in a single buffer
+		format.layout = layout;
+		size_t posBytes = count * 3 * sizeof(float);
+		size_t nrmBytes = count * 3 * sizeof(float);
+		size_t uvBytes = count * 2 * sizeof(float);
+		out.bytes.resize(posBytes + nrmBytes + uvBytes);
+		memcpy(out.bytes.data(), mesh.positions.data(), posBytes);
+		memcpy(out.bytes.data() + posBytes, mesh.normals.data(), nrmBytes);
+		memcpy(out.bytes.data() + posBytes + nrmBytes, mesh.texcoords.data(), uvBytes);
+
+		format.vertexSize = 32;
+		format.attributes = {
+			{ 0, 3, GL_FLOAT, GL_FALSE, 12, 0 },
+			{ 1, 3, GL_FLOAT, GL_FALSE, 12, posBytes },
+			{ 2, 2, GL_FLOAT, GL_FALSE, 8, posBytes + nrmBytes },
+		};
+		return out;
+	}
+
+	bool uvInUnitRange = true;
+	for (float t : mesh.texcoords) {
+		if (t < 0.0f || t > 1.0f) {
+			uvInUnitRange = false;
+			break;
+		}
+	}
+
+	glm::vec3 minPos(0.0f), maxPos(0.0f);
+	if (count > 0) {
+		minPos = maxPos = glm::vec3(mesh.positions[0], mesh.positions[1], mesh.positions[2]);
+		for (size_t i = 1; i < count; i++) {
+			glm::vec3 p(mesh.positions[i * 3 + 0], mesh.positions[i * 3 + 1], mesh.positions[i * 3 + 2]);
+			minPos = glm::min(minPos, p);
+			maxPos = glm::max(maxPos, p);
+		}
+	}
+
+	format = interleavedFormat(layout, uvInUnitRange, minPos, maxPos);
+	out.bytes.resize(count * format.vertexSize);
+	for (size_t i = 0; i < count; i++) {
+		packVertex(format, &mesh.positions[i * 3], &mesh.normals[i * 3], &mesh.texcoords[i * 2],
+			out.bytes.data() + i * format.vertexSize);
+	}
+	return out;
+}
@@ -11,6 +11,13 @@
 
 #include "./header/Shader.h"
 #include "./header/Object.h"
+#include "./header/AssetLoader.h"
+#include "./header/MeshCache.h"
+#include "./header/StreamBuffer.h"
+#include "./header/FrameUniforms.h"
+#include "./header/DrawBatch.h"
+#include "./header/HotReload.h"
+#include "./header/ShaderCache.h"
 
 // Settings
 const int INITIAL_SCR_WIDTH = 800;
@@ -26,11 +33,41 @@ int SCR_WIDTH = INITIAL_SCR_WIDTH;
 int SCR_HEIGHT = INITIAL_SCR_HEIGHT;
 
 // Global objects
-Shader* shader = nullptr;
-Object* cube = nullptr;
-Object* fish1 = nullptr;
-Object* fish2 = nullptr;
-Object* fish3 = nullptr;
+Shader* shader = nullptr; // the shading mode drawn this frame
+ShaderCache* shaders = nullptr;
+AssetLoader* assets = nullptr;
+MeshCache* meshes = nullptr;
+HotReload* hotReload = nullptr;
+MaterialLibrary* materials = nullptr;
+StreamBuffer* stream = nullptr;
+FrameUniformBuffer* frameUniforms = nullptr;
+DrawBatch* drawBatch = nullptr;
+// Uniforms of `shader` written every draw; camera and light go through
+// frameUniforms
+struct ShaderUniforms {
+    UniformHandle<glm::vec3> dequantScale;
+    UniformHandle<glm::vec3> dequantOffset;
+} uniforms;
+// Permutations of easy.vert and easy.frag that N cycles through. Each is
+// requested from `shaders` the first time it is wanted; the one on screen
+// stays until it has compiled.
+struct ShadingMode {
+    ShaderDefines defines;
+    Shader* shader = nullptr;
+    ShaderUniforms uniforms;
+};
+ShadingMode shadingModes[] = {
+    { {}, nullptr, ShaderUniforms() },
+    { { { "SHOW_NORMALS", "" } }, nullptr, ShaderUniforms() },
+};
+const int SHADING_MODE_COUNT = sizeof(shadingModes) / sizeof(shadingModes[0]);
+int wantedShading = 0;
+int drawnShading = 0;
+std::string shaderDirectory;
+MeshHandle cube;
+MeshHandle fish1;
+MeshHandle fish2;
+MeshHandle fish3;
 
 struct Fish {
     glm::vec3 position;
@@ -40,6 +77,7 @@ struct Fish {
     float speed = 3.0f;
     glm::vec3 scale = glm::vec3(2.0f, 2.0f, 2.0f);
     glm::vec3 color = glm::vec3(1.0f, 0.5f, 0.3f);
+    int lod = 0; // level drawn last frame, for LOD hysteresis
 };
 
 struct SeaweedSegment {
@@ -78,16 +116,31 @@ std::vector<Fish> schoolFish;
 
 float globalTime = 0.0f;
 
+// Triangles drawn this frame, how many more full detail would have cost, and
+// how many meshlet culling skipped; draw calls and the material binds they
+// needed
+struct DrawStats {
+    size_t drawn = 0;
+    size_t saved = 0;
+    size_t culled = 0;
+    size_t draws = 0;
+    size_t materialBinds = 0;
+    size_t glIssued = 0; // state changes and uniform writes GLState passed on
+    size_t glElided = 0; // and dropped as redundant
+} drawStats;
+
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods);
 void processInput(GLFWwindow* window, float deltaTime);
-void drawModel(std::string type, const glm::mat4& model, const glm::mat4& view, const glm::mat4& projection, const glm::vec3& color);
+void drawModel(std::string type, const glm::mat4& model, const glm::mat4& view, const glm::mat4& projection, const glm::vec3& color, int* lod = nullptr);
+void flushDraws(const glm::mat4& view, const glm::mat4& projection);
+void selectShading(bool wait = false);
 void drawPlayerFish(const glm::vec3& position, float angle, float tailPhase,
                     const glm::mat4& view, const glm::mat4& projection, bool mouthOpen, float deltaTime);
 void updateSchoolFish(float deltaTime);
 void initializeAquarium();
 void cleanup();
-void init();
+void init(GLFWwindow* window);
 
 int main() {
     // Initialize random seed for aquarium elements
@@ -120,16 +173,17 @@ int main() {
     }
 
     // TODO: Enable depth test, face culling
-    glEnable(GL_DEPTH_TEST);
-    glDepthFunc(GL_LEQUAL);
-    glEnable(GL_CULL_FACE);
-    glFrontFace(GL_CCW);
-    glCullFace(GL_BACK);
+    glState().enable(GL_DEPTH_TEST);
+    glState().depthFunc(GL_LEQUAL);
+    glState().enable(GL_CULL_FACE);
+    glState().frontFace(GL_CCW);
+    glState().cullFace(GL_BACK);
 
-    init();
+    init(window);
     initializeAquarium();
 
     float lastFrame = glfwGetTime();
+    float lastTitleUpdate = lastFrame;
 
     while (!glfwWindowShouldClose(window)) {
         float currentFrame = glfwGetTime();
@@ -137,16 +191,34 @@ int main() {
         lastFrame = currentFrame;
         globalTime = currentFrame;
 
+        // Queue reloads of edited shaders and meshes, then pick up whatever the
+        // loader finished since the last frame, reloads included
+        hotReload->update();
+        assets->update();
+
         playerFish.tailAnimation += deltaTime * TAIL_ANIMATION_SPEED;
+        drawStats = DrawStats();
+        glState().resetStats();
 
         glClearColor(0.2f, 0.5f, 0.8f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+        selectShading();
         shader->use();
 
         glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 10.0f, 25.0f), glm::vec3(0.0f, 8.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
         glm::mat4 projection = glm::perspective(glm::radians(45.0f), static_cast<float>(SCR_WIDTH) / static_cast<float>(SCR_HEIGHT), 0.1f, 1000.0f);
 
+        FrameUniforms frame = {};
+        frame.view = view;
+        frame.projection = projection;
+        frame.viewProjection = projection * view;
+        frame.lightPosition = glm::vec4(0.0f, 200.0f, 100.0f, 1.0f);
+        frame.lightColor = glm::vec4(1.0f);
+        frame.time = globalTime;
+        frame.deltaTime = deltaTime;
+        frameUniforms->update(frame);
+
         glm::mat4 baseModel = glm::mat4(1.0f);
         baseModel = glm::translate(baseModel, glm::vec3(0.0f, 0.0f, 0.0f));
         baseModel = glm::scale(baseModel, glm::vec3(70.0f, 1.0f, 40.0f));
@@ -173,20 +245,33 @@ int main() {
             }
         }
 
-        for (const auto& fish : schoolFish) {
+        for (auto& fish : schoolFish) {
             glm::mat4 model(1.0f);
             model = glm::translate(model, fish.position);
             model = glm::rotate(model, fish.angle, glm::vec3(0.0f, 1.0f, 0.0f));
             model = glm::scale(model, fish.scale);
-            drawModel(fish.fishType, model, view, projection, fish.color);
+            drawModel(fish.fishType, model, view, projection, fish.color, &fish.lod);
         }
         updateSchoolFish(deltaTime);
 
         drawPlayerFish(playerFish.position, playerFish.angle, playerFish.tailAnimation,
                         view, projection, playerFish.mouthOpen, deltaTime);
+        flushDraws(view, projection);
+        stream->endFrame();
+        drawStats.glIssued = glState().frameStats().issuedTotal();
+        drawStats.glElided = glState().frameStats().elidedTotal();
 
         processInput(window, deltaTime);
 
+        if (currentFrame - lastTitleUpdate >= 1.0f) {
+            std::string title = "GPU-Accelerated Aquarium | " + std::to_string(drawStats.drawn) + " triangles, "
+                + std::to_string(drawStats.saved) + " saved by LOD, " + std::to_string(drawStats.culled) + " culled, "
+                + std::to_string(drawStats.draws) + " draws in " + std::to_string(drawStats.materialBinds) + " material binds, "
+                + std::to_string(drawStats.glIssued) + " GL calls issued, " + std::to_string(drawStats.glElided) + " elided";
+            glfwSetWindowTitle(window, title.c_str());
+            lastTitleUpdate = currentFrame;
+        }
+
         glfwSwapBuffers(window);
         glfwPollEvents();
     }
@@ -259,6 +344,10 @@ void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
         glfwSetWindowShouldClose(window, true);
     }
 
+    if (key == GLFW_KEY_N && action == GLFW_PRESS) {
+        wantedShading = (wantedShading + 1) % SHADING_MODE_COUNT;
+    }
+
     // TODO: Implement mouth toggle logic
     if (key == GLFW_KEY_M && action == GLFW_PRESS) {
         playerFish.mouthOpen = !playerFish.mouthOpen;
@@ -268,23 +357,57 @@ void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
     }
 }
 
-void drawModel(std::string type, const glm::mat4& model, const glm::mat4& view, const glm::mat4& projection, const glm::vec3& color) {
-    shader->set_uniform("projection", projection);
-    shader->set_uniform("view", view);
-    shader->set_uniform("model", model);
-    shader->set_uniform("objectColor", color);
+// Queue a draw for flushDraws(). `lod` keeps the level a draw site used last
+// frame so the LOD selection has hysteresis; without it the level is picked
+// from scratch every time.
+void drawModel(std::string type, const glm::mat4& model, const glm::mat4& view, const glm::mat4& projection, const glm::vec3& color, int* lod) {
+    Object* object = nullptr;
     if (type == "fish1") {
-        fish1->draw();
+        object = fish1.get();
     } else if (type == "fish2") {
-        fish2->draw();
+        object = fish2.get();
     } else if (type == "fish3") {
-        fish3->draw();
+        object = fish3.get();
     }else if (type == "cube") {
-        cube->draw();
+        object = cube.get();
     }
+    // Not uploaded yet: stand in with the cube, or skip the draw entirely
+    if (object && !object->resident())
+        object = cube->resident() ? cube.get() : nullptr;
+    if (object) {
+        int level = object->selectLod(view * model, projection, SCR_HEIGHT, lod ? *lod : 0);
+        if (lod)
+            *lod = level;
+        drawBatch->add(object, model, materials->add(colorMaterial(color)), level);
+    }
+}
+
+// Draw everything drawModel() queued this frame, one material at a time
+void flushDraws(const glm::mat4& view, const glm::mat4& projection) {
+    materials->resetStats();
+    drawStats.draws += drawBatch->size();
+    drawBatch->flush([&](const DrawBatch::Item& item) {
+        Object* object = item.object;
+        uniforms.dequantScale.set(object->dequantScale);
+        uniforms.dequantOffset.set(object->dequantOffset);
+        if (object->submeshes().size() > 1) {
+            object->drawSubmesh(item.submesh);
+            drawStats.drawn += object->submeshes()[item.submesh].indexCount / 3;
+            return;
+        }
+        size_t culled = 0;
+        if (item.lod == 0)
+            culled = object->drawCulled(item.model, view, projection);
+        else
+            object->draw(item.lod);
+        drawStats.drawn += object->triangleCount(item.lod) - culled;
+        drawStats.saved += object->triangleCount(0) - object->triangleCount(item.lod);
+        drawStats.culled += culled;
+    });
+    drawStats.materialBinds += materials->bindCount();
 }
 
-void init() {
+void init(GLFWwindow* window) {
 #if defined(__linux__) || defined(__APPLE__)
     std::string dirShader = "shaders/";
     std::string dirAsset = "asset/";
@@ -293,23 +416,100 @@ void init() {
     std::string dirAsset = "asset\\";
 #endif
 
-    shader = new Shader((dirShader + "easy.vert").c_str(), (dirShader + "easy.frag").c_str());
+    materials = new MaterialLibrary();
+    // Per-frame data such as the transforms of every draw; grows if a frame
+    // needs more
+    stream = new StreamBuffer(256 * 1024);
+    frameUniforms = new FrameUniformBuffer(*stream);
+    drawBatch = new DrawBatch(*materials, *stream);
    
-    cube = new Object(dirAsset + "cube.obj");
-    fish1 = new Object(dirAsset + "fish1.obj");
-    fish2 = new Object(dirAsset + "fish2.obj");
-    fish3 = new Object(dirAsset + "fish3.obj");
+    // The cube is built in (Primitives.h), so it is resident right away and
+    // stands in for the fish until they are. The fish load in the background
+    // and are drawn once resident. Loading through the MeshCache means
+    // asking for the same file again, e.g. for more fish variants, just
+    // shares the already uploaded buffers.
+    cube = std::make_shared<Object>("cube", primitiveCube());
+    assets = new AssetLoader(window);
+    meshes = new MeshCache(assets);
+    fish1 = meshes->load(dirAsset + "fish1.obj");
+    fish2 = meshes->load(dirAsset + "fish2.obj");
+    fish3 = meshes->load(dirAsset + "fish3.obj");
+
+    // Edits to the copies next to the executable show up without a restart
+    hotReload = new HotReload(*assets, *meshes);
+    hotReload->watch(dirShader);
+    hotReload->watch(dirAsset);
+
+    // Shading modes other than the first compile on the upload thread when
+    // first wanted
+    shaderDirectory = dirShader;
+    shaders = new ShaderCache(assets, [](Shader& variant) {
+        variant.bind_uniform_block("Material", MATERIAL_BINDING, sizeof(Material));
+        variant.bind_uniform_block("Transform", TRANSFORM_BINDING, sizeof(DrawTransform));
+        hotReload->addShader(variant);
+    });
+    selectShading(true);
+}
+
+// Point `shader` at the wanted shading mode once it has compiled, asking
+// `shaders` for it the first time; `wait` compiles it on the spot
+void selectShading(bool wait) {
+    ShadingMode& wanted = shadingModes[wantedShading];
+    if (!wanted.shader) {
+        wanted.shader = &shaders->get(shaderDirectory + "easy.vert", shaderDirectory + "easy.frag", wanted.defines, wait);
+        wanted.uniforms.dequantScale = wanted.shader->uniform<glm::vec3>("dequantScale");
+        wanted.uniforms.dequantOffset = wanted.shader->uniform<glm::vec3>("dequantOffset");
+    }
+    if (wanted.shader->ready())
+        drawnShading = wantedShading;
+    shader = shadingModes[drawnShading].shader;
+    uniforms = shadingModes[drawnShading].uniforms;
 }
 
 void cleanup() {
-    if (shader) {
-        delete shader;
+    if (hotReload) {
+        delete hotReload;
+        hotReload = nullptr;
+    }
+
+    // Stop the loader threads first; jobs still in flight hold mesh references
+    if (assets) {
+        delete assets;
+        assets = nullptr;
+    }
+
+    // Compiles still queued were dropped with the loader
+    if (shaders) {
+        delete shaders;
+        shaders = nullptr;
         shader = nullptr;
     }
+    if (drawBatch) {
+        delete drawBatch;
+        drawBatch = nullptr;
+    }
+    if (frameUniforms) {
+        delete frameUniforms;
+        frameUniforms = nullptr;
+    }
+    if (stream) {
+        delete stream;
+        stream = nullptr;
+    }
+    if (materials) {
+        delete materials;
+        materials = nullptr;
+    }
     
-    if (cube) {
-        delete cube;
-        cube = nullptr;
+    // Dropping the last handles frees the GL buffers, so do it while the
+    // context is still alive
+    cube.reset();
+    fish1.reset();
+    fish2.reset();
+    fish3.reset();
+    if (meshes) {
+        delete meshes;
+        meshes = nullptr;
     }
     
     for (auto& seaweed : seaweeds) {
@@ -5,19 +5,31 @@ in vec3 Normal;
 in vec3 FragPos;  
 in vec2 TexCoord; 
 
-uniform vec3 objectColor; 
+// Material in Material.h, bound at MATERIAL_BINDING
+layout (std140) uniform Material
+{
+    vec4 diffuse;  // rgb, opacity
+    vec4 emission; // rgb
+} material;
+
+#include "frame.glsl"
 
 void main()
 {
-    vec3 lightPos = vec3(0,200,100);
-    vec3 lightColor = vec3(1,1,1);
+    vec3 lightPos = frame.lightPosition.xyz;
+    vec3 lightColor = frame.lightColor.rgb;
   	
     // diffuse 
     vec3 norm = normalize(Normal);
+#ifdef SHOW_NORMALS
+    // Debug view: world space normals as colors
+    FragColor = vec4(norm * 0.5 + 0.5, 1.0);
+    return;
+#endif
     vec3 lightDir = normalize(lightPos - FragPos);
     float diff = max(dot(norm, lightDir), 0.0);
     vec3 diffuse = diff * lightColor;
         
-    vec3 result = diffuse * objectColor;
-    FragColor = vec4(result, 1.0);
+    vec3 result = diffuse * material.diffuse.rgb + material.emission.rgb;
+    FragColor = vec4(result, material.diffuse.a);
 } 
\ No newline at end of file
@@ -7,14 +7,24 @@ out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoord;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// DrawTransform in DrawBatch.h, bound at TRANSFORM_BINDING
+layout (std140) uniform Transform
+{
+    mat4 model;
+} transform;
+
+#include "frame.glsl"
+
+// Quantized meshes store positions in [0,1] over their bounding box
+uniform vec3 dequantScale = vec3(1.0);
+uniform vec3 dequantOffset = vec3(0.0);
 
 void main()
 {
-    FragPos = vec3(model * vec4(aPos, 1.0));
+    vec3 position = aPos * dequantScale + dequantOffset;
+    mat4 model = transform.model;
+    FragPos = vec3(model * vec4(position, 1.0));
     Normal = mat3(transpose(inverse(model))) * aNormal;  
     TexCoord = aTexCoord;
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    gl_Position = frame.viewProjection * vec4(FragPos, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,11 @@
+// FrameUniforms in FrameUniforms.h, bound at FRAME_BINDING
+layout (std140) uniform Frame
+{
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec4 lightPosition;
+    vec4 lightColor;
+    float time;
+    float deltaTime;
+} frame;
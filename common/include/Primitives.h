@@ -0,0 +1,244 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+using namespace std;
+
+// Built-in meshes generated at compile time: cube, cylinder, sphere,
+// capsule and a segmented strip, all centered on the origin with CCW front
+// faces. Each is an indexed PrimitiveMesh of interleaved position, normal,
+// texcoord vertices and 16-bit indices, sized by its template arguments.
+// Call the generators from a constant expression to get the arrays baked
+// into the binary, e.g. primitiveCube():
+//
+//     static constexpr auto mesh = makeSphere<32, 16>();
+//
+// Stays C++14 so both assignments can share it from common/include.
+
+struct PrimitiveVertex
+{
+	float position[3];
+	float normal[3];
+	float texcoord[2];
+};
+
+template <size_t V, size_t I>
+struct PrimitiveMesh
+{
+	static_assert(V <= 0x10000, "PrimitiveMesh indices are 16 bit");
+	static constexpr size_t vertexCount = V;
+	static constexpr size_t indexCount = I;
+
+	PrimitiveVertex vertices[V];
+	uint16_t indices[I];
+};
+
+namespace primitives
+{
+	constexpr double PI = 3.14159265358979323846;
+
+	// Taylor series after reducing to [-pi, pi]; well below float precision
+	constexpr double sine(double x)
+	{
+		long long turns = static_cast<long long>(x / (2.0 * PI) + (x >= 0.0 ? 0.5 : -0.5));
+		x -= static_cast<double>(turns) * 2.0 * PI;
+		double term = x, sum = x;
+		for (int n = 1; n < 14; n++) {
+			term *= -x * x / ((2.0 * n) * (2.0 * n + 1.0));
+			sum += term;
+		}
+		return sum;
+	}
+
+	constexpr double cosine(double x)
+	{
+		return sine(x + PI / 2.0);
+	}
+
+	template <size_t V, size_t I>
+	constexpr void setVertex(PrimitiveMesh<V, I>& mesh, size_t i, double px, double py, double pz, double nx,
+		double ny, double nz, double u, double v)
+	{
+		PrimitiveVertex& vertex = mesh.vertices[i];
+		vertex.position[0] = float(px);
+		vertex.position[1] = float(py);
+		vertex.position[2] = float(pz);
+		vertex.normal[0] = float(nx);
+		vertex.normal[1] = float(ny);
+		vertex.normal[2] = float(nz);
+		vertex.texcoord[0] = float(u);
+		vertex.texcoord[1] = float(v);
+	}
+
+	template <size_t V, size_t I>
+	constexpr void setTriangle(PrimitiveMesh<V, I>& mesh, size_t& next, size_t a, size_t b, size_t c)
+	{
+		mesh.indices[next++] = uint16_t(a);
+		mesh.indices[next++] = uint16_t(b);
+		mesh.indices[next++] = uint16_t(c);
+	}
+
+	// Rows of Slices + 1 vertices around the Y axis, from the top pole row
+	// down to the bottom pole row; the first and last column meet at the
+	// seam with different texcoords. Row r sits at polar angle theta[r] on a
+	// sphere of `radius` moved up by yOffset[r], so a sphere has one offset
+	// and a capsule pulls its two hemispheres apart.
+	template <size_t Slices, size_t Rows, size_t V, size_t I>
+	constexpr void revolve(PrimitiveMesh<V, I>& mesh, double radius, const double (&theta)[Rows],
+		const double (&yOffset)[Rows], double length)
+	{
+		size_t next = 0;
+		for (size_t r = 0; r < Rows; r++) {
+			double sinTheta = sine(theta[r]), cosTheta = cosine(theta[r]);
+			double y = radius * cosTheta + yOffset[r];
+			for (size_t s = 0; s <= Slices; s++) {
+				double phi = 2.0 * PI * double(s) / double(Slices);
+				double nx = sinTheta * sine(phi), nz = sinTheta * cosine(phi);
+				setVertex(mesh, next++, radius * nx, y, radius * nz, nx, cosTheta, nz, double(s) / double(Slices),
+					0.5 + y / length);
+			}
+		}
+		next = 0;
+		for (size_t r = 0; r + 1 < Rows; r++) {
+			for (size_t s = 0; s < Slices; s++) {
+				size_t a = r * (Slices + 1) + s, b = a + Slices + 1;
+				if (r > 0)
+					setTriangle(mesh, next, a, b, a + 1);
+				if (r + 2 < Rows)
+					setTriangle(mesh, next, a + 1, b, b + 1);
+			}
+		}
+	}
+} // namespace primitives
+
+// Unit cube: 24 vertices so every face has its own normal and 0..1 texcoords
+constexpr PrimitiveMesh<24, 36> makeCube()
+{
+	// Normal, then two edge directions whose cross product is the normal
+	const double faces[6][9] = {
+		{ 1, 0, 0, 0, 0, -1, 0, 1, 0 },
+		{ -1, 0, 0, 0, 0, 1, 0, 1, 0 },
+		{ 0, 1, 0, 1, 0, 0, 0, 0, -1 },
+		{ 0, -1, 0, 1, 0, 0, 0, 0, 1 },
+		{ 0, 0, 1, 1, 0, 0, 0, 1, 0 },
+		{ 0, 0, -1, -1, 0, 0, 0, 1, 0 },
+	};
+	const double corners[4][2] = { { -1, -1 }, { 1, -1 }, { 1, 1 }, { -1, 1 } };
+
+	PrimitiveMesh<24, 36> mesh{};
+	size_t next = 0;
+	for (size_t f = 0; f < 6; f++) {
+		const double* n = faces[f];
+		for (size_t c = 0; c < 4; c++) {
+			double s = corners[c][0], t = corners[c][1];
+			primitives::setVertex(mesh, f * 4 + c, 0.5 * (n[0] + s * n[3] + t * n[6]),
+				0.5 * (n[1] + s * n[4] + t * n[7]), 0.5 * (n[2] + s * n[5] + t * n[8]), n[0], n[1], n[2],
+				0.5 * (s + 1.0), 0.5 * (t + 1.0));
+		}
+		primitives::setTriangle(mesh, next, f * 4, f * 4 + 1, f * 4 + 2);
+		primitives::setTriangle(mesh, next, f * 4, f * 4 + 2, f * 4 + 3);
+	}
+	return mesh;
+}
+
+// Capped cylinder along Y. The side and each cap have their own ring of
+// vertices, so the rim keeps hard edges.
+template <size_t Segments>
+constexpr PrimitiveMesh<4 * Segments + 6, 12 * Segments> makeCylinder(double radius = 0.5, double height = 1.0)
+{
+	static_assert(Segments >= 3, "a cylinder needs at least 3 segments");
+	PrimitiveMesh<4 * Segments + 6, 12 * Segments> mesh{};
+	const size_t side = 0, top = 2 * (Segments + 1), bottom = top + Segments + 2;
+	size_t next = 0;
+	primitives::setVertex(mesh, top, 0.0, 0.5 * height, 0.0, 0.0, 1.0, 0.0, 0.5, 0.5);
+	primitives::setVertex(mesh, bottom, 0.0, -0.5 * height, 0.0, 0.0, -1.0, 0.0, 0.5, 0.5);
+	for (size_t s = 0; s <= Segments; s++) {
+		double phi = 2.0 * primitives::PI * double(s) / double(Segments);
+		double x = primitives::sine(phi), z = primitives::cosine(phi);
+		double u = double(s) / double(Segments);
+		primitives::setVertex(mesh, side + 2 * s, radius * x, -0.5 * height, radius * z, x, 0.0, z, u, 0.0);
+		primitives::setVertex(mesh, side + 2 * s + 1, radius * x, 0.5 * height, radius * z, x, 0.0, z, u, 1.0);
+		primitives::setVertex(mesh, top + 1 + s, radius * x, 0.5 * height, radius * z, 0.0, 1.0, 0.0,
+			0.5 + 0.5 * x, 0.5 - 0.5 * z);
+		primitives::setVertex(mesh, bottom + 1 + s, radius * x, -0.5 * height, radius * z, 0.0, -1.0, 0.0,
+			0.5 + 0.5 * x, 0.5 + 0.5 * z);
+	}
+	for (size_t s = 0; s < Segments; s++) {
+		size_t a = side + 2 * s;
+		primitives::setTriangle(mesh, next, a, a + 2, a + 3);
+		primitives::setTriangle(mesh, next, a, a + 3, a + 1);
+		primitives::setTriangle(mesh, next, top, top + 1 + s, top + 2 + s);
+		primitives::setTriangle(mesh, next, bottom, bottom + 2 + s, bottom + 1 + s);
+	}
+	return mesh;
+}
+
+// UV sphere; Stacks rows of quads between the poles, triangles at the poles
+template <size_t Slices, size_t Stacks>
+constexpr PrimitiveMesh<(Slices + 1) * (Stacks + 1), 6 * Slices * (Stacks - 1)> makeSphere(double radius = 0.5)
+{
+	static_assert(Slices >= 3 && Stacks >= 2, "a sphere needs at least 3 slices and 2 stacks");
+	double theta[Stacks + 1] = {};
+	double yOffset[Stacks + 1] = {};
+	for (size_t r = 0; r <= Stacks; r++)
+		theta[r] = primitives::PI * double(r) / double(Stacks);
+	PrimitiveMesh<(Slices + 1) * (Stacks + 1), 6 * Slices * (Stacks - 1)> mesh{};
+	primitives::revolve<Slices>(mesh, radius, theta, yOffset, 2.0 * radius);
+	return mesh;
+}
+
+// Cylinder of `height` overall with hemispherical ends of CapStacks rows
+// each; the straight part is one row of quads
+template <size_t Slices, size_t CapStacks>
+constexpr PrimitiveMesh<(Slices + 1) * (2 * CapStacks + 2), 12 * Slices * CapStacks> makeCapsule(
+	double radius = 0.25, double height = 1.0)
+{
+	static_assert(Slices >= 3 && CapStacks >= 1, "a capsule needs at least 3 slices and 1 cap stack");
+	const size_t rows = 2 * CapStacks + 2;
+	double theta[rows] = {};
+	double yOffset[rows] = {};
+	double shift = height > 2.0 * radius ? 0.5 * height - radius : 0.0;
+	for (size_t r = 0; r <= CapStacks; r++) {
+		theta[r] = 0.5 * primitives::PI * double(r) / double(CapStacks);
+		yOffset[r] = shift;
+		theta[rows - 1 - r] = primitives::PI - theta[r];
+		yOffset[rows - 1 - r] = -shift;
+	}
+	PrimitiveMesh<(Slices + 1) * (2 * CapStacks + 2), 12 * Slices * CapStacks> mesh{};
+	primitives::revolve<Slices>(mesh, radius, theta, yOffset, 2.0 * (shift + radius));
+	return mesh;
+}
+
+// Flat ribbon in the XY plane, cut into Segments quads along Y so it can be
+// bent per segment in a vertex shader. Front (+Z) and back (-Z) each have
+// their own vertices, so it shows from both sides with face culling on.
+template <size_t Segments>
+constexpr PrimitiveMesh<4 * (Segments + 1), 12 * Segments> makeStrip(double width = 1.0, double height = 1.0)
+{
+	static_assert(Segments >= 1, "a strip needs at least 1 segment");
+	PrimitiveMesh<4 * (Segments + 1), 12 * Segments> mesh{};
+	const size_t back = 2 * (Segments + 1);
+	size_t next = 0;
+	for (size_t s = 0; s <= Segments; s++) {
+		double v = double(s) / double(Segments), y = (v - 0.5) * height;
+		primitives::setVertex(mesh, 2 * s, -0.5 * width, y, 0.0, 0.0, 0.0, 1.0, 0.0, v);
+		primitives::setVertex(mesh, 2 * s + 1, 0.5 * width, y, 0.0, 0.0, 0.0, 1.0, 1.0, v);
+		primitives::setVertex(mesh, back + 2 * s, -0.5 * width, y, 0.0, 0.0, 0.0, -1.0, 1.0, v);
+		primitives::setVertex(mesh, back + 2 * s + 1, 0.5 * width, y, 0.0, 0.0, 0.0, -1.0, 0.0, v);
+	}
+	for (size_t s = 0; s < Segments; s++) {
+		size_t a = 2 * s, b = back + 2 * s;
+		primitives::setTriangle(mesh, next, a, a + 1, a + 3);
+		primitives::setTriangle(mesh, next, a, a + 3, a + 2);
+		primitives::setTriangle(mesh, next, b, b + 2, b + 3);
+		primitives::setTriangle(mesh, next, b, b + 3, b + 1);
+	}
+	return mesh;
+}
+
+// The unit cube, baked into the binary once however many files use it
+inline const PrimitiveMesh<24, 36>& primitiveCube()
+{
+	static constexpr PrimitiveMesh<24, 36> mesh = makeCube();
+	return mesh;
+}
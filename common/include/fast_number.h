@@ -0,0 +1,253 @@
+//
+// Locale independent number parsing for OBJ/MTL text.
+//
+// Shared by tinyobjloader and the hand-written CG_2025_HW0 loader so both
+// read `v`/`vn`/`vt` values and face indices the same way. Header only,
+// C++11 and later; std::from_chars is used as the slow path when the
+// standard library provides it. The one copy lives in common/include,
+// which both assignments put on their include path.
+//
+
+#ifndef FAST_NUMBER_H
+#define FAST_NUMBER_H
+
+#include <cfloat>
+#include <cstdint>
+#include <cstring>
+#include <locale>
+#include <sstream>
+#include <string>
+
+#if __cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+#include <charconv>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FAST_NUMBER_SSE2 1
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+#endif
+
+namespace fastnum
+{
+
+inline bool isDigit(char c)
+{
+    return static_cast<unsigned int>(c - '0') < 10u;
+}
+
+// Finds the first occurrence of `c` in [s, end), 16 bytes at a time where
+// SSE2 is available. Returns `end` if there is none.
+inline const char *findByte(const char *s, const char *end, char c)
+{
+#ifdef FAST_NUMBER_SSE2
+    const __m128i needle = _mm_set1_epi8(c);
+    while (end - s >= 16)
+    {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s));
+        unsigned int mask = static_cast<unsigned int>(
+            _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, needle)));
+        if (mask != 0)
+        {
+#if defined(_MSC_VER) && !defined(__clang__)
+            unsigned long bit;
+            _BitScanForward(&bit, mask);
+            return s + bit;
+#else
+            return s + __builtin_ctz(mask);
+#endif
+        }
+        s += 16;
+    }
+#endif
+    while (s < end && *s != c)
+        s++;
+    return s;
+}
+
+// Parses an optionally signed decimal integer at `s`. Returns the first
+// character after it, or `s` if there are no digits (value is untouched).
+inline const char *parseInt(const char *s, const char *end, int &value)
+{
+    const char *p = s;
+    bool negative = false;
+    if (p < end && (*p == '+' || *p == '-'))
+    {
+        negative = *p == '-';
+        p++;
+    }
+    if (p >= end || !isDigit(*p))
+        return s;
+
+    long long v = 0;
+    while (p < end && isDigit(*p))
+    {
+        if (v < 0x7FFFFFFFll)
+            v = v * 10 + (*p - '0');
+        p++;
+    }
+    if (v > 0x7FFFFFFFll)
+        v = 0x7FFFFFFFll;
+    value = static_cast<int>(negative ? -v : v);
+    return p;
+}
+
+namespace detail
+{
+
+// Correctly rounded fallback for inputs the fast path cannot handle exactly.
+inline float slowParseFloat(const char *s, const char *end)
+{
+    if (s < end && *s == '+')
+        s++;
+#if defined(__cpp_lib_to_chars)
+    float value = 0.0f;
+    std::from_chars(s, end, value);
+    return value;
+#else
+    std::istringstream ss(std::string(s, end));
+    ss.imbue(std::locale::classic());
+    float value = 0.0f;
+    ss >> value;
+    return value;
+#endif
+}
+
+} // namespace detail
+
+// Parses a decimal float: [+|-] digits [. digits] [(e|E) [+|-] digits],
+// where either the integer or the fraction digits may be empty.
+// Stores the correctly rounded value and returns the first character after
+// the number, or returns `s` (value untouched) if no number is present.
+//
+// Most OBJ values have at most 7 significant digits and a handful of
+// decimals. Those are exact as float mantissa and power of ten, so a single
+// IEEE multiply/divide already gives the correctly rounded result. Anything
+// else goes through from_chars.
+inline const char *parseFloat(const char *s, const char *end, float &value)
+{
+    static const float pow10[] = { 1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f,
+                                   1e6f, 1e7f, 1e8f, 1e9f, 1e10f };
+
+    const char *p = s;
+    bool negative = false;
+    if (p < end && (*p == '+' || *p == '-'))
+    {
+        negative = *p == '-';
+        p++;
+    }
+
+    uint64_t mantissa = 0;
+    int digits = 0;   // significant digits kept in `mantissa`
+    int exponent = 0; // decimal exponent applied to `mantissa`
+    bool any = false;
+    bool truncated = false;
+
+    while (p < end && isDigit(*p))
+    {
+        if (digits < 19)
+        {
+            mantissa = mantissa * 10 + static_cast<uint64_t>(*p - '0');
+            if (mantissa != 0)
+                digits++;
+        }
+        else
+        {
+            exponent++;
+            truncated |= *p != '0';
+        }
+        any = true;
+        p++;
+    }
+
+    if (p < end && *p == '.')
+    {
+        p++;
+        while (p < end && isDigit(*p))
+        {
+            if (digits < 19)
+            {
+                mantissa = mantissa * 10 + static_cast<uint64_t>(*p - '0');
+                if (mantissa != 0)
+                    digits++;
+                exponent--;
+            }
+            else
+            {
+                truncated |= *p != '0';
+            }
+            any = true;
+            p++;
+        }
+    }
+
+    if (!any)
+        return s;
+
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+        const char *q = p + 1;
+        bool expNegative = false;
+        if (q < end && (*q == '+' || *q == '-'))
+        {
+            expNegative = *q == '-';
+            q++;
+        }
+        if (q < end && isDigit(*q))
+        {
+            int e = 0;
+            while (q < end && isDigit(*q))
+            {
+                if (e < 100000)
+                    e = e * 10 + (*q - '0');
+                q++;
+            }
+            exponent += expNegative ? -e : e;
+            p = q;
+        }
+    }
+
+    if (mantissa == 0)
+    {
+        value = negative ? -0.0f : 0.0f;
+        return p;
+    }
+
+#if FLT_EVAL_METHOD == 0
+    if (!truncated && mantissa <= (uint64_t(1) << 24) && exponent >= -10 &&
+        exponent <= 10)
+    {
+        float f = static_cast<float>(mantissa);
+        f = exponent < 0 ? f / pow10[-exponent] : f * pow10[exponent];
+        value = negative ? -f : f;
+        return p;
+    }
+#endif
+
+    value = detail::slowParseFloat(s, p);
+    return p;
+}
+
+// Parses one face corner: "v", "v/t", "v//n" or "v/t/n". Missing members
+// are set to `missing`. Returns the first character after the corner.
+inline const char *parseIndexTriplet(const char *s, const char *end,
+                                     int index[3], int missing)
+{
+    index[0] = index[1] = index[2] = missing;
+    const char *p = parseInt(s, end, index[0]);
+    if (p >= end || *p != '/')
+        return p;
+    p++;
+    if (p < end && *p != '/')
+        p = parseInt(p, end, index[1]);
+    if (p >= end || *p != '/')
+        return p;
+    p++;
+    return parseInt(p, end, index[2]);
+}
+
+} // namespace fastnum
+
+#endif // FAST_NUMBER_H